@@ -0,0 +1,687 @@
+#include "simpson/jsonreader.h"
+#include "simpson/jsonwriter.h"
+#include "simpson/jsonvalue.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+using namespace Simpson;
+
+// Benchmarks parsing, serializing, traversing and copying a set of generated JSON corpora.
+//
+// The corpora are generated from a fixed seed with our own random number generator and formatting,
+// so they are byte-for-byte identical on every platform and at every commit, and results can be
+// compared between commits. Use --json to write the results in machine-readable form.
+
+////////////////////////////////////////
+// allocation tracking
+
+namespace
+{
+    std::atomic<long long> g_allocations(0);
+    std::atomic<long long> g_liveBytes(0);
+
+    // each allocation is prefixed with its size and offset from the start of the block,
+    // so we can track the number of bytes in use
+    const size_t k_allocHeader = 16;
+
+    void* allocate(size_t size, size_t alignment = k_allocHeader)
+    {
+        size_t header = alignment > k_allocHeader ? alignment : k_allocHeader;
+        char* block = (char*) std::malloc(size + header + alignment);
+        if (!block)
+        {
+            throw std::bad_alloc();
+        }
+        char* p = block + header;
+        p += (alignment - (uintptr_t) p % alignment) % alignment;
+        ((size_t*) p)[-1] = size;
+        ((size_t*) p)[-2] = p - block;
+        ++g_allocations;
+        g_liveBytes += size;
+        return p;
+    }
+
+    void deallocate(void* p)
+    {
+        if (p)
+        {
+            g_liveBytes -= ((size_t*) p)[-1];
+            std::free((char*) p - ((size_t*) p)[-2]);
+        }
+    }
+}
+
+void* operator new(size_t size) { return allocate(size); }
+void* operator new[](size_t size) { return allocate(size); }
+void* operator new(size_t size, std::align_val_t alignment) { return allocate(size, (size_t) alignment); }
+void* operator new[](size_t size, std::align_val_t alignment) { return allocate(size, (size_t) alignment); }
+void operator delete(void* p) noexcept { deallocate(p); }
+void operator delete[](void* p) noexcept { deallocate(p); }
+void operator delete(void* p, size_t) noexcept { deallocate(p); }
+void operator delete[](void* p, size_t) noexcept { deallocate(p); }
+void operator delete(void* p, std::align_val_t) noexcept { deallocate(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { deallocate(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { deallocate(p); }
+void operator delete[](void* p, size_t, std::align_val_t) noexcept { deallocate(p); }
+
+namespace
+{
+
+long long peakRss()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+    return (long long) counters.PeakWorkingSetSize;
+#else
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return (long long) usage.ru_maxrss; // bytes
+#else
+    return (long long) usage.ru_maxrss * 1024; // kilobytes
+#endif
+#endif
+}
+
+////////////////////////////////////////
+// corpus generation
+
+class Random
+{
+public:
+    Random(uint64_t seed) : m_state(seed) {}
+
+    // splitmix64
+    uint64_t next()
+    {
+        uint64_t z = (m_state += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+
+    int range(int lo, int hi) // inclusive
+    {
+        return lo + (int) (next() % (uint64_t) (hi - lo + 1));
+    }
+
+    bool chance(int percent)
+    {
+        return range(0, 99) < percent;
+    }
+
+private:
+    uint64_t m_state;
+};
+
+const char* k_words[] =
+{
+    "the", "quick", "brown", "fox", "jumps", "over", "lazy", "dog", "lorem", "ipsum", "dolor", "sit", "amet",
+    "server", "request", "timeout", "cache", "latency", "json", "parser", "benchmark", "simple", "fast", "value",
+    "caf\\u00e9", "na\\u00efve", "\\\"quoted\\\"", "back\\\\slash", "tab\\there", "\\u263a", "\xe2\x98\x83", "\xc3\xa9t\xc3\xa9",
+};
+const int k_numWords = sizeof(k_words) / sizeof(k_words[0]);
+
+void appendWords(std::string& out, Random& random, int count)
+{
+    for (int i = 0; i < count; ++i)
+    {
+        if (i > 0)
+        {
+            out += ' ';
+        }
+        // mostly plain ASCII words, with occasional escapes and multibyte characters
+        out += k_words[random.chance(90) ? random.range(0, 23) : random.range(24, k_numWords-1)];
+    }
+}
+
+void appendInt(std::string& out, long long n)
+{
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%lld", n);
+    out += buf;
+}
+
+void appendDouble(std::string& out, Random& random)
+{
+    char buf[64];
+    double mantissa = (double) (random.next() % 100000000) / 1000.0;
+    switch (random.range(0, 3))
+    {
+        case 0: snprintf(buf, sizeof(buf), "%.2f", mantissa); break;
+        case 1: snprintf(buf, sizeof(buf), "%.6f", -mantissa / 100.0); break;
+        case 2: snprintf(buf, sizeof(buf), "%.17g", mantissa * 1.0e-7); break;
+        default: snprintf(buf, sizeof(buf), "%.4e", mantissa * 1.0e12); break;
+    }
+    out += buf;
+}
+
+// records similar to the twitter API: mixed types, nested objects, large ids, lots of short strings
+std::string generateTwitter(size_t targetSize)
+{
+    Random random(1);
+    std::string out = "{\"statuses\":[";
+    for (int i = 0; out.size() < targetSize; ++i)
+    {
+        if (i > 0)
+        {
+            out += ',';
+        }
+        long long id = 250075927172759552LL + (long long) (random.next() % 1000000000000LL);
+        out += "{\"id\":";
+        appendInt(out, id);
+        out += ",\"id_str\":\"";
+        appendInt(out, id);
+        out += "\",\"created_at\":\"Mon Sep 24 03:35:";
+        appendInt(out, random.range(10, 59));
+        out += " +0000 2012\",\"text\":\"";
+        appendWords(out, random, random.range(5, 25));
+        out += "\",\"truncated\":false,\"user\":{\"id\":";
+        appendInt(out, random.range(1000, 2000000000));
+        out += ",\"name\":\"";
+        appendWords(out, random, 2);
+        out += "\",\"screen_name\":\"user";
+        appendInt(out, random.range(0, 99999));
+        out += "\",\"description\":\"";
+        appendWords(out, random, random.range(0, 15));
+        out += "\",\"followers_count\":";
+        appendInt(out, random.range(0, 5000000));
+        out += ",\"friends_count\":";
+        appendInt(out, random.range(0, 5000));
+        out += ",\"verified\":";
+        out += random.chance(5) ? "true" : "false";
+        out += ",\"profile_background_color\":\"C0DEED\",\"utc_offset\":";
+        out += random.chance(30) ? "null" : "-18000";
+        out += "},\"geo\":null,\"coordinates\":";
+        if (random.chance(20))
+        {
+            out += "{\"type\":\"Point\",\"coordinates\":[";
+            appendDouble(out, random);
+            out += ',';
+            appendDouble(out, random);
+            out += "]}";
+        }
+        else
+        {
+            out += "null";
+        }
+        out += ",\"retweet_count\":";
+        appendInt(out, random.range(0, 1000));
+        out += ",\"favorited\":false,\"entities\":{\"hashtags\":[";
+        int hashtags = random.range(0, 3);
+        for (int h = 0; h < hashtags; ++h)
+        {
+            out += h > 0 ? ",{\"text\":\"" : "{\"text\":\"";
+            appendWords(out, random, 1);
+            out += "\",\"indices\":[";
+            appendInt(out, h*10);
+            out += ',';
+            appendInt(out, h*10 + 8);
+            out += "]}";
+        }
+        out += "],\"urls\":[],\"user_mentions\":[]},\"lang\":\"en\"}";
+    }
+    out += "],\"search_metadata\":{\"completed_in\":0.087,\"max_id\":250126199840518145,\"query\":\"%23freebandnames\",\"count\":100}}";
+    return out;
+}
+
+// time series and coordinates: arrays dominated by floating-point and integer numbers
+std::string generateNumbers(size_t targetSize)
+{
+    Random random(2);
+    std::string out = "[";
+    for (int i = 0; out.size() < targetSize; ++i)
+    {
+        if (i > 0)
+        {
+            out += ',';
+        }
+        out += '[';
+        appendInt(out, 1600000000000LL + i*1000);
+        for (int j = 0; j < 8; ++j)
+        {
+            out += ',';
+            if (random.chance(50))
+            {
+                appendDouble(out, random);
+            }
+            else
+            {
+                appendInt(out, random.range(-100000, 100000));
+            }
+        }
+        out += ']';
+    }
+    out += ']';
+    return out;
+}
+
+// log records: few, mostly long strings, some with escapes
+std::string generateLogs(size_t targetSize)
+{
+    static const char* levels[] = { "DEBUG", "INFO", "INFO", "INFO", "WARN", "ERROR" };
+
+    Random random(3);
+    std::string out = "[";
+    for (int i = 0; out.size() < targetSize; ++i)
+    {
+        if (i > 0)
+        {
+            out += ",\n";
+        }
+        out += "{\"timestamp\":\"2024-03-";
+        appendInt(out, 10 + i % 20);
+        out += "T12:";
+        appendInt(out, 10 + i % 50);
+        out += ":00.";
+        appendInt(out, 100 + i % 900);
+        out += "Z\",\"level\":\"";
+        out += levels[random.range(0, 5)];
+        out += "\",\"host\":\"web-";
+        appendInt(out, random.range(10, 99));
+        out += ".example.com\",\"request_id\":\"";
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%016llx", (unsigned long long) random.next());
+        out += buf;
+        out += "\",\"message\":\"";
+        appendWords(out, random, random.range(20, 80));
+        if (random.chance(20))
+        {
+            out += "\\n\\tat com.example.Handler.process(Handler.java:";
+            appendInt(out, random.range(1, 999));
+            out += ")\\n\\tat com.example.Server.run(Server.java:42)";
+        }
+        out += "\"}";
+    }
+    out += "]";
+    return out;
+}
+
+// deeply nested objects and arrays, with a little data at each level
+std::string generateNested(size_t targetSize)
+{
+    const int depth = 200;
+
+    Random random(4);
+    std::string out = "[";
+    for (int i = 0; out.size() < targetSize; ++i)
+    {
+        if (i > 0)
+        {
+            out += ',';
+        }
+        for (int d = 0; d < depth; ++d)
+        {
+            if (d % 2 == 0)
+            {
+                out += "{\"level\":";
+                appendInt(out, d);
+                out += ",\"name\":\"";
+                appendWords(out, random, 1);
+                out += "\",\"child\":";
+            }
+            else
+            {
+                out += "[";
+                appendInt(out, d);
+                out += ",true,";
+            }
+        }
+        out += "null";
+        for (int d = depth-1; d >= 0; --d)
+        {
+            out += d % 2 == 0 ? "}" : "]";
+        }
+    }
+    out += "]";
+    return out;
+}
+
+// objects with thousands of keys
+std::string generateWide(size_t targetSize)
+{
+    const int width = 2000;
+
+    Random random(5);
+    std::string out = "[";
+    for (int i = 0; out.size() < targetSize; ++i)
+    {
+        out += i > 0 ? ",{" : "{";
+        for (int k = 0; k < width; ++k)
+        {
+            if (k > 0)
+            {
+                out += ',';
+            }
+            char key[32];
+            snprintf(key, sizeof(key), "\"field_%04x_%d\":", (unsigned) (random.next() & 0xffff), k);
+            out += key;
+            switch (random.range(0, 3))
+            {
+                case 0: appendInt(out, random.range(0, 1000000)); break;
+                case 1: appendDouble(out, random); break;
+                case 2: out += '"'; appendWords(out, random, 2); out += '"'; break;
+                default: out += random.chance(50) ? "true" : "null"; break;
+            }
+        }
+        out += '}';
+    }
+    out += "]";
+    return out;
+}
+
+struct Corpus
+{
+    const char* name;
+    std::function<std::string(size_t)> generate;
+    size_t size; // target size at scale 1
+};
+
+////////////////////////////////////////
+// measurement
+
+struct Measurement
+{
+    double seconds = 0; // fastest run
+    int runs = 0;
+    long long allocations = 0; // in one run
+};
+
+// run the function repeatedly for at least minTime seconds (and at least 3 times), and keep the fastest run
+Measurement measure(const std::function<void()>& f, double minTime)
+{
+    Measurement m;
+    double total = 0;
+    while (m.runs < 3 || total < minTime)
+    {
+        long long allocations = g_allocations;
+        auto start = std::chrono::steady_clock::now();
+        f();
+        auto end = std::chrono::steady_clock::now();
+        double seconds = std::chrono::duration<double>(end - start).count();
+        if (m.runs == 0)
+        {
+            m.allocations = g_allocations - allocations;
+        }
+        if (m.runs == 0 || seconds < m.seconds)
+        {
+            m.seconds = seconds;
+        }
+        total += seconds;
+        ++m.runs;
+    }
+    return m;
+}
+
+// visit every value, roughly as an application reading the data would
+double traverse(const JsonValue& value)
+{
+    switch (value.type())
+    {
+        case JsonValue::Type::Boolean:
+            return value.boolean() ? 1 : 0;
+        case JsonValue::Type::Number:
+            return value.number();
+        case JsonValue::Type::String:
+            return (double) value.string().size();
+        case JsonValue::Type::Array:
+        {
+            double sum = 0;
+            for (int i = 0; i < value.size(); ++i)
+            {
+                sum += traverse(value[i]);
+            }
+            return sum;
+        }
+        case JsonValue::Type::Object:
+        {
+            double sum = 0;
+            for (int i = 0; i < value.size(); ++i)
+            {
+                sum += traverse(value[value.key(i)]);
+            }
+            return sum;
+        }
+        default:
+            return 0;
+    }
+}
+
+// copy the value by building it with append() and set(), adding each object's keys in reverse order, which
+// is the slowest order for set()
+JsonValue rebuild(const JsonValue& value)
+{
+    switch (value.type())
+    {
+        case JsonValue::Type::Array:
+        {
+            JsonValue out(JsonValue::Type::Array);
+            out.reserve(value.size());
+            for (int i = 0; i < value.size(); ++i)
+            {
+                out.append(rebuild(value[i]));
+            }
+            return out;
+        }
+        case JsonValue::Type::Object:
+        {
+            JsonValue out(JsonValue::Type::Object);
+            for (int i = value.size() - 1; i >= 0; --i)
+            {
+                out.set(value.key(i), rebuild(value[value.key(i)]));
+            }
+            return out;
+        }
+        default:
+            return value;
+    }
+}
+
+struct Result
+{
+    std::string corpus;
+    size_t bytes = 0;
+    long long domBytes = 0;
+    Measurement parse;
+    Measurement serialize;
+    Measurement traverse;
+    Measurement copy;
+    Measurement build;
+};
+
+double mbPerSecond(size_t bytes, const Measurement& m)
+{
+    return m.seconds > 0 ? bytes / m.seconds / (1024.0 * 1024.0) : 0;
+}
+
+double perSecond(const Measurement& m)
+{
+    return m.seconds > 0 ? 1.0 / m.seconds : 0;
+}
+
+void printRow(const char* op, size_t bytes, const Measurement& m)
+{
+    printf("  %-10s %10.1f MB/s %12.1f docs/s %12lld allocs  (%d runs)\n", op, mbPerSecond(bytes, m), perSecond(m), m.allocations, m.runs);
+}
+
+void writeMeasurement(FILE* file, const char* op, size_t bytes, const Measurement& m, bool last)
+{
+    fprintf(file, "      \"%s\": { \"seconds\": %.9f, \"mb_per_s\": %.3f, \"docs_per_s\": %.3f, \"allocations\": %lld, \"runs\": %d }%s\n",
+            op, m.seconds, mbPerSecond(bytes, m), perSecond(m), m.allocations, m.runs, last ? "" : ",");
+}
+
+bool writeJson(const std::string& path, const std::vector<Result>& results, double scale)
+{
+    FILE* file = path == "-" ? stdout : fopen(path.c_str(), "w");
+    if (!file)
+    {
+        return false;
+    }
+
+    fprintf(file, "{\n  \"scale\": %g,\n  \"results\": [\n", scale);
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        const Result& r = results[i];
+        fprintf(file, "    {\n      \"corpus\": \"%s\",\n      \"bytes\": %zu,\n      \"dom_bytes\": %lld,\n", r.corpus.c_str(), r.bytes, r.domBytes);
+        writeMeasurement(file, "parse", r.bytes, r.parse, false);
+        writeMeasurement(file, "serialize", r.bytes, r.serialize, false);
+        writeMeasurement(file, "traverse", r.bytes, r.traverse, false);
+        writeMeasurement(file, "copy", r.bytes, r.copy, false);
+        writeMeasurement(file, "build", r.bytes, r.build, true);
+        fprintf(file, "    }%s\n", i+1 < results.size() ? "," : "");
+    }
+    fprintf(file, "  ],\n  \"peak_rss_bytes\": %lld\n}\n", peakRss());
+
+    if (file != stdout)
+    {
+        fclose(file);
+    }
+    return true;
+}
+
+} // namespace
+
+////////////////////////////////////////
+
+int main(int argc, char* argv[])
+{
+    double scale = 1.0;
+    double minTime = 0.5;
+    std::string jsonPath;
+    std::string only;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--scale" && i+1 < argc)
+        {
+            scale = atof(argv[++i]);
+        }
+        else if (arg == "--min-time" && i+1 < argc)
+        {
+            minTime = atof(argv[++i]);
+        }
+        else if (arg == "--json" && i+1 < argc)
+        {
+            jsonPath = argv[++i];
+        }
+        else if (arg == "--corpus" && i+1 < argc)
+        {
+            only = argv[++i];
+        }
+        else
+        {
+            std::cerr << "usage: " << argv[0] << " [--scale <factor>] [--min-time <seconds>] [--corpus <name>] [--json <file or ->]" << std::endl;
+            return 1;
+        }
+    }
+
+    const Corpus corpora[] =
+    {
+        { "twitter", generateTwitter, 4 << 20 },
+        { "numbers", generateNumbers, 4 << 20 },
+        { "logs", generateLogs, 4 << 20 },
+        { "nested", generateNested, 2 << 20 },
+        { "wide", generateWide, 2 << 20 },
+    };
+
+    std::vector<Result> results;
+    for (const Corpus& corpus : corpora)
+    {
+        if (!only.empty() && only != corpus.name)
+        {
+            continue;
+        }
+
+        Result result;
+        result.corpus = corpus.name;
+        std::string text = corpus.generate((size_t) (corpus.size * scale));
+        result.bytes = text.size();
+
+        // parse once outside the timing loop to check the corpus, and to measure the size of the DOM
+        long long liveBytes = g_liveBytes;
+        JsonValue value;
+        {
+            std::istringstream stream(text);
+            JsonReader reader(stream);
+            if (!reader.read(value))
+            {
+                std::cerr << corpus.name << ": parse error at line " << (reader.line()+1) << ", column " << (reader.column()+1) << std::endl;
+                return 1;
+            }
+        }
+        result.domBytes = g_liveBytes - liveBytes;
+
+        result.parse = measure([&]()
+        {
+            std::istringstream stream(text);
+            JsonValue v;
+            v.read(stream);
+        }, minTime);
+
+        result.serialize = measure([&]()
+        {
+            std::ostringstream stream;
+            JsonWriter writer(stream);
+            writer.setIndent(0);
+            writer.write(value);
+        }, minTime);
+
+        volatile double sink = 0;
+        result.traverse = measure([&]()
+        {
+            sink = sink + traverse(value);
+        }, minTime);
+
+        result.copy = measure([&]()
+        {
+            JsonValue copy = value;
+            sink = sink + (copy.isValid() ? 1 : 0);
+        }, minTime);
+
+        result.build = measure([&]()
+        {
+            JsonValue built = rebuild(value);
+            sink = sink + (built.isValid() ? 1 : 0);
+        }, minTime);
+
+        printf("%s: %zu bytes, DOM %lld bytes\n", corpus.name, result.bytes, result.domBytes);
+        printRow("parse", result.bytes, result.parse);
+        printRow("serialize", result.bytes, result.serialize);
+        printRow("traverse", result.bytes, result.traverse);
+        printRow("copy", result.bytes, result.copy);
+        printRow("build", result.bytes, result.build);
+        fflush(stdout);
+
+        results.push_back(result);
+    }
+
+    printf("peak RSS: %.1f MB\n", peakRss() / (1024.0 * 1024.0));
+
+    if (!jsonPath.empty() && !writeJson(jsonPath, results, scale))
+    {
+        std::cerr << "can't write " << jsonPath << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
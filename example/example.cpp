@@ -13,7 +13,7 @@ void makeUppercase(JsonValue& value)
 {
     if (value.isString())
     {
-        std::string s = value.string();
+        std::string s(value.stringView());
         std::transform(s.begin(), s.end(), s.begin(), ::toupper);
         value = s;
     }
@@ -28,7 +28,7 @@ void makeUppercase(JsonValue& value)
     {
         for (int i = 0; i < value.size(); ++i)
         {
-            const std::string& key = value.key(i);
+            const std::pmr::string& key = value.key(i);
             makeUppercase(value.get(key));
         }
     }
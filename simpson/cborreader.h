@@ -0,0 +1,62 @@
+#pragma once
+
+#include "simpson/jsonvalue.h"
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+namespace Simpson 
+{
+
+
+class ByteInput;
+
+// Reads values in CBOR (RFC 8949) binary format.
+// CBOR items with no JSON equivalent are converted as RFC 8949 section 6.1 suggests: byte strings become
+// base64url strings, tags are ignored, and undefined, other simple values, NaN and infinities become null.
+// Maps with non-string keys are not supported.
+class CborReader
+{
+public:
+    CborReader(std::istream&);
+    CborReader(const void* data, size_t size);
+    ~CborReader();
+
+    bool read(JsonValue&);
+
+    // Maximum nesting depth of arrays and maps; deeper input fails to read. As with JsonReader, input is read
+    // without recursion, so this bounds the depth of the values that are made rather than protecting the stack.
+    // 0 for no limit.
+    static const int k_defaultMaxDepth = 10000;
+    void setMaxDepth(int);
+    int maxDepth() const { return m_maxDepth; }
+
+    // byte offset of the input
+    int pos() const;
+
+private:
+    ByteInput* m_input;
+    int m_maxDepth = k_defaultMaxDepth;
+
+    // an array or map being read
+    struct Frame
+    {
+        JsonValue value;
+        std::string key; // of the next value, in a map
+        uint64_t remaining; // items left to read, if the length is definite
+        bool indefinite;
+        bool sorted; // the map's keys were in order
+    };
+    std::vector<Frame> m_stack;
+
+    bool readHead(int& majorType, int& info, uint64_t& value);
+    bool readChunks(int majorType, int info, uint64_t value, std::string&);
+    bool readScalar(int majorType, int info, uint64_t value, JsonValue&);
+    bool readValue(JsonValue&);
+
+    CborReader& operator=(const CborReader&) = delete;
+    CborReader(const CborReader&) = delete;
+};
+
+
+} // namespace Simpson
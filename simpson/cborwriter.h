@@ -0,0 +1,51 @@
+#pragma once
+
+#include "simpson/jsonvalue.h"
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+namespace Simpson 
+{
+
+
+class ByteOutput;
+
+// Writes values in CBOR (RFC 8949) binary format.
+// Numbers are written as integers when they hold an exact integer, as single-precision floats
+// when that loses nothing, and as double-precision floats otherwise.
+class CborWriter
+{
+public:
+    CborWriter(std::ostream&);
+    CborWriter(std::vector<uint8_t>&); // appends to the vector
+    ~CborWriter();
+
+    void write(const JsonValue&);
+
+private:
+    ByteOutput* m_output;
+
+    void writeHead(int majorType, uint64_t value);
+    void writeNumber(const JsonValue&);
+    void writeString(std::string_view);
+    void writeImpl(const JsonValue&);
+    void writeValue(const JsonValue&);
+
+    // an array or object being written; or a row of a columnar array, written as an object
+    struct Frame
+    {
+        const JsonValue* value;
+        int index; // of the next element or member
+        int row;
+    };
+    std::vector<Frame> m_stack;
+
+    int frameSize(const Frame&) const;
+
+    CborWriter& operator=(const CborWriter&) = delete;
+    CborWriter(const CborWriter&) = delete;
+};
+
+
+} // namespace Simpson
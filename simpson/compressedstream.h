@@ -0,0 +1,62 @@
+#pragma once
+
+#include <iostream>
+
+namespace Simpson 
+{
+
+
+// Compressed formats for reading and writing; each needs its library, so it's only available if the library
+// was built with it (CMake does this when it finds zlib or zstd; otherwise, build with SIMPSON_ENABLE_ZLIB=1
+// or SIMPSON_ENABLE_ZSTD=1 defined, and link with the library).
+enum class Compression
+{
+    None,
+    Gzip, // also reads zlib data
+    Zstd,
+    Auto, // for reading: gzip or zstd if the data starts like it, or else uncompressed
+};
+
+bool isCompressionAvailable(Compression);
+
+// An input stream that decompresses another stream as it's read, a block at a time, so that a JsonReader can
+// read compressed data without holding either the compressed or the decompressed data in memory. Bulk reads,
+// like JsonReader's, are decompressed straight into the reader's buffer. Concatenated gzip members or zstd
+// frames are read as one stream. Throws std::runtime_error if the format isn't available; invalid data sets
+// the stream's badbit.
+class DecompressingStream : public std::istream
+{
+public:
+    DecompressingStream(std::istream& compressed, Compression = Compression::Auto);
+    ~DecompressingStream();
+
+private:
+    DecompressingStream& operator=(const DecompressingStream&) = delete;
+    DecompressingStream(const DecompressingStream&) = delete;
+
+    class Buffer;
+    Buffer* m_buffer;
+};
+
+// An output stream that compresses what's written to it, a block at a time, to another stream. Flushing the
+// stream doesn't force out compressed data, since that would make it larger; call finish() at the end. The
+// level is the library's (0 for its default). Throws std::runtime_error if the format isn't available.
+class CompressingStream : public std::ostream
+{
+public:
+    CompressingStream(std::ostream& compressed, Compression, int level = 0);
+    ~CompressingStream(); // finishes, if finish() hasn't been called
+
+    // write the rest of the compressed data, and flush the other stream; returns false if that fails
+    bool finish();
+
+private:
+    CompressingStream& operator=(const CompressingStream&) = delete;
+    CompressingStream(const CompressingStream&) = delete;
+
+    class Buffer;
+    Buffer* m_buffer;
+};
+
+
+} // namespace Simpson
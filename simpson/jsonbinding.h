@@ -0,0 +1,715 @@
+#pragma once
+
+#include "simpson/tokentype.h"
+#include <string>
+#include <string_view>
+#include <vector>
+#include <optional>
+#include <array>
+#include <tuple>
+#include <utility>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+#include <cstdint>
+#include <iostream>
+
+// Binding of JSON to C++ types, without building JsonValues.
+//
+// A struct's fields are described by a function found by argument-dependent lookup, declared with
+// SIMPSON_FIELDS in the struct's namespace (or as a friend, in the struct itself):
+//
+//     struct Point { double x; double y; std::string label; };
+//     SIMPSON_FIELDS(Point, SIMPSON_FIELD(x), SIMPSON_FIELD(y), SIMPSON_FIELD_NAMED(label, "name"))
+//
+//     Point p = Simpson::decode<Point>(text);
+//     std::string json = Simpson::encode(p);
+//
+// Fields can be bool, integers, floating point, std::string, enums, std::vector and std::optional of
+// those, and other structs with fields. Enums are numbers, unless their names are given with SIMPSON_ENUM:
+//
+//     enum class Color { Red, Green };
+//     SIMPSON_ENUM(Color, { Color::Red, "red" }, { Color::Green, "green" })
+//
+// Keys are matched with a perfect hash computed at compile time; unknown keys are skipped, and fields
+// that are missing keep their values. A null value for an optional field resets it. Encoding writes every
+// field in order (empty optionals as null), with no whitespace.
+
+#define SIMPSON_FIELDS(Type_, ...) \
+    constexpr auto simpsonJsonFields(const Type_*) { using Type = Type_; return std::make_tuple(__VA_ARGS__); }
+#define SIMPSON_FIELD(name) ::Simpson::jsonField(#name, &Type::name)
+#define SIMPSON_FIELD_NAMED(name, jsonName) ::Simpson::jsonField(jsonName, &Type::name)
+
+#define SIMPSON_ENUM(Type_, ...) \
+    constexpr auto simpsonJsonEnum(const Type_*) { return ::Simpson::jsonEnumNames<Type_>({ __VA_ARGS__ }); }
+
+namespace Simpson
+{
+
+
+class Tokenizer;
+
+// A pull parser that reads JSON a token at a time, for decoding into C++ types. It reads from memory,
+// which must remain valid while decoding.
+class JsonDecoder
+{
+public:
+    JsonDecoder(const char* data, size_t size);
+    ~JsonDecoder();
+
+    // type of the next token (END at the end of the input, or after an error)
+    TokenType peek() const;
+
+    // Read a value of the given type; return false on an error, including a value of the wrong type.
+    // Numbers must be exact and in range for integers. The string_view version is valid until the next read.
+    bool readNull();
+    bool read(bool&);
+    bool read(int64_t&);
+    bool read(uint64_t&);
+    bool read(double&);
+    bool read(std::string&);
+    bool read(std::string_view&);
+
+    // Arrays and objects: call begin, then next until it returns false, then check fail():
+    //
+    //     if (!decoder.beginArray()) { return false; }
+    //     for (bool first = true; decoder.nextElement(first); first = false)
+    //     {
+    //         // read the element
+    //     }
+    //     return !decoder.fail();
+    //
+    // nextMember() returns the key, which is valid until the member's value has been read.
+    bool beginArray();
+    bool nextElement(bool first);
+    bool beginObject();
+    bool nextMember(bool first, std::string_view& key);
+
+    // skip a value of any type
+    bool skipValue();
+
+    // true if the whole input has been read
+    bool end() const;
+
+    bool fail() const;
+    int pos() const;
+
+    // Arrays and objects nested deeper than this fail to decode, since typed decoding recurses
+    // (skipped values can be nested any depth).
+    static const int k_defaultMaxDepth = 1000;
+    void setMaxDepth(int);
+
+private:
+    JsonDecoder& operator=(const JsonDecoder&) = delete;
+    JsonDecoder(const JsonDecoder&) = delete;
+
+    Tokenizer* m_tokenizer;
+    const char* m_data;
+    size_t m_size;
+    bool m_fail = false;
+    int m_depth = 0;
+    int m_maxDepth = k_defaultMaxDepth;
+    std::string m_key;            // keys that were unescaped
+    std::vector<bool> m_skipping; // containers being skipped (true for arrays)
+
+    void advance();
+    bool error();
+    bool skipKey();
+};
+
+////////////////////////////////////////
+
+// Writes compact JSON a value at a time, appending to a string, for encoding C++ types. Nothing checks
+// that the values written make valid JSON.
+class JsonEncoder
+{
+public:
+    JsonEncoder(std::string& out) : m_out(out) {}
+
+    void writeNull() { m_out.append("null", 4); }
+    void write(bool value) { value ? m_out.append("true", 4) : m_out.append("false", 5); }
+    void write(int64_t);
+    void write(uint64_t);
+    void write(double); // non-finite values are written as null
+    void write(std::string_view); // a string, escaped and quoted
+    void write(const char* s) { write(std::string_view(s)); }
+
+    // append text as it is (such as punctuation, or keys that are already escaped)
+    void writeRaw(std::string_view text) { m_out.append(text.data(), text.size()); }
+    void writeRaw(char c) { m_out.push_back(c); }
+
+private:
+    JsonEncoder& operator=(const JsonEncoder&) = delete;
+    JsonEncoder(const JsonEncoder&) = delete;
+
+    std::string& m_out;
+};
+
+////////////////////////////////////////
+
+template <typename T, typename M>
+struct JsonField
+{
+    std::string_view name;
+    M T::* member;
+};
+
+template <typename T, typename M>
+constexpr JsonField<T, M> jsonField(std::string_view name, M T::* member)
+{
+    return JsonField<T, M>{ name, member };
+}
+
+template <typename E, size_t N, size_t... I>
+constexpr std::array<std::pair<E, std::string_view>, N> jsonEnumNames(const std::pair<E, std::string_view> (&names)[N], std::index_sequence<I...>)
+{
+    return {{ names[I]... }};
+}
+
+template <typename E, size_t N>
+constexpr std::array<std::pair<E, std::string_view>, N> jsonEnumNames(const std::pair<E, std::string_view> (&names)[N])
+{
+    return jsonEnumNames(names, std::make_index_sequence<N>());
+}
+
+// parse a value of a bound type; see above
+template <typename T>
+bool decode(const char* data, size_t size, T& value);
+
+// as above, but throws std::runtime_error if the text can't be decoded
+template <typename T>
+T decode(std::string_view text);
+
+// write a value of a bound type, appending to a string or writing to a stream
+template <typename T>
+void encode(const T& value, std::string& out);
+template <typename T>
+void encode(const T& value, std::ostream& out);
+template <typename T>
+std::string encode(const T& value);
+
+////////////////////////////////////////
+
+namespace Detail
+{
+    template <typename T, typename = void>
+    struct HasFields : std::false_type {};
+    template <typename T>
+    struct HasFields<T, std::void_t<decltype(simpsonJsonFields((const T*) nullptr))>> : std::true_type {};
+
+    template <typename T, typename = void>
+    struct HasEnumNames : std::false_type {};
+    template <typename T>
+    struct HasEnumNames<T, std::void_t<decltype(simpsonJsonEnum((const T*) nullptr))>> : std::true_type {};
+
+    template <typename T>
+    struct IsVector : std::false_type {};
+    template <typename T, typename A>
+    struct IsVector<std::vector<T, A>> : std::true_type {};
+
+    template <typename T>
+    struct IsOptional : std::false_type {};
+    template <typename T>
+    struct IsOptional<std::optional<T>> : std::true_type {};
+
+    template <typename T>
+    struct AlwaysFalse : std::false_type {};
+
+    // the hash for matching keys to fields
+    constexpr uint32_t keyHash(std::string_view key, uint32_t seed)
+    {
+        uint32_t h = 2166136261u ^ (seed * 0x9e3779b9u);
+        for (char c : key)
+        {
+            h = (h ^ (uint8_t) c) * 16777619u;
+        }
+        h ^= h >> 16;
+        h *= 0x7feb352du;
+        h ^= h >> 15;
+        return h;
+    }
+
+    // A perfect hash of N keys: a seed for which each key hashes to a different slot of a table,
+    // found at compile time.
+    template <size_t N>
+    struct PerfectHash
+    {
+        static constexpr size_t k_maxSize = (N <= 1 ? 1 : 2 * N) * 4;
+        uint32_t seed = 0;
+        size_t size = 0; // 0 if there isn't one
+        std::array<int16_t, k_maxSize> slots {};
+
+        constexpr PerfectHash(const std::array<std::string_view, N>& keys)
+        {
+            for (size_t tableSize = 1; tableSize <= k_maxSize; tableSize *= 2)
+            {
+                if (tableSize < N)
+                {
+                    continue;
+                }
+                for (uint32_t s = 0; s < 1000; ++s)
+                {
+                    if (tryBuild(keys, tableSize, s))
+                    {
+                        return;
+                    }
+                }
+            }
+        }
+
+        constexpr bool tryBuild(const std::array<std::string_view, N>& keys, size_t tableSize, uint32_t s)
+        {
+            for (size_t i = 0; i < k_maxSize; ++i)
+            {
+                slots[i] = -1;
+            }
+            for (size_t i = 0; i < N; ++i)
+            {
+                size_t slot = keyHash(keys[i], s) & (tableSize - 1);
+                if (slots[slot] >= 0)
+                {
+                    return false;
+                }
+                slots[slot] = (int16_t) i;
+            }
+            seed = s;
+            size = tableSize;
+            return true;
+        }
+
+        // index of the only key that could match
+        constexpr int find(std::string_view key) const
+        {
+            return slots[keyHash(key, seed) & (size - 1)];
+        }
+    };
+
+    template <typename T>
+    bool decodeValue(JsonDecoder&, T&);
+
+    template <typename T>
+    struct FieldTable
+    {
+        static constexpr auto fields = simpsonJsonFields((const T*) nullptr);
+        static constexpr size_t count = std::tuple_size<std::remove_const_t<decltype(fields)>>::value;
+
+        template <size_t... I>
+        static constexpr std::array<std::string_view, count> makeNames(std::index_sequence<I...>)
+        {
+            return {{ std::get<I>(fields).name... }};
+        }
+        static constexpr std::array<std::string_view, count> names = makeNames(std::make_index_sequence<count>());
+        static constexpr PerfectHash<count> hash = PerfectHash<count>(names);
+        static_assert(count == 0 || hash.size != 0, "no perfect hash for these field names");
+
+        template <size_t I>
+        static bool decodeField(JsonDecoder& decoder, T& object)
+        {
+            return decodeValue(decoder, object.*(std::get<I>(fields).member));
+        }
+
+        using Decoder = bool (*)(JsonDecoder&, T&);
+        template <size_t... I>
+        static constexpr std::array<Decoder, count> makeDecoders(std::index_sequence<I...>)
+        {
+            return {{ &decodeField<I>... }};
+        }
+        static constexpr std::array<Decoder, count> decoders = makeDecoders(std::make_index_sequence<count>());
+
+        static int find(std::string_view key)
+        {
+            if constexpr (count == 0)
+            {
+                return -1;
+            }
+            else
+            {
+                int index = hash.find(key);
+                return (index >= 0 && names[index] == key) ? index : -1;
+            }
+        }
+    };
+
+    template <typename T>
+    bool decodeObject(JsonDecoder& decoder, T& object)
+    {
+        using Table = FieldTable<T>;
+        if (!decoder.beginObject())
+        {
+            return false;
+        }
+        std::string_view key;
+        for (bool first = true; decoder.nextMember(first, key); first = false)
+        {
+            int index = Table::find(key);
+            if (index < 0 ? !decoder.skipValue() : !Table::decoders[index](decoder, object))
+            {
+                return false;
+            }
+        }
+        return !decoder.fail();
+    }
+
+    template <typename T>
+    bool decodeInteger(JsonDecoder& decoder, T& value)
+    {
+        if constexpr (std::is_signed<T>::value)
+        {
+            int64_t i;
+            if (!decoder.read(i) || i < (int64_t) std::numeric_limits<T>::min() || i > (int64_t) std::numeric_limits<T>::max())
+            {
+                return false;
+            }
+            value = (T) i;
+        }
+        else
+        {
+            uint64_t u;
+            if (!decoder.read(u) || u > (uint64_t) std::numeric_limits<T>::max())
+            {
+                return false;
+            }
+            value = (T) u;
+        }
+        return true;
+    }
+
+    template <typename T>
+    bool decodeValue(JsonDecoder& decoder, T& value)
+    {
+        if constexpr (std::is_same<T, bool>::value)
+        {
+            return decoder.read(value);
+        }
+        else if constexpr (std::is_enum<T>::value)
+        {
+            if constexpr (HasEnumNames<T>::value)
+            {
+                std::string_view name;
+                if (!decoder.read(name))
+                {
+                    return false;
+                }
+                for (const auto& entry : simpsonJsonEnum((const T*) nullptr))
+                {
+                    if (entry.second == name)
+                    {
+                        value = entry.first;
+                        return true;
+                    }
+                }
+                return false;
+            }
+            else
+            {
+                std::underlying_type_t<T> i;
+                if (!decodeInteger(decoder, i))
+                {
+                    return false;
+                }
+                value = (T) i;
+                return true;
+            }
+        }
+        else if constexpr (std::is_integral<T>::value)
+        {
+            return decodeInteger(decoder, value);
+        }
+        else if constexpr (std::is_floating_point<T>::value)
+        {
+            double d;
+            if (!decoder.read(d))
+            {
+                return false;
+            }
+            value = (T) d;
+            return true;
+        }
+        else if constexpr (std::is_same<T, std::string>::value)
+        {
+            return decoder.read(value);
+        }
+        else if constexpr (IsOptional<T>::value)
+        {
+            if (decoder.peek() == TokenType::NULL_)
+            {
+                value.reset();
+                return decoder.readNull();
+            }
+            if (!value)
+            {
+                value.emplace();
+            }
+            return decodeValue(decoder, *value);
+        }
+        else if constexpr (IsVector<T>::value)
+        {
+            value.clear();
+            if (!decoder.beginArray())
+            {
+                return false;
+            }
+            for (bool first = true; decoder.nextElement(first); first = false)
+            {
+                typename T::value_type element {};
+                if (!decodeValue(decoder, element))
+                {
+                    return false;
+                }
+                value.push_back(std::move(element));
+            }
+            return !decoder.fail();
+        }
+        else if constexpr (HasFields<T>::value)
+        {
+            return decodeObject(decoder, value);
+        }
+        else
+        {
+            static_assert(AlwaysFalse<T>::value, "type can't be decoded from JSON; declare its fields with SIMPSON_FIELDS");
+            return false;
+        }
+    }
+
+    // The text written before each field of a struct, with the key already escaped: {"a": for the
+    // first, ,"b": for the others, followed by the closing }.
+    constexpr size_t escapedLength(std::string_view key)
+    {
+        size_t length = 0;
+        for (char c : key)
+        {
+            switch (c)
+            {
+                case '"': case '\\': case '\b': case '\f': case '\n': case '\r': case '\t':
+                    length += 2;
+                    break;
+                default:
+                    length += ((uint8_t) c < 0x20) ? 6 : 1;
+                    break;
+            }
+        }
+        return length;
+    }
+
+    template <typename T>
+    struct FieldPrefixes
+    {
+        using Table = FieldTable<T>;
+
+        static constexpr size_t computeLength()
+        {
+            size_t length = 1;
+            for (std::string_view name : Table::names)
+            {
+                length += escapedLength(name) + 4;
+            }
+            return Table::count == 0 ? 2 : length;
+        }
+        static constexpr size_t length = computeLength();
+
+        struct Text
+        {
+            std::array<char, length> chars {};
+            std::array<size_t, Table::count + 1> offsets {}; // start of each prefix, and of the closing }
+        };
+
+        static constexpr Text build()
+        {
+            const char hex[] = "0123456789abcdef";
+            Text text {};
+            size_t n = 0;
+            for (size_t i = 0; i < Table::count; ++i)
+            {
+                text.offsets[i] = n;
+                text.chars[n++] = (i == 0) ? '{' : ',';
+                text.chars[n++] = '"';
+                for (char c : Table::names[i])
+                {
+                    char escape = 0;
+                    switch (c)
+                    {
+                        case '"': escape = '"'; break;
+                        case '\\': escape = '\\'; break;
+                        case '\b': escape = 'b'; break;
+                        case '\f': escape = 'f'; break;
+                        case '\n': escape = 'n'; break;
+                        case '\r': escape = 'r'; break;
+                        case '\t': escape = 't'; break;
+                        default: break;
+                    }
+                    if (escape)
+                    {
+                        text.chars[n++] = '\\';
+                        text.chars[n++] = escape;
+                    }
+                    else if ((uint8_t) c < 0x20)
+                    {
+                        text.chars[n++] = '\\';
+                        text.chars[n++] = 'u';
+                        text.chars[n++] = '0';
+                        text.chars[n++] = '0';
+                        text.chars[n++] = hex[(uint8_t) c >> 4];
+                        text.chars[n++] = hex[(uint8_t) c & 0xf];
+                    }
+                    else
+                    {
+                        text.chars[n++] = c;
+                    }
+                }
+                text.chars[n++] = '"';
+                text.chars[n++] = ':';
+            }
+            text.offsets[Table::count] = n;
+            if (Table::count == 0)
+            {
+                text.chars[n++] = '{';
+            }
+            text.chars[n++] = '}';
+            return text;
+        }
+        static constexpr Text text = build();
+
+        // the prefix of field i, or the end of the object if i is the number of fields
+        static constexpr std::string_view get(size_t i)
+        {
+            size_t end = (i < Table::count) ? text.offsets[i + 1] : length;
+            return std::string_view(text.chars.data() + text.offsets[i], end - text.offsets[i]);
+        }
+    };
+
+    template <typename T>
+    void encodeValue(JsonEncoder&, const T&);
+
+    template <typename T, size_t... I>
+    void encodeObject(JsonEncoder& encoder, const T& object, std::index_sequence<I...>)
+    {
+        using Prefixes = FieldPrefixes<T>;
+        ((encoder.writeRaw(Prefixes::get(I)), encodeValue(encoder, object.*(std::get<I>(FieldTable<T>::fields).member))), ...);
+        encoder.writeRaw(Prefixes::get(FieldTable<T>::count));
+    }
+
+    template <typename T>
+    void encodeValue(JsonEncoder& encoder, const T& value)
+    {
+        if constexpr (std::is_same<T, bool>::value)
+        {
+            encoder.write(value);
+        }
+        else if constexpr (std::is_enum<T>::value)
+        {
+            if constexpr (HasEnumNames<T>::value)
+            {
+                for (const auto& entry : simpsonJsonEnum((const T*) nullptr))
+                {
+                    if (entry.first == value)
+                    {
+                        encoder.write(entry.second);
+                        return;
+                    }
+                }
+                throw std::runtime_error("enum value has no name");
+            }
+            else
+            {
+                encodeValue(encoder, (std::underlying_type_t<T>) value);
+            }
+        }
+        else if constexpr (std::is_integral<T>::value)
+        {
+            if constexpr (std::is_signed<T>::value)
+            {
+                encoder.write((int64_t) value);
+            }
+            else
+            {
+                encoder.write((uint64_t) value);
+            }
+        }
+        else if constexpr (std::is_floating_point<T>::value)
+        {
+            encoder.write((double) value);
+        }
+        else if constexpr (std::is_same<T, std::string>::value)
+        {
+            encoder.write(std::string_view(value));
+        }
+        else if constexpr (IsOptional<T>::value)
+        {
+            if (value)
+            {
+                encodeValue(encoder, *value);
+            }
+            else
+            {
+                encoder.writeNull();
+            }
+        }
+        else if constexpr (IsVector<T>::value)
+        {
+            encoder.writeRaw('[');
+            bool first = true;
+            for (const auto& element : value)
+            {
+                if (!first)
+                {
+                    encoder.writeRaw(',');
+                }
+                first = false;
+                encodeValue(encoder, (const typename T::value_type&) element);
+            }
+            encoder.writeRaw(']');
+        }
+        else if constexpr (HasFields<T>::value)
+        {
+            encodeObject(encoder, value, std::make_index_sequence<FieldTable<T>::count>());
+        }
+        else
+        {
+            static_assert(AlwaysFalse<T>::value, "type can't be encoded as JSON; declare its fields with SIMPSON_FIELDS");
+        }
+    }
+}
+
+template <typename T>
+bool decode(const char* data, size_t size, T& value)
+{
+    JsonDecoder decoder(data, size);
+    return Detail::decodeValue(decoder, value) && decoder.end();
+}
+
+template <typename T>
+T decode(std::string_view text)
+{
+    T value {};
+    if (!decode(text.data(), text.size(), value))
+    {
+        throw std::runtime_error("JSON can't be decoded");
+    }
+    return value;
+}
+
+template <typename T>
+void encode(const T& value, std::string& out)
+{
+    JsonEncoder encoder(out);
+    Detail::encodeValue(encoder, value);
+}
+
+template <typename T>
+void encode(const T& value, std::ostream& out)
+{
+    std::string text;
+    encode(value, text);
+    out.write(text.data(), text.size());
+}
+
+template <typename T>
+std::string encode(const T& value)
+{
+    std::string text;
+    encode(value, text);
+    return text;
+}
+
+
+} // namespace Simpson
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace Simpson 
+{
+
+
+class Tokenizer;
+
+// Reformats JSON text without reading it into values: strings and numbers are copied exactly as they are,
+// object members stay in their order, and only the whitespace between tokens changes. Input is scanned in
+// blocks, and output is written in blocks, so memory use doesn't depend on the size of the input (except for
+// one bit per level of nesting).
+class JsonFormatter
+{
+public:
+    JsonFormatter(std::istream& in, std::ostream& out);
+
+    // read from memory; the data must remain valid while reading
+    JsonFormatter(const char* data, size_t size, std::ostream& out);
+
+    ~JsonFormatter();
+
+    // Spaces to indent each level, as with JsonWriter (2 by default), or k_minify for no whitespace at all.
+    static const int k_minify = -1;
+    void setIndent(int);
+
+    // Reformat the next value in the input, so a stream holding several values can be reformatted by calling
+    // this repeatedly. Returns false if there's no value, or it's invalid, in which case the output stops
+    // where the error was found.
+    bool format();
+
+    int line() const;
+    int column() const;
+    int pos() const;
+
+private:
+    JsonFormatter& operator=(const JsonFormatter&) = delete;
+    JsonFormatter(const JsonFormatter&) = delete;
+
+    Tokenizer* m_tokenizer;
+    std::ostream& m_stream;
+    std::string m_indent = "  ";
+    bool m_minify = false;
+    std::string m_output;     // written to the stream in blocks
+    std::vector<bool> m_stack; // for each open container, true for an array, false for an object
+
+    bool formatValue();
+    bool writeKey();
+    void writeNewline();
+    void flush();
+};
+
+
+} // namespace Simpson
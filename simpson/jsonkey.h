@@ -0,0 +1,57 @@
+#pragma once
+
+#include <string_view>
+#include <atomic>
+#include <cstdint>
+
+namespace Simpson
+{
+
+
+// A precomputed object key, for looking up the same key many times (for example, the same fields of each
+// record in a large array). It holds the key's length and hash, and remembers where it was last found,
+// which is usually where it will be found in the next record.
+//
+//     static const JsonKey k_name("name");
+//     for (int i = 0; i < records.size(); ++i)
+//     {
+//         std::string_view name = records[i][k_name].stringView();
+//     }
+//
+// The key refers to the characters it was created from (it doesn't copy them), so they must outlive it.
+// A JsonKey can be used on several threads at once.
+class JsonKey
+{
+public:
+    constexpr explicit JsonKey(const char* key) : JsonKey(std::string_view(key)) {}
+    constexpr explicit JsonKey(std::string_view key) : m_key(key), m_hash(hash(key)), m_slot(0) {}
+
+    JsonKey(const JsonKey& other) : m_key(other.m_key), m_hash(other.m_hash), m_slot(other.m_slot.load(std::memory_order_relaxed)) {}
+    JsonKey& operator=(const JsonKey&) = delete;
+
+    constexpr std::string_view key() const { return m_key; }
+    constexpr size_t size() const { return m_key.size(); }
+    constexpr uint32_t hash() const { return m_hash; }
+
+    // the hash used for keys (32-bit FNV-1a)
+    static constexpr uint32_t hash(std::string_view key)
+    {
+        uint32_t h = 2166136261u;
+        for (char c : key)
+        {
+            h = (h ^ (uint8_t) c) * 16777619u;
+        }
+        return h;
+    }
+
+private:
+    friend class JsonValue;
+    friend class JsonSnapshotValue;
+
+    std::string_view m_key;
+    uint32_t m_hash;
+    mutable std::atomic<uint32_t> m_slot; // index of the member where the key was last found
+};
+
+
+} // namespace Simpson
@@ -1,7 +1,9 @@
 #pragma once
 
 #include "simpson/jsonvalue.h"
+#include "simpson/jsonstats.h"
 #include <iostream>
+#include <vector>
 
 namespace Simpson 
 {
@@ -12,11 +14,65 @@ class Tokenizer;
 class JsonReader
 {
 public:
+    // Streams are read in large blocks, so after reading, the stream may be positioned past the end of the value.
     JsonReader(std::istream&);
+
+    // read from memory; the data must remain valid while reading
+    JsonReader(const char* data, size_t size);
+
+    // Read "in situ" from a mutable buffer: strings are unescaped in place, and string values refer to the
+    // buffer instead of copying it (see JsonValue::stringView()). The contents of the buffer are overwritten,
+    // and it must outlive all values read from it, and their copies. Object keys are still copied.
+    struct InSitu {};
+    JsonReader(char* buffer, size_t size, InSitu);
+
     ~JsonReader();
 
     bool read(JsonValue&);
 
+    // memory resource for the strings, arrays and objects that are read (see JsonValue);
+    // by default, the default resource
+    void setResource(std::pmr::memory_resource*);
+    std::pmr::memory_resource* resource() const { return m_resource; }
+
+    // if enabled, numbers keep their original text (see JsonValue::isRawNumber()), so they are only converted
+    // if they are accessed, and are written back exactly as they were read; off by default
+    void setRawNumbers(bool);
+    bool rawNumbers() const { return m_rawNumbers; }
+
+    // if enabled, arrays of numbers or booleans of one kind are stored packed (see JsonValue::isPacked());
+    // on by default
+    void setPackArrays(bool);
+    bool packArrays() const { return m_packArrays; }
+
+    // if enabled, arrays of objects that all have the same keys are stored as columns (see
+    // JsonValue::isColumnar()); off by default
+    void setColumnarArrays(bool);
+    bool columnarArrays() const { return m_columnarArrays; }
+
+    // What to do with strings that aren't valid UTF-8, or that have escapes of unpaired UTF-16 surrogates:
+    // accept them as they are (the default), fail to read, or replace each invalid sequence with U+FFFD.
+    // Strings are checked as they're scanned, which costs little, since most text is ASCII.
+    enum class InvalidUtf8
+    {
+        Accept,
+        Reject,
+        Replace,
+    };
+    void setInvalidUtf8(InvalidUtf8);
+    InvalidUtf8 invalidUtf8() const { return m_invalidUtf8; }
+
+    // Maximum nesting depth of arrays and objects; deeper input fails to read. Input is read without recursion,
+    // so this isn't needed to protect the stack, but it bounds the depth of the values that the rest of a
+    // program has to deal with. 0 for no limit.
+    static const int k_defaultMaxDepth = 10000;
+    void setMaxDepth(int);
+    int maxDepth() const { return m_maxDepth; }
+
+    // attach statistics to be updated by each read (or null to detach)
+    void setStats(JsonStats*);
+    JsonStats* stats() const { return m_stats; }
+
     int line() const;
     int column() const;
     int pos() const;
@@ -27,17 +83,43 @@ private:
 
     Tokenizer* m_tokenizer;
     bool m_fail = false;
+    std::pmr::memory_resource* m_resource;
+    bool m_rawNumbers = false;
+    bool m_packArrays = true;
+    bool m_columnarArrays = false;
+    InvalidUtf8 m_invalidUtf8 = InvalidUtf8::Accept;
+    int m_maxDepth = k_defaultMaxDepth;
+    JsonStats* m_stats = nullptr;
+#if SIMPSON_ENABLE_STATS
+    JsonStats* m_record = nullptr; // where to record statistics for the current read, if any
+    JsonStats m_current;
+#endif
+
+    // an array or object being read
+    struct Frame
+    {
+        JsonValue value;
+        std::string key; // of the next value, in an object
+        int count = 0;
+        bool sorted = true; // the object's keys were in order
+    };
+    std::vector<Frame> m_stack;
+
+    bool readValue(JsonValue&);
 
     bool parseBoolean(JsonValue&);
     bool parseNumber(JsonValue&);
     bool parseString(JsonValue&);
-    bool parseString(std::string&);
     bool parseNull(JsonValue&);
-    bool parseArray(JsonValue&);
-    bool parseObject(JsonValue&);
-    bool parseValue(JsonValue&);
+    bool parseKey();
     bool fail() const;
 };
 
+// Check that the data holds one JSON value (with optional whitespace around it), without reading it: no
+// values are made, and no strings or numbers are converted, so it's several times faster than reading.
+// Numbers are only checked for syntax, and there's no depth limit. If it's not valid, returns false, and sets
+// errorOffset (if not null) to the offset of the first character that's wrong, or the size if it ends early.
+bool validate(const char* data, size_t size, size_t* errorOffset = nullptr);
+
 
 } // namespace Simpson
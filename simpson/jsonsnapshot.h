@@ -0,0 +1,125 @@
+#pragma once
+
+#include "simpson/jsonvalue.h"
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <iostream>
+
+namespace Simpson 
+{
+
+
+class JsonSnapshotValue;
+
+// A snapshot is a compact binary image of a whole JsonValue tree, which can be used in place
+// with no parsing step, e.g. straight from a memory-mapped file.
+// It is position-independent (everything is addressed by offsets from the start of the snapshot),
+// strings are stored once in a shared string table, and object keys are sorted so lookups are O(log n).
+class JsonSnapshot
+{
+public:
+    JsonSnapshot();
+    JsonSnapshot(const void* data, size_t size); // use snapshot data in memory; data must outlive the snapshot
+    ~JsonSnapshot();
+
+    // memory-map a snapshot file (read-only, so the pages can be shared by all processes using the file)
+    bool open(const std::string& path);
+    void close();
+
+    bool isValid() const;
+
+    // root value; Invalid if the data isn't a valid snapshot
+    JsonSnapshotValue root() const;
+
+    // create a snapshot
+    static void write(const JsonValue&, std::ostream&);
+    static void write(const JsonValue&, std::vector<uint8_t>&);
+
+private:
+    const uint8_t* m_data = nullptr;
+    size_t m_size = 0;
+    void* m_mapping = nullptr;
+
+    class Builder;
+
+    JsonSnapshot& operator=(const JsonSnapshot&) = delete;
+    JsonSnapshot(const JsonSnapshot&) = delete;
+};
+
+////////////////////////////////////////
+
+// Read-only view of a value in a snapshot.
+// Accessors behave like their JsonValue counterparts, except that child values are returned by value (they're small).
+class JsonSnapshotValue
+{
+public:
+    JsonSnapshotValue(); // Invalid
+
+    JsonValue::Type type() const;
+
+    bool isBoolean() const { return type() == JsonValue::Type::Boolean; }
+    bool isNumber() const { return type() == JsonValue::Type::Number; }
+    bool isString() const { return type() == JsonValue::Type::String; }
+    bool isNull() const { return type() == JsonValue::Type::Null; }
+    bool isArray() const { return type() == JsonValue::Type::Array; }
+    bool isObject() const { return type() == JsonValue::Type::Object; }
+    bool isInteger() const; // see JsonValue::isInteger()
+
+    bool isInvalid() const { return m_slot == nullptr; }
+    bool isValid() const { return m_slot != nullptr; }
+    explicit operator bool() const { return m_slot != nullptr; }
+
+    // primitive values
+    bool boolean() const;
+    double number() const;
+    int64_t int64() const;
+    uint64_t uint64() const;
+    const char* string() const; // null-terminated, but may also contain nulls; see stringLength()
+    int stringLength() const;
+
+    // array/object
+    int size() const;
+
+    // array
+    JsonSnapshotValue get(int index) const;
+    JsonSnapshotValue operator[](int index) const;
+
+    // object; keys are given as in JsonValue, including precomputed JsonKeys
+    JsonSnapshotValue get(std::string_view key) const;
+    JsonSnapshotValue operator[](std::string_view key) const;
+    bool contains(std::string_view key) const;
+    JsonSnapshotValue get(const JsonKey& key) const;
+    JsonSnapshotValue operator[](const JsonKey& key) const;
+    const char* key(int index) const;
+    int keyLength(int index) const;
+
+    // copy into a regular JsonValue
+    JsonValue toValue() const;
+
+private:
+    friend class JsonSnapshot;
+
+    const uint8_t* m_data = nullptr; // start of snapshot
+    size_t m_size = 0;
+    const uint8_t* m_slot = nullptr; // this value's slot
+
+    JsonSnapshotValue(const uint8_t* data, size_t size, const uint8_t* slot);
+
+    JsonSnapshotValue get(const char* key, size_t length) const;
+    JsonSnapshotValue lookup(const char* key, size_t length) const;
+    int find(const char* key, size_t length) const;
+    int find(const JsonKey& key) const;
+    const uint8_t* keyEntry(int index) const;
+    JsonSnapshotValue member(int index) const;
+    JsonSnapshotValue child(uint64_t offset) const;
+    const char* text(uint32_t offset, uint32_t length) const;
+    JsonValue numberValue() const;
+    JsonValue shallowValue() const;
+    void assertType(JsonValue::Type) const;
+    [[ noreturn ]] void throwTypeError() const;
+};
+
+
+} // namespace Simpson
@@ -0,0 +1,104 @@
+#pragma once
+
+#include "simpson/jsonvalue.h"
+#include "simpson/tokentype.h"
+#include <cstdint>
+
+// Statistics collection can be compiled out entirely by defining SIMPSON_ENABLE_STATS=0 when building
+// the library (or configuring CMake with -DSIMPSON_STATS=OFF); the API remains, but nothing is recorded.
+#ifndef SIMPSON_ENABLE_STATS
+#define SIMPSON_ENABLE_STATS 1
+#endif
+
+namespace Simpson
+{
+
+
+class JsonStatsHook;
+
+// Counters describing the work done by a JsonReader or JsonWriter.
+// Attach one with JsonReader::setStats() or JsonWriter::setStats(); counts accumulate over every
+// value read or written until reset() is called.
+class JsonStats
+{
+public:
+    enum class Phase
+    {
+        Read,
+        Write,
+
+        COUNT // not a phase; the number of phases
+    };
+
+    JsonStats() { reset(); }
+
+    void reset();
+
+    // bytes of JSON text consumed by readers, or produced by writers
+    // (0 if the stream doesn't support positioning, like std::cin)
+    uint64_t bytes;
+
+    // number of tokens read
+    uint64_t tokens(TokenType type) const { return m_tokens[(int) type]; }
+
+    // number of values created by readers, or written by writers
+    uint64_t values(JsonValue::Type type) const { return m_values[(int) type]; }
+
+    // deepest nesting of arrays and objects (a scalar at the top level has depth 0)
+    int maxDepth;
+
+    // bytes of string content, including object keys, after unescaping by readers or before escaping by writers
+    uint64_t stringBytes;
+
+    // An estimate of the allocations made for the values created by readers: the nodes of strings, arrays
+    // and objects, growth of their vectors, and the characters of long strings and keys. It counts what's
+    // requested from the reader's memory resource (or the heap, for characters) rather than hooking the
+    // allocator, so it doesn't include converting arrays to packed or columnar storage, or appending to packed
+    // arrays.
+    uint64_t estimatedAllocations;
+
+    // wall-clock time in seconds
+    double seconds(Phase phase) const { return m_seconds[(int) phase]; }
+
+    // hook to call after each value is read or written
+    void setHook(JsonStatsHook* hook) { m_hook = hook; }
+    JsonStatsHook* hook() const { return m_hook; }
+
+    // add the counts from another JsonStats (maxDepth is the greater of the two)
+    JsonStats& operator+=(const JsonStats&);
+
+    // used by JsonReader and JsonWriter:
+    void addToken(TokenType type) { ++m_tokens[(int) type]; }
+    void addValue(JsonValue::Type type) { ++m_values[(int) type]; }
+    void enter() { if (++m_depth > maxDepth) { maxDepth = m_depth; } }
+    void leave() { --m_depth; }
+    void addString(size_t size) { stringBytes += size; }
+    void addEstimatedAllocations(int count) { estimatedAllocations += count; }
+    void addSeconds(Phase phase, double seconds) { m_seconds[(int) phase] += seconds; }
+
+private:
+    uint64_t m_tokens[(int) TokenType::COUNT];
+    uint64_t m_values[(int) JsonValue::Type::Invalid + 1];
+    double m_seconds[(int) Phase::COUNT];
+    int m_depth;
+    JsonStatsHook* m_hook = nullptr;
+};
+
+////////////////////////////////////////
+
+// Interface for forwarding statistics to a metrics system.
+// The JsonStats passed to the hook hold the counts for that single value only.
+class JsonStatsHook
+{
+public:
+    virtual ~JsonStatsHook() {}
+
+    // called after each call to JsonReader::read(), whether or not it succeeded
+    virtual void onRead(const JsonStats&, bool /*success*/) {}
+
+    // called after each call to JsonWriter::write()
+    virtual void onWrite(const JsonStats&) {}
+};
+
+
+} // namespace Simpson
@@ -1,8 +1,14 @@
 #pragma once
 
+#include "simpson/jsonkey.h"
 #include <vector>
 #include <string>
-#include <map>
+#include <string_view>
+#include <memory_resource>
+#include <atomic>
+#include <cstdint>
+#include <utility>
+#include <functional>
 #include <iostream>
 
 namespace Simpson 
@@ -28,23 +34,56 @@ public:
     // default-constructed value of specified type
     JsonValue(Type = Type::Invalid);
 
+    // The storage of strings, arrays and objects is allocated from a std::pmr::memory_resource; this is the
+    // default resource (std::pmr::get_default_resource()) unless one is given here. The resource must outlive
+    // the value and all copies of it, and must be thread-safe if copies are used on other threads.
+    // Only the value's own storage comes from the resource; values added to an array or object keep their own.
+    // (The characters of long strings and keys are still allocated with the global new.)
+    JsonValue(Type, std::pmr::memory_resource*);
+    JsonValue(std::string_view, std::pmr::memory_resource*); // String type
+
     JsonValue(nullptr_t); // Null type
     JsonValue(bool); // Boolean type
     JsonValue(double); // Number type
-    JsonValue(int); // Number type
+
+    // Number type, stored as a 64-bit integer (so it's exact, even above 2^53)
+    JsonValue(int);
+    JsonValue(unsigned int);
+    JsonValue(long);
+    JsonValue(unsigned long);
+    JsonValue(long long);
+    JsonValue(unsigned long long);
     JsonValue(const std::string&); // String type
     JsonValue(const char*); // String type (unless pointer is null, in which case type is then Null)
 
+    // Copies are cheap: string, array and object storage is reference-counted and shared between copies,
+    // and is only copied on the first write to a shared value. (That includes calling the non-const
+    // versions of get() and operator[], so use a const reference if you only need to read.)
+    // Copies can be safely passed to other threads.
+    // An array or object that a non-const accessor has returned a reference into is never shared again,
+    // since the reference could still be used to change it: later copies copy it (but not its children).
     ~JsonValue();
     JsonValue(const JsonValue&);
+    JsonValue(JsonValue&&) noexcept;
     JsonValue& operator=(const JsonValue&);
+    JsonValue& operator=(JsonValue&&);
 
     // value equality
     bool operator==(const JsonValue&) const;
     bool operator!=(const JsonValue&) const;
 
+    // A hash consistent with ==, so equal values have equal hashes however they're stored (1 and 1.0, a packed
+    // array and an unpacked one); the members of objects are combined without regard to order. Arrays and objects
+    // keep their hashes once computed, so hashing them again is cheap, and == compares kept hashes before
+    // comparing contents. Changing a value forgets its hash, but as with copies (above), don't modify values
+    // through a reference from a non-const accessor after hashing its container.
+    size_t hash() const;
+
     Type type() const { return m_type; }
 
+    // the memory resource that the value's storage comes from (the default resource for other types)
+    std::pmr::memory_resource* resource() const;
+
     // equivalent to comparing return value of type(), but more concise:
     bool isBoolean() const { return m_type == Type::Boolean; }
     bool isNumber() const { return m_type == Type::Number; }
@@ -57,19 +96,37 @@ public:
     bool isValid() const { return m_type != Type::Invalid; }
     explicit operator bool() const { return m_type != Type::Invalid; }
 
+    // Numbers are stored as 64-bit integers if they were created from integers, or read from text
+    // with no fraction or exponent that fits in an int64_t or uint64_t; otherwise as doubles.
+    // isInteger() is true for numbers stored as integers.
+    bool isInteger() const;
+
+    // Numbers read by a JsonReader with raw numbers enabled keep their original text instead; it's
+    // converted (each time) when the value is accessed, and written back unchanged.
+    bool isRawNumber() const { return m_type == Type::Number && m_numberType == NumberType::Raw; }
+    const std::pmr::string& numberText() const; // text of a raw number
+
     // get primitive values
     bool boolean() const;
     double number() const;
     float numberFloat() const { return (float) number(); }
     int numberInt() const { return (int) number(); }
-    const std::string& string() const;
+    int64_t int64() const; // doubles are truncated; throws if out of range
+    uint64_t uint64() const; // doubles are truncated; throws if out of range (including negative)
+    const std::pmr::string& string() const; // allocated from the value's memory resource
+
+    // the characters of a string, without copying them; see also JsonReader's in-situ mode, where
+    // strings refer to the reader's buffer, and string() has to copy them
+    std::string_view stringView() const;
 
     // get primitive values, or default if invalid
     bool boolean(bool def) const;
     double number(double def) const;
     float numberFloat(float def) const;
     int numberInt(int def) const;
-    const std::string& string(const std::string& def) const;
+    int64_t int64(int64_t def) const;
+    uint64_t uint64(uint64_t def) const;
+    const std::pmr::string& string(const std::pmr::string& def) const;
 
     // array/object
     int size() const;
@@ -85,37 +142,258 @@ public:
     void reserve(int size);
     void append(const JsonValue& value);
 
+    // A view of a contiguous run of values, like std::span.
+    template <typename T>
+    class Span
+    {
+    public:
+        Span() = default;
+        Span(const T* data, size_t size) : m_data(data), m_size(size) {}
+
+        const T* data() const { return m_data; }
+        size_t size() const { return m_size; }
+        bool empty() const { return m_size == 0; }
+        const T* begin() const { return m_data; }
+        const T* end() const { return m_data + m_size; }
+        const T& operator[](size_t i) const { return m_data[i]; }
+
+    private:
+        const T* m_data = nullptr;
+        size_t m_size = 0;
+    };
+
+    // Arrays whose elements are all doubles, all integers that fit in an int64_t, or all booleans can be
+    // packed: stored as a plain array of those values, without a JsonValue for each (JsonReader packs
+    // them automatically). Packed arrays behave like any other array, but:
+    // - adding or setting an element of a different kind, or calling the non-const get() or operator[],
+    //   unpacks the array (so that the element can be modified through the returned reference);
+    // - the const get() and operator[] make JsonValues for all the elements, the first time they're called.
+    // pack() returns false if the array can't be packed (including if it's empty).
+    bool isPacked() const { return m_type == Type::Array && m_arrayType != ArrayType::Generic && m_arrayType != ArrayType::Columns; }
+    bool pack();
+
+    // Arrays of objects that all have the same keys can be stored as columns: the keys once, and for each key,
+    // an array of its values in each object (packed, where possible). That takes much less memory, and
+    // column() gives direct access to each one. Rows are accessed as objects in the same way as the
+    // elements of a packed array (see above), and any change to the array unpacks it.
+    // toColumns() returns false if the array isn't one of objects with the same keys (including if it's empty).
+    bool isColumnar() const { return m_type == Type::Array && m_arrayType == ArrayType::Columns; }
+    bool toColumns();
+    const JsonValue& column(std::string_view key) const; // invalid if the array isn't columnar, or has no such key
+
+    // store a packed or columnar array as an ordinary array
+    void unpack();
+
+    // the elements of an array packed as doubles or integers, or an empty span for any other value
+    Span<double> doubles() const;
+    Span<int64_t> integers() const;
+
     // object
-    JsonValue& get(const std::string& key);
-    const JsonValue& get(const std::string& key) const;
-    JsonValue& operator[](const std::string& key);
-    const JsonValue& operator[](const std::string& key) const;
-    void set(const std::string& key, const JsonValue& value);
-    void remove(const std::string& key);
-    bool contains(const std::string& key) const;
-    const std::string& key(int index) const;
+    // Keys can be given as a std::string, a string literal, or a pointer and length ({ key, length });
+    // looking them up never allocates.
+    JsonValue& get(std::string_view key);
+    const JsonValue& get(std::string_view key) const;
+    JsonValue& operator[](std::string_view key);
+    const JsonValue& operator[](std::string_view key) const;
+    // Members are kept sorted by key, so set() with a new key moves the members that sort after it: adding
+    // keys in sorted order takes constant time each, but building an object of n members in any other order
+    // takes O(n^2) time. (The readers add members in the order they're read, and sort them once at the end.)
+    void set(std::string_view key, const JsonValue& value);
+    void remove(std::string_view key);
+    bool contains(std::string_view key) const;
+    const std::pmr::string& key(int index) const; // keys are in sorted order
+
+    // object lookups with a precomputed key, which are faster when the same key is looked up many times
+    JsonValue& get(const JsonKey& key);
+    const JsonValue& get(const JsonKey& key) const;
+    JsonValue& operator[](const JsonKey& key);
+    const JsonValue& operator[](const JsonKey& key) const;
+
+    // JSON Patch (RFC 6902): diff() returns a patch (an array of operations) that turns this value into the
+    // other one. Values that share storage (copies of each other) are skipped without comparing them; arrays
+    // are compared element by element, so inserting near the start of an array replaces the elements after it.
+    // apply() applies a patch, copying only the arrays and objects on the paths it changes, if they're shared.
+    // If any operation fails, or the patch is invalid, it returns false, and the value is unchanged.
+    JsonValue diff(const JsonValue& other) const;
+    bool apply(const JsonValue& patch);
 
     // serialization
     bool read(std::istream&);
     void write(std::ostream&, bool compact = false) const;
 
 private:
+    friend class JsonReader;
+    friend class JsonWriter;
+    friend class CborReader;
+    friend class MsgPackReader;
+    friend class CborWriter;
+    friend class MsgPackWriter;
+    friend class JsonSnapshot;
+
+    using Array = std::pmr::vector<JsonValue>;
+    struct Member;
+    using Object = std::pmr::vector<Member>; // sorted by key
+
+    template <typename T>
+    struct Shared
+    {
+        std::atomic<int> refCount;
+        std::atomic<uint32_t> hash; // of an array or object, once computed (see hash()); otherwise 0
+        std::pmr::memory_resource* resource; // the node was allocated from this
+        T value;
+
+        template <typename... Args>
+        Shared(std::pmr::memory_resource* r, Args&&... args) : refCount(1), hash(0), resource(r), value(std::forward<Args>(args)...) {}
+
+        Shared(const Shared&) = delete;
+        Shared& operator=(const Shared&) = delete;
+    };
+
+    // integers that fit in an int64_t are always stored as Int64, so each integer has one representation
+    enum class NumberType : uint8_t
+    {
+        Double,
+        Int64,
+        UInt64,
+        Raw, // text, in m_data.string
+    };
+
+    // a string in a buffer owned by the caller (see JsonReader's in-situ mode); string() needs a
+    // std::pmr::string, so the first call makes a copy, which is kept
+    struct BufferString
+    {
+        std::string_view view;
+        std::atomic<Shared<std::pmr::string>*> copy;
+
+        BufferString(std::string_view v) : view(v), copy(nullptr) {}
+        ~BufferString();
+    };
+
+    enum class StringType : uint8_t
+    {
+        Owned,  // in m_data.string
+        Buffer, // in m_data.buffer
+    };
+
+    enum class ArrayType : uint8_t
+    {
+        Generic,  // in m_data.array
+        Doubles,  // in m_data.packed
+        Integers, // in m_data.packed
+        Booleans, // in m_data.packed
+        Columns,  // in m_data.columns
+    };
+
+    // the elements of a packed array, in the vector for its type
+    struct Packed
+    {
+        std::pmr::vector<double> doubles;
+        std::pmr::vector<int64_t> integers;
+        std::pmr::vector<bool> booleans;
+        std::atomic<Shared<Array>*> elements; // as JsonValues, for the const accessors; made once
+
+        Packed(std::pmr::memory_resource*);
+        Packed(const Packed&, std::pmr::memory_resource*); // copies the values, but not the elements
+        Packed(Packed&&);
+        ~Packed();
+    };
+
+    struct Columns;
+
     Type m_type;
+    NumberType m_numberType = NumberType::Double;
+    StringType m_stringType = StringType::Owned;
+    ArrayType m_arrayType = ArrayType::Generic;
 
     union Data
     {
         bool boolean;
         double number;
-        std::string* string;
-        std::vector<JsonValue>* array;
-        std::map<std::string, JsonValue>* object;
+        int64_t int64;
+        uint64_t uint64;
+        Shared<std::pmr::string>* string;
+        Shared<BufferString>* buffer;
+        Shared<Array>* array;
+        Shared<Packed>* packed;
+        Shared<Columns>* columns;
+        Shared<Object>* object;
     };
 
     Data m_data;
 
+    static JsonValue rawNumber(std::string_view, std::pmr::memory_resource*);
+    static JsonValue bufferString(std::string_view, std::pmr::memory_resource*);
+    JsonValue decodeNumber() const;
+    void setInteger(int64_t);
+    void setUnsigned(uint64_t);
+    bool numberEquals(const JsonValue&) const;
+    uint32_t scalarHash() const;
+    uint32_t packedHash(int index) const;
+    std::atomic<uint32_t>* hashSlot() const;
+    uint32_t cachedHash() const;
+    int findMember(std::string_view key) const;
+    const JsonValue* findMember(const JsonKey& key) const;
+    static void sortMembers(Object&);
+    static ArrayType packedType(const JsonValue& element);
+    bool isGenericArray() const { return m_arrayType == ArrayType::Generic; }
+    int packedSize() const;
+    JsonValue packedElement(int index) const;
+    JsonValue element(int index) const;
+    bool appendPacked(const JsonValue& value);
+    const Array& elements() const;
+    void retain();
+    void makeUnshareable();
+    void release();
+    void releaseContainer();
+    void releaseContainerNode();
+    void detach();
+    bool sharesStorage(const JsonValue&) const;
     void assertType(Type) const;
     [[ noreturn ]] void throwTypeError() const;
 };
 
+// a member of an object; its key is allocated from the object's memory resource, which the object's
+// vector passes in when it makes, copies or moves a member
+struct JsonValue::Member
+{
+    using allocator_type = std::pmr::polymorphic_allocator<char>;
+
+    std::pmr::string key;
+    uint32_t hash; // JsonKey::hash(key), so lookups with a JsonKey can skip comparing the key
+    JsonValue value;
+
+    Member(std::string_view k, uint32_t h, JsonValue v, const allocator_type& a = {}) : key(k, a), hash(h), value(std::move(v)) {}
+    Member(const Member& other, const allocator_type& a) : key(other.key, a), hash(other.hash), value(other.value) {}
+    Member(Member&& other, const allocator_type& a) : key(std::move(other.key), a), hash(other.hash), value(std::move(other.value)) {}
+    Member(const Member&) = default;
+    Member(Member&&) = default;
+    Member& operator=(const Member&) = default;
+    Member& operator=(Member&&) = default;
+};
+
+// the columns of an array of objects with the same keys
+struct JsonValue::Columns
+{
+    JsonValue columns; // an object, with an array of values for each key
+    int rows;
+    std::atomic<Shared<Array>*> elements; // rows as objects, for the const accessors; made once
+
+    Columns(const JsonValue& c, int r) : columns(c), rows(r), elements(nullptr) {}
+    Columns(const Columns& other, std::pmr::memory_resource*) : Columns(other.columns, other.rows) {}
+    Columns(Columns&& other) : columns(std::move(other.columns)), rows(other.rows), elements(other.elements.exchange(nullptr)) {}
+    ~Columns();
+};
+
 
 } // namespace Simpson
+
+namespace std
+{
+
+template <>
+struct hash<Simpson::JsonValue>
+{
+    size_t operator()(const Simpson::JsonValue& value) const { return value.hash(); }
+};
+
+} // namespace std
@@ -1,27 +1,80 @@
 #pragma once
 
 #include "simpson/jsonvalue.h"
+#include "simpson/jsonstats.h"
 #include <iostream>
+#include <vector>
 
 namespace Simpson 
 {
 
 
+class WorkerPool;
+
 class JsonWriter
 {
 public:
     JsonWriter(std::ostream&);
+    ~JsonWriter();
 
     void setIndent(int);
 
+    // if enabled, characters over U+007F are written as \uXXXX escapes (as UTF-16 surrogate pairs, for those over
+    // U+FFFF), so the output is plain ASCII; invalid UTF-8 is written as \ufffd. Off by default.
+    void setAsciiOnly(bool);
+    bool asciiOnly() const { return m_asciiOnly; }
+
+    // if enabled, / is written as \/, so the output can be embedded in an HTML <script> element; off by default
+    void setEscapeSlash(bool);
+    bool escapeSlash() const { return m_escapeSlash; }
+
+    // Number of threads to write with. Arrays and objects with at least k_parallelSize elements are split
+    // into ranges of elements, which are written on separate threads and then output in order; the output
+    // is the same as when writing on one thread (the default). 0 for one thread per core. The threads are
+    // started by the first write that needs them, and kept until the writer is destroyed or this is changed.
+    static const int k_parallelSize = 4096;
+    void setThreads(int);
+    int threads() const { return m_threads; }
+
     void write(const JsonValue&);
 
+    // attach statistics to be updated by each write (or null to detach)
+    void setStats(JsonStats*);
+    JsonStats* stats() const { return m_stats; }
+
 private:
     std::ostream& m_stream;
     std::string m_indent = "  ";
+    bool m_asciiOnly = false;
+    bool m_escapeSlash = false;
+    int m_threads = 1;
+    WorkerPool* m_pool = nullptr; // m_threads threads, once a write has needed them
+    JsonStats* m_stats = nullptr;
+#if SIMPSON_ENABLE_STATS
+    JsonStats* m_record = nullptr; // where to record statistics for the current write, if any
+    JsonStats m_current;
+#endif
+
+    // an array or object being written; or a row of a columnar array, written as an object
+    struct Frame
+    {
+        const JsonValue* value;
+        int index;
+        int row;
+        int level; // of the container; its elements are one level deeper
+    };
+    std::vector<Frame> m_stack;
 
     void writeIndent(int level);
-    void writeImpl(const JsonValue&, int level = 0, const std::string& prefix = "");
+    void writeString(std::string_view);
+    bool needsEscape(unsigned char) const;
+    void writeUnicodeEscape(uint32_t);
+    void writeImpl(const JsonValue&);
+    void writeValue(const JsonValue&, int level, const std::pmr::string* key);
+    void writeNext();
+    void writeParallel();
+    void writeRange(const Frame& container, int begin, int end);
+    int frameSize(const Frame&) const;
 
     JsonWriter& operator=(const JsonWriter&) = delete;
     JsonWriter(const JsonWriter&) = delete;
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "simpson/jsonvalue.h"
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+namespace Simpson 
+{
+
+
+class ByteInput;
+
+// Reads values in MessagePack binary format.
+// Binary data is converted to base64url strings. Extension types and maps with non-string keys are not supported.
+class MsgPackReader
+{
+public:
+    MsgPackReader(std::istream&);
+    MsgPackReader(const void* data, size_t size);
+    ~MsgPackReader();
+
+    bool read(JsonValue&);
+
+    // Maximum nesting depth of arrays and maps; deeper input fails to read. As with JsonReader, input is read
+    // without recursion, so this bounds the depth of the values that are made rather than protecting the stack.
+    // 0 for no limit.
+    static const int k_defaultMaxDepth = 10000;
+    void setMaxDepth(int);
+    int maxDepth() const { return m_maxDepth; }
+
+    // byte offset of the input
+    int pos() const;
+
+private:
+    ByteInput* m_input;
+    int m_maxDepth = k_defaultMaxDepth;
+
+    // an array or map being read
+    struct Frame
+    {
+        JsonValue value;
+        std::string key; // of the next value, in a map
+        uint64_t remaining; // items left to read
+        bool sorted; // the map's keys were in order
+    };
+    std::vector<Frame> m_stack;
+
+    bool readKey(std::string&);
+    bool readScalar(uint8_t c, JsonValue&);
+    bool readValue(JsonValue&);
+
+    MsgPackReader& operator=(const MsgPackReader&) = delete;
+    MsgPackReader(const MsgPackReader&) = delete;
+};
+
+
+} // namespace Simpson
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "simpson/jsonvalue.h"
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+namespace Simpson 
+{
+
+
+class ByteOutput;
+
+// Writes values in MessagePack binary format.
+// Numbers are written as integers when they hold an exact integer, as float32 when that loses nothing,
+// and as float64 otherwise.
+class MsgPackWriter
+{
+public:
+    MsgPackWriter(std::ostream&);
+    MsgPackWriter(std::vector<uint8_t>&); // appends to the vector
+    ~MsgPackWriter();
+
+    void write(const JsonValue&);
+
+private:
+    ByteOutput* m_output;
+
+    void writeNumber(const JsonValue&);
+    void writeInteger(int64_t);
+    void writeUnsigned(uint64_t);
+    void writeString(std::string_view);
+    void writeContainerHead(int fixBase, uint8_t code16, uint8_t code32, size_t size);
+    void writeImpl(const JsonValue&);
+    void writeValue(const JsonValue&);
+
+    // an array or object being written; or a row of a columnar array, written as an object
+    struct Frame
+    {
+        const JsonValue* value;
+        int index; // of the next element or member
+        int row;
+    };
+    std::vector<Frame> m_stack;
+
+    int frameSize(const Frame&) const;
+
+    MsgPackWriter& operator=(const MsgPackWriter&) = delete;
+    MsgPackWriter(const MsgPackWriter&) = delete;
+};
+
+
+} // namespace Simpson
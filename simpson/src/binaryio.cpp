@@ -0,0 +1,228 @@
+#include "simpson/src/binaryio.h"
+#include <cmath>
+#include <cfloat>
+#include <cstring>
+#include <algorithm>
+
+namespace Simpson
+{
+
+namespace
+{
+    const size_t k_readBlockSize = 64 * 1024;
+}
+
+////////////////////////////////////////
+
+ByteInput::ByteInput(std::istream& stream) :
+    m_stream(&stream)
+{
+}
+
+ByteInput::ByteInput(const void* data, size_t size) :
+    m_begin((const uint8_t*) data),
+    m_pos((const uint8_t*) data),
+    m_end((const uint8_t*) data + size)
+{
+}
+
+bool ByteInput::get(uint8_t& c)
+{
+    if (m_pos == m_end && !refill())
+    {
+        return false;
+    }
+    c = *m_pos++;
+    return true;
+}
+
+bool ByteInput::read(void* dst, size_t size)
+{
+    uint8_t* out = (uint8_t*) dst;
+    while (size > 0)
+    {
+        if (m_pos == m_end && !refill())
+        {
+            return false;
+        }
+        size_t n = std::min(size, (size_t) (m_end - m_pos));
+        memcpy(out, m_pos, n);
+        out += n;
+        m_pos += n;
+        size -= n;
+    }
+    return true;
+}
+
+bool ByteInput::read(std::string& dst, uint64_t size)
+{
+    // copy in chunks rather than resizing up front, so a bogus length in the input can't make us allocate gigabytes
+    while (size > 0)
+    {
+        if (m_pos == m_end && !refill())
+        {
+            return false;
+        }
+        size_t n = (size_t) std::min(size, (uint64_t) (m_end - m_pos));
+        dst.append((const char*) m_pos, n);
+        m_pos += n;
+        size -= n;
+    }
+    return true;
+}
+
+bool ByteInput::readBigEndian(uint64_t& value, int bytes)
+{
+    uint8_t buf[8];
+    if (!read(buf, bytes))
+    {
+        return false;
+    }
+    value = 0;
+    for (int i = 0; i < bytes; ++i)
+    {
+        value = (value << 8) | buf[i];
+    }
+    return true;
+}
+
+bool ByteInput::eof()
+{
+    return m_pos == m_end && !refill();
+}
+
+bool ByteInput::refill()
+{
+    if (!m_stream || !*m_stream)
+    {
+        return false;
+    }
+
+    m_offset += m_end - m_begin;
+    m_buffer.resize(k_readBlockSize);
+    m_stream->read((char*) m_buffer.data(), m_buffer.size());
+    size_t count = (size_t) m_stream->gcount();
+    m_begin = m_pos = m_buffer.data();
+    m_end = m_begin + count;
+    return count > 0;
+}
+
+////////////////////////////////////////
+
+ByteOutput::ByteOutput(std::ostream& stream) :
+    m_stream(&stream),
+    m_buffer(&m_ownBuffer)
+{
+    m_ownBuffer.reserve(k_blockSize);
+}
+
+ByteOutput::ByteOutput(std::vector<uint8_t>& buffer) :
+    m_buffer(&buffer)
+{
+}
+
+ByteOutput::~ByteOutput()
+{
+    flush();
+}
+
+void ByteOutput::write(const void* data, size_t size)
+{
+    const uint8_t* p = (const uint8_t*) data;
+    m_buffer->insert(m_buffer->end(), p, p + size);
+    if (m_stream && m_buffer->size() >= k_blockSize)
+    {
+        flush();
+    }
+}
+
+void ByteOutput::writeBigEndian(uint64_t value, int bytes)
+{
+    uint8_t buf[8];
+    for (int i = bytes-1; i >= 0; --i)
+    {
+        buf[i] = (uint8_t) value;
+        value >>= 8;
+    }
+    write(buf, bytes);
+}
+
+void ByteOutput::flush()
+{
+    if (m_stream && !m_buffer->empty())
+    {
+        m_stream->write((const char*) m_buffer->data(), m_buffer->size());
+        m_buffer->clear();
+    }
+}
+
+////////////////////////////////////////
+
+bool toExactInteger(double d, int64_t& i)
+{
+    // 2^63 is exactly representable as a double, but is one past the largest int64_t
+    if (d >= -9223372036854775808.0 && d < 9223372036854775808.0 && d == std::floor(d) && !(d == 0 && std::signbit(d)))
+    {
+        i = (int64_t) d;
+        return true;
+    }
+    return false;
+}
+
+bool isExactFloat(double d)
+{
+    return !std::isfinite(d) || (std::fabs(d) <= FLT_MAX && (double) (float) d == d);
+}
+
+double halfToDouble(uint16_t half)
+{
+    int exponent = (half >> 10) & 0x1f;
+    int mantissa = half & 0x3ff;
+    double value;
+    if (exponent == 0)
+    {
+        value = std::ldexp(mantissa, -24);
+    }
+    else if (exponent != 31)
+    {
+        value = std::ldexp(mantissa + 1024, exponent - 25);
+    }
+    else
+    {
+        value = mantissa == 0 ? INFINITY : NAN;
+    }
+    return (half & 0x8000) ? -value : value;
+}
+
+std::string base64Url(const uint8_t* data, size_t size)
+{
+    static const char* k_chars = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+
+    std::string result;
+    result.reserve((size + 2) / 3 * 4);
+    size_t i = 0;
+    for (; i + 2 < size; i += 3)
+    {
+        uint32_t n = (data[i] << 16) | (data[i+1] << 8) | data[i+2];
+        result += k_chars[(n >> 18) & 0x3f];
+        result += k_chars[(n >> 12) & 0x3f];
+        result += k_chars[(n >> 6) & 0x3f];
+        result += k_chars[n & 0x3f];
+    }
+    if (i + 1 == size)
+    {
+        uint32_t n = data[i] << 16;
+        result += k_chars[(n >> 18) & 0x3f];
+        result += k_chars[(n >> 12) & 0x3f];
+    }
+    else if (i + 2 == size)
+    {
+        uint32_t n = (data[i] << 16) | (data[i+1] << 8);
+        result += k_chars[(n >> 18) & 0x3f];
+        result += k_chars[(n >> 12) & 0x3f];
+        result += k_chars[(n >> 6) & 0x3f];
+    }
+    return result;
+}
+
+} // namespace Simpson
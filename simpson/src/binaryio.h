@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <iostream>
+
+namespace Simpson
+{
+
+// Buffered byte input for the binary readers; reads either straight from a memory buffer,
+// or from a stream in large blocks (never a byte at a time).
+class ByteInput
+{
+public:
+    ByteInput(std::istream&);
+    ByteInput(const void* data, size_t size);
+
+    bool get(uint8_t&);
+    bool read(void* dst, size_t size);
+    bool read(std::string& dst, uint64_t size); // appends
+    bool readBigEndian(uint64_t& value, int bytes);
+
+    bool eof();
+    size_t pos() const { return m_offset + (m_pos - m_begin); }
+
+private:
+    std::istream* m_stream = nullptr;
+    std::vector<uint8_t> m_buffer;
+    const uint8_t* m_begin = nullptr;
+    const uint8_t* m_pos = nullptr;
+    const uint8_t* m_end = nullptr;
+    size_t m_offset = 0; // stream offset of m_begin
+
+    bool refill();
+
+    ByteInput& operator=(const ByteInput&) = delete;
+    ByteInput(const ByteInput&) = delete;
+};
+
+////////////////////////////////////////
+
+// Buffered byte output for the binary writers; appends to a vector, or collects output in
+// blocks which are then written to a stream.
+class ByteOutput
+{
+public:
+    ByteOutput(std::ostream&);
+    ByteOutput(std::vector<uint8_t>&);
+    ~ByteOutput();
+
+    void put(uint8_t c)
+    {
+        m_buffer->push_back(c);
+        if (m_stream && m_buffer->size() >= k_blockSize)
+        {
+            flush();
+        }
+    }
+    void write(const void* data, size_t size);
+    void writeBigEndian(uint64_t value, int bytes);
+
+    void flush();
+
+private:
+    static const size_t k_blockSize = 64 * 1024;
+
+    std::ostream* m_stream = nullptr;
+    std::vector<uint8_t> m_ownBuffer;
+    std::vector<uint8_t>* m_buffer;
+
+    ByteOutput& operator=(const ByteOutput&) = delete;
+    ByteOutput(const ByteOutput&) = delete;
+};
+
+////////////////////////////////////////
+
+// If the double holds an integer that can be represented exactly as an int64_t, return true and set the integer.
+// (-0 is not considered an integer, since converting it would lose the sign.)
+bool toExactInteger(double, int64_t&);
+
+// true if the double can be converted to float with no loss
+bool isExactFloat(double);
+
+// half-precision (IEEE 754 binary16) to double
+double halfToDouble(uint16_t);
+
+// base64url encoding without padding; this is how RFC 8949 says byte strings should be represented in JSON
+std::string base64Url(const uint8_t* data, size_t size);
+
+} // namespace Simpson
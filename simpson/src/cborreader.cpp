@@ -0,0 +1,343 @@
+#include "simpson/cborreader.h"
+#include "simpson/src/binaryio.h"
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+namespace Simpson 
+{
+
+const int CborReader::k_defaultMaxDepth;
+
+namespace
+{
+    enum MajorType
+    {
+        k_unsigned = 0,
+        k_negative = 1,
+        k_bytes = 2,
+        k_text = 3,
+        k_array = 4,
+        k_map = 5,
+        k_tag = 6,
+        k_simple = 7,
+    };
+
+    const int k_indefinite = 31;
+
+    // don't trust sizes in the input for more than this when reserving space
+    const uint64_t k_maxReserve = 4096;
+
+    void setFloat(JsonValue& value, double d)
+    {
+        // there's no JSON representation of NaN or infinity
+        if (std::isfinite(d))
+        {
+            value = d;
+        }
+        else
+        {
+            value = nullptr;
+        }
+    }
+}
+
+////////////////////////////////////////
+
+CborReader::CborReader(std::istream& stream) :
+    m_input(new ByteInput(stream))
+{
+}
+
+CborReader::CborReader(const void* data, size_t size) :
+    m_input(new ByteInput(data, size))
+{
+}
+
+CborReader::~CborReader()
+{
+    delete m_input;
+}
+
+bool CborReader::read(JsonValue& value)
+{
+    value = JsonValue(); // clear
+    return readValue(value);
+}
+
+void CborReader::setMaxDepth(int depth)
+{
+    m_maxDepth = depth;
+}
+
+int CborReader::pos() const
+{
+    return (int) m_input->pos();
+}
+
+////////////////////////////////////////
+
+bool CborReader::readHead(int& majorType, int& info, uint64_t& value)
+{
+    uint8_t c;
+    if (!m_input->get(c))
+    {
+        return false;
+    }
+    majorType = c >> 5;
+    info = c & 0x1f;
+
+    if (info < 24)
+    {
+        value = info;
+        return true;
+    }
+    else if (info <= 27)
+    {
+        // 24..27 mean the argument follows in 1, 2, 4 or 8 bytes
+        return m_input->readBigEndian(value, 1 << (info - 24));
+    }
+    else if (info == k_indefinite)
+    {
+        value = 0;
+        return majorType == k_bytes || majorType == k_text || majorType == k_array || majorType == k_map || majorType == k_simple;
+    }
+    else
+    {
+        // 28..30 are reserved
+        return false;
+    }
+}
+
+bool CborReader::readChunks(int majorType, int info, uint64_t value, std::string& str)
+{
+    if (info != k_indefinite)
+    {
+        return m_input->read(str, value);
+    }
+
+    // indefinite-length string is a sequence of definite-length chunks of the same type, terminated by "break"
+    while (true)
+    {
+        int chunkType, chunkInfo;
+        uint64_t chunkValue;
+        if (!readHead(chunkType, chunkInfo, chunkValue))
+        {
+            return false;
+        }
+        if (chunkType == k_simple && chunkInfo == k_indefinite)
+        {
+            return true;
+        }
+        if (chunkType != majorType || chunkInfo == k_indefinite || !m_input->read(str, chunkValue))
+        {
+            return false;
+        }
+    }
+}
+
+bool CborReader::readValue(JsonValue& result)
+{
+    // Arrays and maps that are being read are kept on a stack, rather than reading them recursively, so that
+    // deeply nested input can't overflow the call stack.
+    m_stack.clear();
+
+    for (;;)
+    {
+        JsonValue value;
+        Frame* frame = m_stack.empty() ? nullptr : &m_stack.back();
+        int majorType = 0, info = 0;
+        uint64_t arg = 0;
+        bool ended;
+        if (frame && !frame->indefinite && frame->remaining == 0)
+        {
+            ended = true;
+        }
+        else
+        {
+            if (!readHead(majorType, info, arg))
+            {
+                return false;
+            }
+            // a "break" stop code ends an indefinite-length item
+            ended = frame && frame->indefinite && majorType == k_simple && info == k_indefinite;
+        }
+
+        if (ended)
+        {
+            if (!frame->sorted)
+            {
+                JsonValue::sortMembers(frame->value.m_data.object->value);
+            }
+            value = std::move(frame->value);
+            m_stack.pop_back();
+        }
+        else
+        {
+            if (frame)
+            {
+                if (!frame->indefinite)
+                {
+                    --frame->remaining;
+                }
+                if (frame->value.isObject())
+                {
+                    frame->key.clear();
+                    if (majorType != k_text || !readChunks(majorType, info, arg, frame->key) || !readHead(majorType, info, arg))
+                    {
+                        return false;
+                    }
+                }
+            }
+
+            // no JSON equivalent of tags, so just use the tagged item
+            while (majorType == k_tag)
+            {
+                if (!readHead(majorType, info, arg))
+                {
+                    return false;
+                }
+            }
+
+            if (majorType == k_array || majorType == k_map)
+            {
+                if (m_maxDepth > 0 && (int) m_stack.size() >= m_maxDepth)
+                {
+                    return false;
+                }
+                bool isArray = (majorType == k_array);
+                m_stack.push_back(Frame{ JsonValue(isArray ? JsonValue::Type::Array : JsonValue::Type::Object), std::string(), arg, info == k_indefinite, true });
+                if (info != k_indefinite)
+                {
+                    if (isArray)
+                    {
+                        m_stack.back().value.reserve((int) std::min(arg, k_maxReserve));
+                    }
+                    else
+                    {
+                        m_stack.back().value.m_data.object->value.reserve(std::min(arg, k_maxReserve));
+                    }
+                }
+                continue; // read the first item
+            }
+
+            if (!readScalar(majorType, info, arg, value))
+            {
+                return false;
+            }
+        }
+
+        // add the value to its container
+        if (m_stack.empty())
+        {
+            result = std::move(value);
+            return true;
+        }
+        Frame& container = m_stack.back();
+        if (container.value.isArray())
+        {
+            container.value.append(value);
+        }
+        else
+        {
+            // members are sorted when the map ends, if they weren't in order
+            JsonValue::Object& members = container.value.m_data.object->value;
+            std::string_view key = container.key;
+            if (!members.empty() && !(std::string_view(members.back().key) < key))
+            {
+                container.sorted = false;
+            }
+            members.emplace_back(key, JsonKey::hash(key), std::move(value));
+        }
+    }
+}
+
+// a value that isn't an array, map or tag
+bool CborReader::readScalar(int majorType, int info, uint64_t arg, JsonValue& value)
+{
+    switch (majorType)
+    {
+        case k_unsigned:
+            value = JsonValue((unsigned long long) arg);
+            return true;
+
+        case k_negative:
+            if (arg <= (uint64_t) INT64_MAX)
+            {
+                value = JsonValue((long long) (-1 - (int64_t) arg));
+            }
+            else
+            {
+                value = -1.0 - (double) arg; // out of int64_t range
+            }
+            return true;
+
+        case k_bytes:
+        {
+            std::string bytes;
+            if (!readChunks(majorType, info, arg, bytes))
+            {
+                return false;
+            }
+            value = base64Url((const uint8_t*) bytes.data(), bytes.size());
+            return true;
+        }
+
+        case k_text:
+        {
+            std::string str;
+            if (!readChunks(majorType, info, arg, str))
+            {
+                return false;
+            }
+            value = str;
+            return true;
+        }
+
+        case k_simple:
+            switch (info)
+            {
+                case 20:
+                    value = false;
+                    return true;
+
+                case 21:
+                    value = true;
+                    return true;
+
+                case 25:
+                    setFloat(value, halfToDouble((uint16_t) arg));
+                    return true;
+
+                case 26:
+                {
+                    uint32_t bits = (uint32_t) arg;
+                    float f;
+                    memcpy(&f, &bits, sizeof(f));
+                    setFloat(value, f);
+                    return true;
+                }
+
+                case 27:
+                {
+                    double d;
+                    memcpy(&d, &arg, sizeof(d));
+                    setFloat(value, d);
+                    return true;
+                }
+
+                case k_indefinite:
+                    // "break" stop code; only valid at the end of an indefinite-length item
+                    return false;
+
+                default:
+                    // null, undefined, and unassigned simple values
+                    value = nullptr;
+                    return true;
+            }
+    }
+
+    return false;
+}
+
+} // namespace Simpson
@@ -0,0 +1,238 @@
+#include "simpson/cborwriter.h"
+#include "simpson/src/binaryio.h"
+#include <cstring>
+
+namespace Simpson 
+{
+
+namespace
+{
+    enum MajorType
+    {
+        k_unsigned = 0,
+        k_negative = 1,
+        k_text = 3,
+        k_array = 4,
+        k_map = 5,
+    };
+
+    const uint8_t k_false = 0xf4;
+    const uint8_t k_true = 0xf5;
+    const uint8_t k_null = 0xf6;
+    const uint8_t k_undefined = 0xf7;
+    const uint8_t k_float32 = 0xfa;
+    const uint8_t k_float64 = 0xfb;
+}
+
+////////////////////////////////////////
+
+CborWriter::CborWriter(std::ostream& stream) :
+    m_output(new ByteOutput(stream))
+{
+}
+
+CborWriter::CborWriter(std::vector<uint8_t>& buffer) :
+    m_output(new ByteOutput(buffer))
+{
+}
+
+CborWriter::~CborWriter()
+{
+    delete m_output;
+}
+
+void CborWriter::write(const JsonValue& value)
+{
+    writeImpl(value);
+    m_output->flush();
+}
+
+////////////////////////////////////////
+
+void CborWriter::writeHead(int majorType, uint64_t value)
+{
+    uint8_t type = (uint8_t) (majorType << 5);
+    if (value < 24)
+    {
+        m_output->put(type | (uint8_t) value);
+    }
+    else if (value <= 0xff)
+    {
+        m_output->put(type | 24);
+        m_output->put((uint8_t) value);
+    }
+    else if (value <= 0xffff)
+    {
+        m_output->put(type | 25);
+        m_output->writeBigEndian(value, 2);
+    }
+    else if (value <= 0xffffffff)
+    {
+        m_output->put(type | 26);
+        m_output->writeBigEndian(value, 4);
+    }
+    else
+    {
+        m_output->put(type | 27);
+        m_output->writeBigEndian(value, 8);
+    }
+}
+
+void CborWriter::writeNumber(const JsonValue& value)
+{
+    if (value.isInteger())
+    {
+        if (value.number() < 0)
+        {
+            writeHead(k_negative, (uint64_t) (-1 - value.int64()));
+        }
+        else
+        {
+            writeHead(k_unsigned, value.uint64());
+        }
+        return;
+    }
+
+    double d = value.number();
+    int64_t i;
+    if (toExactInteger(d, i))
+    {
+        if (i >= 0)
+        {
+            writeHead(k_unsigned, (uint64_t) i);
+        }
+        else
+        {
+            writeHead(k_negative, (uint64_t) (-1 - i));
+        }
+    }
+    else if (isExactFloat(d))
+    {
+        float f = (float) d;
+        uint32_t bits;
+        memcpy(&bits, &f, sizeof(bits));
+        m_output->put(k_float32);
+        m_output->writeBigEndian(bits, 4);
+    }
+    else
+    {
+        uint64_t bits;
+        memcpy(&bits, &d, sizeof(bits));
+        m_output->put(k_float64);
+        m_output->writeBigEndian(bits, 8);
+    }
+}
+
+void CborWriter::writeString(std::string_view s)
+{
+    writeHead(k_text, s.size());
+    m_output->write(s.data(), s.size());
+}
+
+void CborWriter::writeImpl(const JsonValue& root)
+{
+    // Containers being written are kept on a stack, rather than writing them recursively, so that deeply
+    // nested values can't overflow the call stack.
+    m_stack.clear();
+    writeValue(root);
+    while (!m_stack.empty())
+    {
+        Frame& frame = m_stack.back();
+        if (frame.index == frameSize(frame))
+        {
+            m_stack.pop_back();
+            continue;
+        }
+
+        // the frame reference isn't valid after writeValue() adds a container to the stack
+        const JsonValue& container = *frame.value;
+        int index = frame.index++;
+        int row = frame.row;
+        if (row >= 0)
+        {
+            // a member of a row: the row's value in the key's column
+            const JsonValue::Member& column = container.m_data.columns->value.columns.m_data.object->value[index];
+            writeString(column.key);
+            if (column.value.isPacked())
+            {
+                writeValue(column.value.packedElement(row));
+            }
+            else
+            {
+                writeValue(column.value.m_data.array->value[row]);
+            }
+        }
+        else if (container.isColumnar())
+        {
+            // a row, which is written from the columns rather than made as an object
+            const JsonValue::Object& columns = container.m_data.columns->value.columns.m_data.object->value;
+            writeHead(k_map, columns.size());
+            m_stack.push_back(Frame{ &container, 0, index });
+        }
+        else if (container.isPacked())
+        {
+            writeValue(container.packedElement(index)); // a scalar, so it isn't kept
+        }
+        else if (container.isArray())
+        {
+            writeValue(container.m_data.array->value[index]);
+        }
+        else
+        {
+            const JsonValue::Member& member = container.m_data.object->value[index];
+            writeString(member.key);
+            writeValue(member.value);
+        }
+    }
+}
+
+// number of elements (or members) of a frame
+int CborWriter::frameSize(const Frame& frame) const
+{
+    return frame.row >= 0 ? (int) frame.value->m_data.columns->value.columns.m_data.object->value.size() : frame.value->size();
+}
+
+// write a value, or the head of an array or object, which is added to the stack
+void CborWriter::writeValue(const JsonValue& value)
+{
+    switch (value.type())
+    {
+        case JsonValue::Type::Boolean:
+            m_output->put(value.boolean() ? k_true : k_false);
+            break;
+
+        case JsonValue::Type::Number:
+            writeNumber(value);
+            break;
+
+        case JsonValue::Type::String:
+            writeString(value.stringView());
+            break;
+
+        case JsonValue::Type::Null:
+            m_output->put(k_null);
+            break;
+
+        case JsonValue::Type::Invalid:
+            m_output->put(k_undefined);
+            break;
+
+        case JsonValue::Type::Array:
+            writeHead(k_array, value.size());
+            if (value.size() > 0)
+            {
+                m_stack.push_back(Frame{ &value, 0, -1 });
+            }
+            break;
+
+        case JsonValue::Type::Object:
+            writeHead(k_map, value.size());
+            if (value.size() > 0)
+            {
+                m_stack.push_back(Frame{ &value, 0, -1 });
+            }
+            break;
+    }
+}
+
+} // namespace Simpson
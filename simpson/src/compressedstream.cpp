@@ -0,0 +1,550 @@
+#include "simpson/compressedstream.h"
+#include <vector>
+#include <stdexcept>
+#include <cstring>
+#include <algorithm>
+
+#ifndef SIMPSON_ENABLE_ZLIB
+#define SIMPSON_ENABLE_ZLIB 0
+#endif
+#ifndef SIMPSON_ENABLE_ZSTD
+#define SIMPSON_ENABLE_ZSTD 0
+#endif
+
+#if SIMPSON_ENABLE_ZLIB
+#include <zlib.h>
+#endif
+#if SIMPSON_ENABLE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace Simpson 
+{
+
+namespace
+{
+    // size of the blocks of compressed and decompressed data
+    const size_t k_blockSize = 64 * 1024;
+
+    // the most passed to the libraries at once, since zlib counts in 32 bits
+    const size_t k_maxChunk = 1 << 30;
+
+    void checkAvailable(Compression compression)
+    {
+        if (!isCompressionAvailable(compression))
+        {
+            throw std::runtime_error(compression == Compression::Gzip ? "gzip isn't available in this build" : "zstd isn't available in this build");
+        }
+    }
+}
+
+bool isCompressionAvailable(Compression compression)
+{
+    switch (compression)
+    {
+        case Compression::Gzip:
+            return SIMPSON_ENABLE_ZLIB != 0;
+        case Compression::Zstd:
+            return SIMPSON_ENABLE_ZSTD != 0;
+        default:
+            return true;
+    }
+}
+
+////////////////////////////////////////
+
+class DecompressingStream::Buffer : public std::streambuf
+{
+public:
+    Buffer(std::istream& source, Compression);
+    ~Buffer();
+
+protected:
+    int_type underflow() override;
+    std::streamsize xsgetn(char* s, std::streamsize count) override;
+
+private:
+    std::istream& m_source;
+    Compression m_format;
+    std::vector<char> m_in;  // compressed data read from the source
+    size_t m_inPos = 0;
+    size_t m_inEnd = 0;
+    std::vector<char> m_out; // decompressed data, for reads of a few characters at a time
+    bool m_inFrame = false;  // partway through a gzip member or zstd frame
+#if SIMPSON_ENABLE_ZLIB
+    z_stream m_zlib;
+#endif
+#if SIMPSON_ENABLE_ZSTD
+    ZSTD_DStream* m_zstd = nullptr;
+#endif
+
+    bool fill();
+    size_t decompress(char* out, size_t size);
+};
+
+DecompressingStream::Buffer::Buffer(std::istream& source, Compression compression) :
+    m_source(source),
+    m_format(compression),
+    m_in(k_blockSize)
+{
+    if (m_format == Compression::Auto)
+    {
+        // look at the start of the data for the magic numbers of the formats
+        fill();
+        const unsigned char* start = (const unsigned char*) m_in.data();
+        if (m_inEnd >= 2 && start[0] == 0x1f && start[1] == 0x8b)
+        {
+            m_format = Compression::Gzip;
+        }
+        else if (m_inEnd >= 4 && start[0] == 0x28 && start[1] == 0xb5 && start[2] == 0x2f && start[3] == 0xfd)
+        {
+            m_format = Compression::Zstd;
+        }
+        else
+        {
+            m_format = Compression::None;
+        }
+    }
+    checkAvailable(m_format);
+
+#if SIMPSON_ENABLE_ZLIB
+    if (m_format == Compression::Gzip)
+    {
+        memset(&m_zlib, 0, sizeof(m_zlib));
+        if (inflateInit2(&m_zlib, 15 + 32) != Z_OK) // 32: detect a gzip or zlib header
+        {
+            throw std::runtime_error("can't initialize zlib");
+        }
+    }
+#endif
+#if SIMPSON_ENABLE_ZSTD
+    if (m_format == Compression::Zstd)
+    {
+        m_zstd = ZSTD_createDStream();
+        if (!m_zstd || ZSTD_isError(ZSTD_initDStream(m_zstd)))
+        {
+            ZSTD_freeDStream(m_zstd);
+            throw std::runtime_error("can't initialize zstd");
+        }
+    }
+#endif
+}
+
+DecompressingStream::Buffer::~Buffer()
+{
+#if SIMPSON_ENABLE_ZLIB
+    if (m_format == Compression::Gzip)
+    {
+        inflateEnd(&m_zlib);
+    }
+#endif
+#if SIMPSON_ENABLE_ZSTD
+    ZSTD_freeDStream(m_zstd);
+#endif
+}
+
+DecompressingStream::Buffer::int_type DecompressingStream::Buffer::underflow()
+{
+    if (gptr() == egptr())
+    {
+        m_out.resize(k_blockSize);
+        size_t count = decompress(m_out.data(), m_out.size());
+        if (count == 0)
+        {
+            return traits_type::eof();
+        }
+        setg(m_out.data(), m_out.data(), m_out.data() + count);
+    }
+    return traits_type::to_int_type(*gptr());
+}
+
+std::streamsize DecompressingStream::Buffer::xsgetn(char* s, std::streamsize count)
+{
+    // first anything that's been decompressed already, and then the rest decompressed straight into s
+    std::streamsize done = std::min<std::streamsize>(egptr() - gptr(), count);
+    if (done > 0)
+    {
+        memcpy(s, gptr(), (size_t) done);
+        setg(eback(), gptr() + done, egptr());
+    }
+    while (done < count)
+    {
+        size_t n = decompress(s + done, (size_t) (count - done));
+        if (n == 0)
+        {
+            break;
+        }
+        done += (std::streamsize) n;
+    }
+    return done;
+}
+
+// read more compressed data, if it's all been used; returns false at the end of the source
+bool DecompressingStream::Buffer::fill()
+{
+    if (m_inPos < m_inEnd)
+    {
+        return true;
+    }
+    m_inPos = 0;
+    m_inEnd = 0;
+    if (m_source)
+    {
+        m_source.read(m_in.data(), m_in.size());
+        m_inEnd = (size_t) m_source.gcount();
+    }
+    return m_inEnd > 0;
+}
+
+// decompress some data into out; returns the size, or 0 at the end
+size_t DecompressingStream::Buffer::decompress(char* out, size_t size)
+{
+    size = std::min(size, k_maxChunk);
+    switch (m_format)
+    {
+#if SIMPSON_ENABLE_ZLIB
+        case Compression::Gzip:
+        {
+            m_zlib.next_out = (Bytef*) out;
+            m_zlib.avail_out = (uInt) size;
+            for (;;)
+            {
+                // inflate may have output left even when there's no input left
+                size_t available = m_inEnd - m_inPos;
+                int result = Z_BUF_ERROR;
+                if (available > 0 || m_inFrame)
+                {
+                    m_zlib.next_in = (Bytef*) m_in.data() + m_inPos;
+                    m_zlib.avail_in = (uInt) available;
+                    result = inflate(&m_zlib, Z_NO_FLUSH);
+                    m_inPos += available - m_zlib.avail_in;
+                }
+                if (result == Z_STREAM_END)
+                {
+                    inflateReset(&m_zlib); // another member may follow
+                    m_inFrame = false;
+                }
+                else if (result == Z_OK)
+                {
+                    m_inFrame = true;
+                }
+                else if (result != Z_BUF_ERROR)
+                {
+                    throw std::runtime_error("invalid gzip data");
+                }
+                if (m_zlib.avail_out < size)
+                {
+                    return size - m_zlib.avail_out;
+                }
+                if (result == Z_BUF_ERROR && !fill())
+                {
+                    if (m_inFrame)
+                    {
+                        throw std::runtime_error("gzip data ends early");
+                    }
+                    return 0;
+                }
+            }
+        }
+#endif
+#if SIMPSON_ENABLE_ZSTD
+        case Compression::Zstd:
+        {
+            ZSTD_outBuffer output = { out, size, 0 };
+            for (;;)
+            {
+                ZSTD_inBuffer input = { m_in.data() + m_inPos, m_inEnd - m_inPos, 0 };
+                size_t result = ZSTD_decompressStream(m_zstd, &output, &input);
+                if (ZSTD_isError(result))
+                {
+                    throw std::runtime_error("invalid zstd data");
+                }
+                m_inPos += input.pos;
+                if (output.pos > 0)
+                {
+                    m_inFrame = (result != 0);
+                    return output.pos;
+                }
+                if (input.pos > 0)
+                {
+                    m_inFrame = (result != 0);
+                }
+                else if (!fill())
+                {
+                    if (m_inFrame)
+                    {
+                        throw std::runtime_error("zstd data ends early");
+                    }
+                    return 0;
+                }
+            }
+        }
+#endif
+        default:
+        {
+            // uncompressed: what's been read to detect the format, and then straight from the source
+            if (m_inPos < m_inEnd)
+            {
+                size_t count = std::min(size, m_inEnd - m_inPos);
+                memcpy(out, m_in.data() + m_inPos, count);
+                m_inPos += count;
+                return count;
+            }
+            if (!m_source)
+            {
+                return 0;
+            }
+            m_source.read(out, (std::streamsize) size);
+            return (size_t) m_source.gcount();
+        }
+    }
+}
+
+////////////////////////////////////////
+
+DecompressingStream::DecompressingStream(std::istream& compressed, Compression compression) :
+    std::istream(nullptr),
+    m_buffer(new Buffer(compressed, compression))
+{
+    rdbuf(m_buffer);
+}
+
+DecompressingStream::~DecompressingStream()
+{
+    delete m_buffer;
+}
+
+////////////////////////////////////////
+
+class CompressingStream::Buffer : public std::streambuf
+{
+public:
+    Buffer(std::ostream& destination, Compression, int level);
+    ~Buffer();
+
+    bool finish();
+
+protected:
+    int_type overflow(int_type c) override;
+    std::streamsize xsputn(const char* s, std::streamsize count) override;
+    int sync() override { return 0; } // see CompressingStream
+
+private:
+    std::ostream& m_destination;
+    Compression m_format;
+    std::vector<char> m_in;  // data to compress (the put area)
+    std::vector<char> m_out; // compressed data
+    bool m_finished = false;
+#if SIMPSON_ENABLE_ZLIB
+    z_stream m_zlib;
+#endif
+#if SIMPSON_ENABLE_ZSTD
+    ZSTD_CCtx* m_zstd = nullptr;
+#endif
+
+    void compressPending(bool end);
+    void compress(const char* data, size_t size, bool end);
+};
+
+CompressingStream::Buffer::Buffer(std::ostream& destination, Compression compression, int level) :
+    m_destination(destination),
+    m_format(compression),
+    m_in(k_blockSize),
+    m_out(k_blockSize)
+{
+    if (m_format == Compression::Auto)
+    {
+        throw std::runtime_error("a compressed format must be chosen for writing");
+    }
+    checkAvailable(m_format);
+    setp(m_in.data(), m_in.data() + m_in.size());
+
+#if SIMPSON_ENABLE_ZLIB
+    if (m_format == Compression::Gzip)
+    {
+        memset(&m_zlib, 0, sizeof(m_zlib));
+        if (deflateInit2(&m_zlib, level ? level : Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) // 16: a gzip header
+        {
+            throw std::runtime_error("can't initialize zlib");
+        }
+    }
+#endif
+#if SIMPSON_ENABLE_ZSTD
+    if (m_format == Compression::Zstd)
+    {
+        m_zstd = ZSTD_createCCtx();
+        if (!m_zstd || ZSTD_isError(ZSTD_CCtx_setParameter(m_zstd, ZSTD_c_compressionLevel, level)))
+        {
+            ZSTD_freeCCtx(m_zstd);
+            throw std::runtime_error("can't initialize zstd");
+        }
+    }
+#endif
+    (void) level;
+}
+
+CompressingStream::Buffer::~Buffer()
+{
+#if SIMPSON_ENABLE_ZLIB
+    if (m_format == Compression::Gzip)
+    {
+        deflateEnd(&m_zlib);
+    }
+#endif
+#if SIMPSON_ENABLE_ZSTD
+    ZSTD_freeCCtx(m_zstd);
+#endif
+}
+
+bool CompressingStream::Buffer::finish()
+{
+    if (!m_finished)
+    {
+        m_finished = true;
+        compressPending(true);
+        m_destination.flush();
+    }
+    return !m_destination.fail();
+}
+
+CompressingStream::Buffer::int_type CompressingStream::Buffer::overflow(int_type c)
+{
+    if (m_finished)
+    {
+        return traits_type::eof();
+    }
+    compressPending(false);
+    if (!traits_type::eq_int_type(c, traits_type::eof()))
+    {
+        *pptr() = traits_type::to_char_type(c);
+        pbump(1);
+    }
+    return traits_type::not_eof(c);
+}
+
+std::streamsize CompressingStream::Buffer::xsputn(const char* s, std::streamsize count)
+{
+    if (m_finished)
+    {
+        return 0;
+    }
+    if (count > epptr() - pptr())
+    {
+        compressPending(false);
+        if ((size_t) count >= m_in.size())
+        {
+            // too big for the buffer, so compress it from where it is
+            compress(s, (size_t) count, false);
+            return count;
+        }
+    }
+    memcpy(pptr(), s, (size_t) count);
+    pbump((int) count);
+    return count;
+}
+
+void CompressingStream::Buffer::compressPending(bool end)
+{
+    compress(pbase(), pptr() - pbase(), end);
+    setp(m_in.data(), m_in.data() + m_in.size());
+}
+
+// compress data, writing whatever compressed data is ready; if end is true, finish the compressed data
+void CompressingStream::Buffer::compress(const char* data, size_t size, bool end)
+{
+    switch (m_format)
+    {
+#if SIMPSON_ENABLE_ZLIB
+        case Compression::Gzip:
+        {
+            do
+            {
+                size_t chunk = std::min(size, k_maxChunk);
+                m_zlib.next_in = (Bytef*) data;
+                m_zlib.avail_in = (uInt) chunk;
+                int flush = (end && chunk == size) ? Z_FINISH : Z_NO_FLUSH;
+                do
+                {
+                    m_zlib.next_out = (Bytef*) m_out.data();
+                    m_zlib.avail_out = (uInt) m_out.size();
+                    if (deflate(&m_zlib, flush) == Z_STREAM_ERROR)
+                    {
+                        throw std::runtime_error("can't compress gzip data");
+                    }
+                    m_destination.write(m_out.data(), m_out.size() - m_zlib.avail_out);
+                }
+                while (m_zlib.avail_out == 0);
+                data += chunk;
+                size -= chunk;
+            }
+            while (size > 0);
+            break;
+        }
+#endif
+#if SIMPSON_ENABLE_ZSTD
+        case Compression::Zstd:
+        {
+            ZSTD_inBuffer input = { data, size, 0 };
+            for (;;)
+            {
+                ZSTD_outBuffer output = { m_out.data(), m_out.size(), 0 };
+                size_t remaining = ZSTD_compressStream2(m_zstd, &output, &input, end ? ZSTD_e_end : ZSTD_e_continue);
+                if (ZSTD_isError(remaining))
+                {
+                    throw std::runtime_error("can't compress zstd data");
+                }
+                m_destination.write(m_out.data(), output.pos);
+                if (end ? remaining == 0 : input.pos == input.size)
+                {
+                    break;
+                }
+            }
+            break;
+        }
+#endif
+        default:
+            m_destination.write(data, size);
+            break;
+    }
+    (void) end;
+}
+
+////////////////////////////////////////
+
+CompressingStream::CompressingStream(std::ostream& compressed, Compression compression, int level) :
+    std::ostream(nullptr),
+    m_buffer(new Buffer(compressed, compression, level))
+{
+    rdbuf(m_buffer);
+}
+
+CompressingStream::~CompressingStream()
+{
+    try
+    {
+        m_buffer->finish();
+    }
+    catch (...)
+    {
+        // nowhere to report it; call finish() to find out
+    }
+    delete m_buffer;
+}
+
+bool CompressingStream::finish()
+{
+    try
+    {
+        if (m_buffer->finish())
+        {
+            return true;
+        }
+    }
+    catch (const std::exception&)
+    {
+    }
+    setstate(std::ios::badbit);
+    return false;
+}
+
+} // namespace Simpson
@@ -0,0 +1,399 @@
+#include "simpson/jsonbinding.h"
+#include "simpson/src/tokenizer.h"
+#include "simpson/src/numbers.h"
+#include <cmath>
+
+namespace Simpson 
+{
+
+const int JsonDecoder::k_defaultMaxDepth;
+
+namespace
+{
+    const double k_twoTo63 = 9223372036854775808.0;
+    const double k_twoTo64 = 18446744073709551616.0;
+
+    bool isScalar(TokenType type)
+    {
+        return type == TokenType::STRING || type == TokenType::NUMBER || type == TokenType::BOOLEAN || type == TokenType::NULL_;
+    }
+}
+
+////////////////////////////////////////
+
+JsonDecoder::JsonDecoder(const char* data, size_t size) :
+    m_tokenizer(new Tokenizer(data, size)),
+    m_data(data),
+    m_size(size)
+{
+    advance();
+}
+
+JsonDecoder::~JsonDecoder()
+{
+    delete m_tokenizer;
+}
+
+TokenType JsonDecoder::peek() const
+{
+    return fail() ? TokenType::END : m_tokenizer->getToken().type;
+}
+
+bool JsonDecoder::readNull()
+{
+    if (peek() != TokenType::NULL_)
+    {
+        return error();
+    }
+    advance();
+    return true;
+}
+
+bool JsonDecoder::read(bool& value)
+{
+    if (peek() != TokenType::BOOLEAN)
+    {
+        return error();
+    }
+    value = m_tokenizer->getToken().boolean;
+    advance();
+    return true;
+}
+
+bool JsonDecoder::read(int64_t& value)
+{
+    JsonValue number;
+    if (peek() != TokenType::NUMBER || !parseNumber(m_tokenizer->getToken().text.data(), m_tokenizer->getToken().text.size(), number))
+    {
+        return error();
+    }
+    double d = number.number();
+    if (number.isInteger())
+    {
+        if (d >= 0 && number.uint64() > (uint64_t) INT64_MAX)
+        {
+            return error();
+        }
+        value = number.int64();
+    }
+    else
+    {
+        // exact integers written with a fraction or exponent
+        if (d != std::trunc(d) || d < -k_twoTo63 || d >= k_twoTo63)
+        {
+            return error();
+        }
+        value = (int64_t) d;
+    }
+    advance();
+    return true;
+}
+
+bool JsonDecoder::read(uint64_t& value)
+{
+    JsonValue number;
+    if (peek() != TokenType::NUMBER || !parseNumber(m_tokenizer->getToken().text.data(), m_tokenizer->getToken().text.size(), number))
+    {
+        return error();
+    }
+    double d = number.number();
+    if (d < 0)
+    {
+        return error();
+    }
+    if (number.isInteger())
+    {
+        value = number.uint64();
+    }
+    else
+    {
+        if (d != std::trunc(d) || d >= k_twoTo64)
+        {
+            return error();
+        }
+        value = (uint64_t) d;
+    }
+    advance();
+    return true;
+}
+
+bool JsonDecoder::read(double& value)
+{
+    JsonValue number;
+    if (peek() != TokenType::NUMBER || !parseNumber(m_tokenizer->getToken().text.data(), m_tokenizer->getToken().text.size(), number))
+    {
+        return error();
+    }
+    value = number.number();
+    advance();
+    return true;
+}
+
+bool JsonDecoder::read(std::string& value)
+{
+    if (peek() != TokenType::STRING)
+    {
+        return error();
+    }
+    value.assign(m_tokenizer->getToken().text);
+    advance();
+    return true;
+}
+
+bool JsonDecoder::read(std::string_view& value)
+{
+    if (peek() != TokenType::STRING)
+    {
+        return error();
+    }
+    // strings with escapes are unescaped into the tokenizer's scratch buffer, which the next token may
+    // replace, so keep a copy
+    std::string_view text = m_tokenizer->getToken().text;
+    if (text.data() < m_data || text.data() >= m_data + m_size)
+    {
+        m_key.assign(text);
+        text = m_key;
+    }
+    value = text;
+    advance();
+    return true;
+}
+
+bool JsonDecoder::beginArray()
+{
+    if (peek() != TokenType::ARRAY_START || (m_maxDepth > 0 && m_depth >= m_maxDepth))
+    {
+        return error();
+    }
+    ++m_depth;
+    advance();
+    return true;
+}
+
+bool JsonDecoder::nextElement(bool first)
+{
+    TokenType type = peek();
+    if (type == TokenType::ARRAY_END)
+    {
+        --m_depth;
+        advance();
+        return false;
+    }
+    if (!first)
+    {
+        if (type != TokenType::COMMA)
+        {
+            return error();
+        }
+        advance();
+    }
+    return !fail();
+}
+
+bool JsonDecoder::beginObject()
+{
+    if (peek() != TokenType::OBJECT_START || (m_maxDepth > 0 && m_depth >= m_maxDepth))
+    {
+        return error();
+    }
+    ++m_depth;
+    advance();
+    return true;
+}
+
+bool JsonDecoder::nextMember(bool first, std::string_view& key)
+{
+    TokenType type = peek();
+    if (type == TokenType::OBJECT_END)
+    {
+        --m_depth;
+        advance();
+        return false;
+    }
+    if (!first)
+    {
+        if (type != TokenType::COMMA)
+        {
+            return error();
+        }
+        advance();
+    }
+    if (!read(key) || peek() != TokenType::COLON)
+    {
+        return error();
+    }
+    advance();
+    return !fail();
+}
+
+bool JsonDecoder::skipValue()
+{
+    // Containers being skipped are kept on a stack, rather than skipping them recursively, so that deeply
+    // nested values can't overflow the call stack.
+    m_skipping.clear();
+    for (;;)
+    {
+        // a value
+        TokenType type = peek();
+        if (type == TokenType::ARRAY_START || type == TokenType::OBJECT_START)
+        {
+            bool isArray = (type == TokenType::ARRAY_START);
+            advance();
+            if (peek() != (isArray ? TokenType::ARRAY_END : TokenType::OBJECT_END))
+            {
+                m_skipping.push_back(isArray);
+                if (!isArray && !skipKey())
+                {
+                    return false;
+                }
+                continue;
+            }
+        }
+        else if (!isScalar(type))
+        {
+            return error();
+        }
+        advance();
+
+        // after a value: the end of the containers it closes, then the next element or member
+        for (;;)
+        {
+            if (m_skipping.empty())
+            {
+                return !fail();
+            }
+            type = peek();
+            if (type == TokenType::COMMA)
+            {
+                advance();
+                if (!m_skipping.back() && !skipKey())
+                {
+                    return false;
+                }
+                break;
+            }
+            else if (type == (m_skipping.back() ? TokenType::ARRAY_END : TokenType::OBJECT_END))
+            {
+                m_skipping.pop_back();
+                advance();
+            }
+            else
+            {
+                return error();
+            }
+        }
+    }
+}
+
+bool JsonDecoder::end() const
+{
+    return !fail() && m_tokenizer->getToken().type == TokenType::END;
+}
+
+bool JsonDecoder::fail() const
+{
+    return m_fail || m_tokenizer->fail();
+}
+
+int JsonDecoder::pos() const
+{
+    return m_tokenizer->pos();
+}
+
+void JsonDecoder::setMaxDepth(int depth)
+{
+    m_maxDepth = depth;
+}
+
+////////////////////////////////////////
+
+void JsonDecoder::advance()
+{
+    m_tokenizer->advance();
+}
+
+bool JsonDecoder::error()
+{
+    m_fail = true;
+    return false;
+}
+
+// skip a key and the colon after it
+bool JsonDecoder::skipKey()
+{
+    if (peek() != TokenType::STRING)
+    {
+        return error();
+    }
+    advance();
+    if (peek() != TokenType::COLON)
+    {
+        return error();
+    }
+    advance();
+    return true;
+}
+
+////////////////////////////////////////
+
+void JsonEncoder::write(int64_t value)
+{
+    char buffer[k_maxIntegerLength];
+    m_out.append(buffer, formatInteger(value, buffer));
+}
+
+void JsonEncoder::write(uint64_t value)
+{
+    char buffer[k_maxIntegerLength];
+    m_out.append(buffer, formatUnsigned(value, buffer));
+}
+
+void JsonEncoder::write(double value)
+{
+    if (!std::isfinite(value))
+    {
+        writeNull();
+        return;
+    }
+    char buffer[k_maxDoubleLength];
+    m_out.append(buffer, formatDouble(value, buffer));
+}
+
+void JsonEncoder::write(std::string_view s)
+{
+    // append runs of characters that don't need escaping at once
+    m_out.push_back('"');
+    const char* run = s.data();
+    const char* end = s.data() + s.size();
+    for (const char* p = run; p < end; ++p)
+    {
+        unsigned char c = (unsigned char) *p;
+        if (c >= 0x20 && c != '"' && c != '\\')
+        {
+            continue;
+        }
+        m_out.append(run, p - run);
+        run = p + 1;
+        switch (c)
+        {
+            case '"': m_out.append("\\\"", 2); break;
+            case '\\': m_out.append("\\\\", 2); break;
+            case '\b': m_out.append("\\b", 2); break;
+            case '\f': m_out.append("\\f", 2); break;
+            case '\n': m_out.append("\\n", 2); break;
+            case '\r': m_out.append("\\r", 2); break;
+            case '\t': m_out.append("\\t", 2); break;
+            default:
+            {
+                const char hex[] = "0123456789abcdef";
+                char escape[6] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xf] };
+                m_out.append(escape, 6);
+                break;
+            }
+        }
+    }
+    m_out.append(run, end - run);
+    m_out.push_back('"');
+}
+
+} // namespace Simpson
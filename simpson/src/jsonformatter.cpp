@@ -0,0 +1,197 @@
+#include "simpson/jsonformatter.h"
+#include "simpson/src/tokenizer.h"
+#include "simpson/src/numbers.h"
+
+namespace Simpson 
+{
+
+const int JsonFormatter::k_minify;
+
+namespace
+{
+    const size_t k_outputBlockSize = 64 * 1024;
+}
+
+JsonFormatter::JsonFormatter(std::istream& in, std::ostream& out) :
+    m_tokenizer(new Tokenizer(in)),
+    m_stream(out)
+{}
+
+JsonFormatter::JsonFormatter(const char* data, size_t size, std::ostream& out) :
+    m_tokenizer(new Tokenizer(data, size)),
+    m_stream(out)
+{}
+
+JsonFormatter::~JsonFormatter()
+{
+    delete m_tokenizer;
+}
+
+void JsonFormatter::setIndent(int spaces)
+{
+    m_minify = (spaces < 0);
+    m_indent = std::string(m_minify ? 0 : spaces, ' ');
+}
+
+bool JsonFormatter::format()
+{
+    m_stack.clear();
+    bool success = formatValue();
+    flush();
+    return success;
+}
+
+int JsonFormatter::line() const
+{
+    return m_tokenizer->line();
+}
+
+int JsonFormatter::column() const
+{
+    return m_tokenizer->column();
+}
+
+int JsonFormatter::pos() const
+{
+    return m_tokenizer->pos();
+}
+
+////////////////////////////////////////
+
+bool JsonFormatter::formatValue()
+{
+    // Containers are kept on a stack, rather than formatted recursively, so that deeply nested input can't
+    // overflow the call stack.
+    if (!m_tokenizer->advance())
+    {
+        return false;
+    }
+    for (;;)
+    {
+        // a value, whose first token has been read
+        const Token& token = m_tokenizer->getToken();
+        if (token.type == TokenType::ARRAY_START || token.type == TokenType::OBJECT_START)
+        {
+            bool isArray = (token.type == TokenType::ARRAY_START);
+            if (!m_tokenizer->advance())
+            {
+                return false;
+            }
+            if (m_tokenizer->getToken().type == (isArray ? TokenType::ARRAY_END : TokenType::OBJECT_END))
+            {
+                m_output += isArray ? "[]" : "{}";
+            }
+            else
+            {
+                m_output += isArray ? '[' : '{';
+                m_stack.push_back(isArray);
+                writeNewline();
+                if (!isArray && !writeKey())
+                {
+                    return false;
+                }
+                continue;
+            }
+        }
+        else if (token.type == TokenType::STRING)
+        {
+            m_output += m_tokenizer->tokenText(); // as it was, escapes and all
+        }
+        else if (token.type == TokenType::NUMBER)
+        {
+            if (!isValidNumber(token.text.data(), token.text.size()))
+            {
+                return false;
+            }
+            m_output += token.text;
+        }
+        else if (token.type == TokenType::BOOLEAN)
+        {
+            m_output += token.boolean ? "true" : "false";
+        }
+        else if (token.type == TokenType::NULL_)
+        {
+            m_output += "null";
+        }
+        else
+        {
+            return false;
+        }
+
+        // after a value: the end of the containers it closes, then the next element or member
+        for (;;)
+        {
+            if (m_stack.empty())
+            {
+                return true; // without reading past the end of the value
+            }
+            if (m_output.size() >= k_outputBlockSize)
+            {
+                flush();
+            }
+            if (!m_tokenizer->advance())
+            {
+                return false;
+            }
+            TokenType type = m_tokenizer->getToken().type;
+            if (type == TokenType::COMMA)
+            {
+                m_output += ',';
+                writeNewline();
+                if (!m_tokenizer->advance() || (!m_stack.back() && !writeKey()))
+                {
+                    return false;
+                }
+                break;
+            }
+            else if (type == (m_stack.back() ? TokenType::ARRAY_END : TokenType::OBJECT_END))
+            {
+                m_stack.pop_back();
+                writeNewline();
+                m_output += (type == TokenType::ARRAY_END) ? ']' : '}';
+            }
+            else
+            {
+                return false;
+            }
+        }
+    }
+}
+
+// the key at the current token, and its colon; leaves the first token of the value read
+bool JsonFormatter::writeKey()
+{
+    if (m_tokenizer->getToken().type != TokenType::STRING)
+    {
+        return false;
+    }
+    m_output += m_tokenizer->tokenText();
+    if (!m_tokenizer->advance() || m_tokenizer->getToken().type != TokenType::COLON)
+    {
+        return false;
+    }
+    m_output += m_minify ? ":" : ": ";
+    return m_tokenizer->advance();
+}
+
+// a line break, and the indentation for the current depth
+void JsonFormatter::writeNewline()
+{
+    if (m_minify)
+    {
+        return;
+    }
+    m_output += '\n';
+    for (size_t i = 0; i < m_stack.size(); ++i)
+    {
+        m_output += m_indent;
+    }
+}
+
+void JsonFormatter::flush()
+{
+    m_stream.write(m_output.data(), m_output.size());
+    m_output.clear();
+}
+
+} // namespace Simpson
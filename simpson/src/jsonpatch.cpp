@@ -0,0 +1,465 @@
+#include "simpson/jsonvalue.h"
+#include <vector>
+#include <string>
+#include <algorithm>
+
+// see: https://datatracker.ietf.org/doc/html/rfc6902 (JSON Patch)
+// and: https://datatracker.ietf.org/doc/html/rfc6901 (JSON Pointer)
+
+namespace Simpson 
+{
+
+namespace
+{
+    // add a token to a JSON pointer, escaping ~ and /
+    std::string appendToken(const std::string& path, std::string_view token)
+    {
+        std::string result = path;
+        result.reserve(path.size() + token.size() + 1);
+        result += '/';
+        for (char c : token)
+        {
+            if (c == '~')
+            {
+                result += "~0";
+            }
+            else if (c == '/')
+            {
+                result += "~1";
+            }
+            else
+            {
+                result += c;
+            }
+        }
+        return result;
+    }
+
+    JsonValue operation(const char* op, const std::string& path)
+    {
+        JsonValue result(JsonValue::Type::Object);
+        result.set("op", op);
+        result.set("path", path);
+        return result;
+    }
+
+    JsonValue operation(const char* op, const std::string& path, const JsonValue& value)
+    {
+        JsonValue result = operation(op, path);
+        result.set("value", value);
+        return result;
+    }
+
+    // split a JSON pointer into its unescaped tokens; returns false if it's invalid
+    bool parsePointer(std::string_view pointer, std::vector<std::string>& tokens)
+    {
+        tokens.clear();
+        if (pointer.empty())
+        {
+            return true; // the whole document
+        }
+        if (pointer[0] != '/')
+        {
+            return false;
+        }
+        size_t start = 1;
+        for (;;)
+        {
+            size_t end = pointer.find('/', start);
+            if (end == std::string_view::npos)
+            {
+                end = pointer.size();
+            }
+            std::string token;
+            for (size_t i = start; i < end; ++i)
+            {
+                if (pointer[i] != '~')
+                {
+                    token += pointer[i];
+                }
+                else if (i + 1 < end && (pointer[i + 1] == '0' || pointer[i + 1] == '1'))
+                {
+                    token += (pointer[++i] == '0') ? '~' : '/';
+                }
+                else
+                {
+                    return false;
+                }
+            }
+            tokens.push_back(std::move(token));
+            if (end == pointer.size())
+            {
+                return true;
+            }
+            start = end + 1;
+        }
+    }
+
+    // parse an array index: digits, with no leading zeros; "-" is the end of the array, if allowed
+    bool parseIndex(const std::string& token, int size, bool allowEnd, int& index)
+    {
+        if (token == "-" && allowEnd)
+        {
+            index = size;
+            return true;
+        }
+        if (token.empty() || token.size() > 9 || (token[0] == '0' && token.size() > 1))
+        {
+            return false;
+        }
+        index = 0;
+        for (char c : token)
+        {
+            if (c < '0' || c > '9')
+            {
+                return false;
+            }
+            index = index*10 + (c - '0');
+        }
+        return index < size || (allowEnd && index == size);
+    }
+
+    // the value at the first count tokens of a pointer, or null if there isn't one
+    const JsonValue* find(const JsonValue& root, const std::vector<std::string>& tokens, size_t count)
+    {
+        const JsonValue* value = &root;
+        for (size_t i = 0; i < count; ++i)
+        {
+            int index;
+            if (value->isObject() && value->contains(tokens[i]))
+            {
+                value = &(*value)[tokens[i]];
+            }
+            else if (value->isArray() && parseIndex(tokens[i], value->size(), false, index))
+            {
+                value = &(*value)[index];
+            }
+            else
+            {
+                return nullptr;
+            }
+        }
+        return value;
+    }
+
+    // as above, for modifying the value, which makes private copies of the containers along the way
+    JsonValue* findMutable(JsonValue& root, const std::vector<std::string>& tokens, size_t count)
+    {
+        JsonValue* value = &root;
+        for (size_t i = 0; i < count; ++i)
+        {
+            int index;
+            if (value->isObject() && value->contains(tokens[i]))
+            {
+                value = &value->get(tokens[i]);
+            }
+            else if (value->isArray() && parseIndex(tokens[i], value->size(), false, index))
+            {
+                value = &value->get(index);
+            }
+            else
+            {
+                return nullptr;
+            }
+        }
+        return value;
+    }
+
+    bool add(JsonValue& root, const std::vector<std::string>& tokens, const JsonValue& value)
+    {
+        if (tokens.empty())
+        {
+            root = value;
+            return true;
+        }
+        JsonValue* parent = findMutable(root, tokens, tokens.size() - 1);
+        const std::string& last = tokens.back();
+        if (!parent)
+        {
+            return false;
+        }
+        else if (parent->isObject())
+        {
+            parent->set(last, value);
+            return true;
+        }
+        else if (parent->isArray())
+        {
+            int index;
+            int size = parent->size();
+            if (!parseIndex(last, size, true, index))
+            {
+                return false;
+            }
+            if (index == size)
+            {
+                parent->append(value);
+                return true;
+            }
+            // insert, moving the following elements up
+            parent->unpack();
+            parent->append(value);
+            for (int i = size; i > index; --i)
+            {
+                parent->set(i, (*parent)[i - 1]);
+            }
+            parent->set(index, value);
+            return true;
+        }
+        return false;
+    }
+
+    bool remove(JsonValue& root, const std::vector<std::string>& tokens)
+    {
+        if (tokens.empty())
+        {
+            return false; // can't remove the whole document
+        }
+        JsonValue* parent = findMutable(root, tokens, tokens.size() - 1);
+        const std::string& last = tokens.back();
+        int index;
+        if (parent && parent->isObject() && parent->contains(last))
+        {
+            parent->remove(last);
+            return true;
+        }
+        else if (parent && parent->isArray() && parseIndex(last, parent->size(), false, index))
+        {
+            parent->remove(index);
+            return true;
+        }
+        return false;
+    }
+
+    bool applyOperation(JsonValue& root, const JsonValue& operation)
+    {
+        const JsonValue& op = operation["op"];
+        const JsonValue& path = operation["path"];
+        const JsonValue& value = operation["value"];
+        const JsonValue& from = operation["from"];
+        std::vector<std::string> tokens;
+        if (!op.isString() || !path.isString() || !parsePointer(path.stringView(), tokens))
+        {
+            return false;
+        }
+
+        std::string_view name = op.stringView();
+        if (name == "add" || name == "replace" || name == "test")
+        {
+            if (!value.isValid())
+            {
+                return false;
+            }
+            if (name == "add")
+            {
+                return add(root, tokens, value);
+            }
+            else if (name == "replace")
+            {
+                JsonValue* target = findMutable(root, tokens, tokens.size());
+                if (target)
+                {
+                    *target = value;
+                }
+                return target != nullptr;
+            }
+            else
+            {
+                const JsonValue* target = find(root, tokens, tokens.size());
+                return target && *target == value;
+            }
+        }
+        else if (name == "remove")
+        {
+            return remove(root, tokens);
+        }
+        else if (name == "move" || name == "copy")
+        {
+            std::vector<std::string> fromTokens;
+            if (!from.isString() || !parsePointer(from.stringView(), fromTokens))
+            {
+                return false;
+            }
+            const JsonValue* source = find(root, fromTokens, fromTokens.size());
+            if (!source)
+            {
+                return false;
+            }
+            JsonValue moved = *source; // a copy, which shares its storage
+            if (name == "move")
+            {
+                // a value can't be moved into itself
+                if (tokens.size() > fromTokens.size() && std::equal(fromTokens.begin(), fromTokens.end(), tokens.begin()))
+                {
+                    return false;
+                }
+                if (tokens == fromTokens)
+                {
+                    return true;
+                }
+                if (!remove(root, fromTokens))
+                {
+                    return false;
+                }
+            }
+            return add(root, tokens, moved);
+        }
+        return false;
+    }
+}
+
+////////////////////////////////////////
+
+JsonValue JsonValue::diff(const JsonValue& other) const
+{
+    // compare pairs of values from a list rather than recursively, so deep values can't overflow the stack
+    JsonValue patch(Type::Array);
+    struct Pending
+    {
+        const JsonValue* a; // null to add b
+        const JsonValue* b; // null to remove a
+        std::string path;
+    };
+    std::vector<Pending> pending;
+    pending.push_back(Pending{ this, &other, std::string() });
+    while (!pending.empty())
+    {
+        Pending p = std::move(pending.back());
+        pending.pop_back();
+        if (!p.a)
+        {
+            patch.append(operation("add", p.path, *p.b));
+            continue;
+        }
+        if (!p.b)
+        {
+            patch.append(operation("remove", p.path));
+            continue;
+        }
+        const JsonValue& a = *p.a;
+        const JsonValue& b = *p.b;
+        if (a.sharesStorage(b))
+        {
+            continue;
+        }
+
+        // children are pushed in reverse, so the operations come out in the order of the document
+        size_t children = pending.size();
+        if (a.isObject() && b.isObject())
+        {
+            // the keys are sorted, so walk through both in order
+            const Object& ma = a.m_data.object->value;
+            const Object& mb = b.m_data.object->value;
+            size_t i = 0;
+            size_t j = 0;
+            while (i < ma.size() || j < mb.size())
+            {
+                if (j == mb.size() || (i < ma.size() && ma[i].key < mb[j].key))
+                {
+                    pending.push_back(Pending{ &ma[i].value, nullptr, appendToken(p.path, ma[i].key) });
+                    ++i;
+                }
+                else if (i == ma.size() || mb[j].key < ma[i].key)
+                {
+                    pending.push_back(Pending{ nullptr, &mb[j].value, appendToken(p.path, mb[j].key) });
+                    ++j;
+                }
+                else
+                {
+                    pending.push_back(Pending{ &ma[i].value, &mb[j].value, appendToken(p.path, ma[i].key) });
+                    ++i;
+                    ++j;
+                }
+            }
+        }
+        else if (a.isArray() && b.isArray())
+        {
+            const JsonValue& ca = a;
+            const JsonValue& cb = b;
+            int sizeA = ca.size();
+            int sizeB = cb.size();
+            int common = std::min(sizeA, sizeB);
+            for (int i = 0; i < common; ++i)
+            {
+                pending.push_back(Pending{ &ca[i], &cb[i], appendToken(p.path, std::to_string(i)) });
+            }
+            // remove from the end, so the indexes of the elements still to be removed don't change
+            for (int i = sizeA - 1; i >= common; --i)
+            {
+                pending.push_back(Pending{ &ca[i], nullptr, appendToken(p.path, std::to_string(i)) });
+            }
+            for (int i = common; i < sizeB; ++i)
+            {
+                pending.push_back(Pending{ nullptr, &cb[i], appendToken(p.path, std::to_string(i)) });
+            }
+        }
+        else if (a != b)
+        {
+            patch.append(operation("replace", p.path, b));
+        }
+        std::reverse(pending.begin() + children, pending.end());
+    }
+    return patch;
+}
+
+bool JsonValue::apply(const JsonValue& patch)
+{
+    if (!patch.isArray())
+    {
+        return false;
+    }
+
+    // apply the patch to a copy, which shares our storage until it's changed, so we're left unchanged
+    // if an operation fails
+    JsonValue result = *this;
+    const JsonValue& operations = patch;
+    for (int i = 0; i < operations.size(); ++i)
+    {
+        if (!operations[i].isObject() || !applyOperation(result, operations[i]))
+        {
+            return false;
+        }
+    }
+    *this = std::move(result);
+    return true;
+}
+
+// true if the values are copies of each other that share their storage (so they must be equal)
+bool JsonValue::sharesStorage(const JsonValue& other) const
+{
+    if (m_type != other.m_type)
+    {
+        return false;
+    }
+    switch (m_type)
+    {
+        case Type::Number:
+            return m_numberType == NumberType::Raw && other.m_numberType == NumberType::Raw && m_data.string == other.m_data.string;
+        case Type::String:
+            if (m_stringType != other.m_stringType)
+            {
+                return false;
+            }
+            return (m_stringType == StringType::Owned) ? m_data.string == other.m_data.string : m_data.buffer == other.m_data.buffer;
+        case Type::Array:
+            if (m_arrayType != other.m_arrayType)
+            {
+                return false;
+            }
+            switch (m_arrayType)
+            {
+                case ArrayType::Generic:
+                    return m_data.array == other.m_data.array;
+                case ArrayType::Columns:
+                    return m_data.columns == other.m_data.columns;
+                default:
+                    return m_data.packed == other.m_data.packed;
+            }
+        case Type::Object:
+            return m_data.object == other.m_data.object;
+        default:
+            return false;
+    }
+}
+
+} // namespace Simpson
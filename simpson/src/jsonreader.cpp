@@ -1,13 +1,27 @@
 #include "simpson/jsonreader.h"
 #include "simpson/src/tokenizer.h"
+#include "simpson/src/numbers.h"
 #include <iostream>
-#include <sstream>
+#include <chrono>
 
 namespace Simpson 
 {
 
+const int JsonReader::k_defaultMaxDepth;
+
 JsonReader::JsonReader(std::istream& stream) :
-    m_tokenizer(new Tokenizer(stream))
+    m_tokenizer(new Tokenizer(stream)),
+    m_resource(std::pmr::get_default_resource())
+{}
+
+JsonReader::JsonReader(const char* data, size_t size) :
+    m_tokenizer(new Tokenizer(data, size)),
+    m_resource(std::pmr::get_default_resource())
+{}
+
+JsonReader::JsonReader(char* buffer, size_t size, InSitu) :
+    m_tokenizer(new Tokenizer(buffer, size, true)),
+    m_resource(std::pmr::get_default_resource())
 {}
 
 JsonReader::~JsonReader()
@@ -17,9 +31,72 @@ JsonReader::~JsonReader()
 
 bool JsonReader::read(JsonValue& value)
 {
-    value = JsonValue(); // clear
-    m_tokenizer->advance();
-    return parseValue(value);
+#if SIMPSON_ENABLE_STATS
+    if (m_stats)
+    {
+        // collect the statistics for this value separately, so the hook can report them on their own
+        m_current.reset();
+        m_record = &m_current;
+        m_tokenizer->setStats(m_record);
+        long long start = m_tokenizer->offset();
+        auto startTime = std::chrono::steady_clock::now();
+
+        bool success = readValue(value);
+
+        m_current.addSeconds(JsonStats::Phase::Read, std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count());
+        long long end = m_tokenizer->offset();
+        if (start >= 0 && end >= start)
+        {
+            m_current.bytes = end - start;
+        }
+        m_tokenizer->setStats(nullptr);
+        m_record = nullptr;
+
+        *m_stats += m_current;
+        if (m_stats->hook())
+        {
+            m_stats->hook()->onRead(m_current, success);
+        }
+        return success;
+    }
+#endif
+    return readValue(value);
+}
+
+void JsonReader::setResource(std::pmr::memory_resource* resource)
+{
+    m_resource = resource;
+}
+
+void JsonReader::setRawNumbers(bool raw)
+{
+    m_rawNumbers = raw;
+}
+
+void JsonReader::setPackArrays(bool pack)
+{
+    m_packArrays = pack;
+}
+
+void JsonReader::setColumnarArrays(bool columnar)
+{
+    m_columnarArrays = columnar;
+}
+
+void JsonReader::setInvalidUtf8(InvalidUtf8 invalidUtf8)
+{
+    m_invalidUtf8 = invalidUtf8;
+    m_tokenizer->setInvalidUtf8(invalidUtf8);
+}
+
+void JsonReader::setMaxDepth(int depth)
+{
+    m_maxDepth = depth;
+}
+
+void JsonReader::setStats(JsonStats* stats)
+{
+    m_stats = stats;
 }
 
 int JsonReader::line() const
@@ -39,12 +116,160 @@ int JsonReader::pos() const
 
 ////////////////////////////////////////
 
+namespace
+{
+    // strings with more capacity than this have their characters on the heap
+    const size_t k_smallString = std::string().capacity();
+
+    // arrays are packed once they have this many elements, if they're all the same kind, and made columnar
+    // if they have at least this many rows; smaller ones aren't worth it
+    const int k_packedArraySize = 16;
+}
+
+bool JsonReader::readValue(JsonValue& result)
+{
+    // Containers that are being read are kept on a stack, rather than parsing them recursively, so that
+    // deeply nested input can't overflow the call stack. Each token is read when it's needed, so we stop
+    // at the end of the value, and the next value can be read from the same input.
+    result = JsonValue(); // clear
+    m_stack.clear();
+    m_tokenizer->advance();
+
+    for (;;)
+    {
+        // read a value, starting at the current token
+        JsonValue value;
+        TokenType type = m_tokenizer->getToken().type;
+        if (fail())
+        {
+            return false;
+        }
+        else if (type == TokenType::ARRAY_START || type == TokenType::OBJECT_START)
+        {
+            bool isArray = (type == TokenType::ARRAY_START);
+            if (m_maxDepth > 0 && (int) m_stack.size() >= m_maxDepth)
+            {
+                m_fail = true;
+                return false;
+            }
+            m_stack.emplace_back();
+            m_stack.back().value = JsonValue(isArray ? JsonValue::Type::Array : JsonValue::Type::Object, m_resource);
+            SIMPSON_STATS(m_record, addValue(isArray ? JsonValue::Type::Array : JsonValue::Type::Object));
+            SIMPSON_STATS(m_record, addEstimatedAllocations(1));
+            SIMPSON_STATS(m_record, enter());
+
+            m_tokenizer->advance();
+            if (m_tokenizer->getToken().type != (isArray ? TokenType::ARRAY_END : TokenType::OBJECT_END))
+            {
+                if (!isArray && !parseKey())
+                {
+                    return false;
+                }
+                continue; // read the first element
+            }
+
+            // empty
+            value = std::move(m_stack.back().value);
+            m_stack.pop_back();
+            SIMPSON_STATS(m_record, leave());
+        }
+        else if (!parseBoolean(value) && !parseNumber(value) && !parseString(value) && !parseNull(value))
+        {
+            m_fail = true;
+            return false;
+        }
+
+        // add the value to its container, and close the containers that end after it
+        for (;;)
+        {
+            if (m_stack.empty())
+            {
+                result = std::move(value);
+                return true;
+            }
+
+            Frame& frame = m_stack.back();
+            bool isArray = frame.value.isArray();
+            if (isArray)
+            {
+                if (!frame.value.appendPacked(value))
+                {
+                    frame.value.unpack(); // if it was packed, this element is a different kind
+                    JsonValue::Array& elements = frame.value.m_data.array->value;
+                    size_t capacity = elements.capacity();
+                    elements.push_back(std::move(value));
+                    if (elements.capacity() != capacity)
+                    {
+                        SIMPSON_STATS(m_record, addEstimatedAllocations(1)); // the vector grew
+                    }
+                    if (m_packArrays && frame.count + 1 == k_packedArraySize)
+                    {
+                        frame.value.pack();
+                    }
+                }
+            }
+            else
+            {
+                // members are sorted when the object ends, if they weren't in order
+                JsonValue::Object& members = frame.value.m_data.object->value;
+                std::string_view key = frame.key;
+                if (!members.empty() && !(std::string_view(members.back().key) < key))
+                {
+                    frame.sorted = false;
+                }
+                size_t capacity = members.capacity();
+                members.emplace_back(key, JsonKey::hash(key), std::move(value)); // copies the key into the object's resource
+                if (members.capacity() != capacity)
+                {
+                    SIMPSON_STATS(m_record, addEstimatedAllocations(1)); // the vector grew
+                }
+                if (key.size() > k_smallString)
+                {
+                    SIMPSON_STATS(m_record, addEstimatedAllocations(1)); // long key
+                }
+            }
+            ++frame.count;
+
+            m_tokenizer->advance();
+            TokenType next = m_tokenizer->getToken().type;
+            if (!fail() && next == TokenType::COMMA)
+            {
+                m_tokenizer->advance();
+                if (!isArray && !parseKey())
+                {
+                    return false;
+                }
+                break; // read the next element
+            }
+            else if (!fail() && next == (isArray ? TokenType::ARRAY_END : TokenType::OBJECT_END))
+            {
+                if (!frame.sorted)
+                {
+                    JsonValue::sortMembers(frame.value.m_data.object->value);
+                }
+                if (isArray && m_columnarArrays && frame.count >= k_packedArraySize)
+                {
+                    frame.value.toColumns();
+                }
+                value = std::move(frame.value);
+                m_stack.pop_back();
+                SIMPSON_STATS(m_record, leave());
+            }
+            else
+            {
+                m_fail = true;
+                return false;
+            }
+        }
+    }
+}
+
 bool JsonReader::parseBoolean(JsonValue& value)
 {
     if (m_tokenizer->getToken().type == TokenType::BOOLEAN)
     {
-        value = m_tokenizer->getToken().value == "true" ? true : false;
-        m_tokenizer->advance();
+        value = m_tokenizer->getToken().boolean;
+        SIMPSON_STATS(m_record, addValue(JsonValue::Type::Boolean));
         return true;
     }
     else
@@ -55,38 +280,27 @@ bool JsonReader::parseBoolean(JsonValue& value)
 
 bool JsonReader::parseNumber(JsonValue& value)
 {
-    if (!fail() && m_tokenizer->getToken().type == TokenType::NUMBER)
+    if (m_tokenizer->getToken().type == TokenType::NUMBER)
     {
         // TODO optionally handle NaN/Infinity/-Infinity?
         //  note that C printf standard is nan/inf/-inf, or NAN/INF/-INF, while the Java standard is 
         //  NaN/Infinity/-Infinity, and other languages are probably different.
-        std::istringstream stream(m_tokenizer->getToken().value);
-        double d;
-        stream >> d;
-        if (!stream || !stream.eof())
+        std::string_view text = m_tokenizer->getToken().text;
+        if (m_rawNumbers)
         {
-            m_fail = true;
-            return false;
+            if (!isValidNumber(text.data(), text.size()))
+            {
+                return false;
+            }
+            value = JsonValue::rawNumber(text, m_resource);
+            SIMPSON_STATS(m_record, addEstimatedAllocations(value.m_data.string->value.capacity() > k_smallString ? 2 : 1)); // shared node, and text
         }
-        else
+        else if (!Simpson::parseNumber(text.data(), text.size(), value))
         {
-            value = d;
-            m_tokenizer->advance();
-            return true;
+            return false;
         }
-    }
-    else
-    {
-        return false;
-    }
-}
 
-bool JsonReader::parseString(JsonValue& value)
-{
-    std::string str;
-    if (parseString(str))
-    {
-        value = str;
+        SIMPSON_STATS(m_record, addValue(JsonValue::Type::Number));
         return true;
     }
     else
@@ -95,12 +309,24 @@ bool JsonReader::parseString(JsonValue& value)
     }
 }
 
-bool JsonReader::parseString(std::string& value)
+bool JsonReader::parseString(JsonValue& value)
 {
-    if (!fail() && m_tokenizer->getToken().type == TokenType::STRING)
+    if (m_tokenizer->getToken().type == TokenType::STRING)
     {
-        value = m_tokenizer->getToken().value;
-        m_tokenizer->advance();
+        std::string_view text = m_tokenizer->getToken().text;
+        if (m_tokenizer->inPlace())
+        {
+            // refer to the string in the buffer
+            value = JsonValue::bufferString(text, m_resource);
+            SIMPSON_STATS(m_record, addEstimatedAllocations(1));
+        }
+        else
+        {
+            value = JsonValue(text, m_resource);
+            SIMPSON_STATS(m_record, addEstimatedAllocations(value.m_data.string->value.capacity() > k_smallString ? 2 : 1)); // shared node, and contents
+        }
+        SIMPSON_STATS(m_record, addValue(JsonValue::Type::String));
+        SIMPSON_STATS(m_record, addString(text.size()));
         return true;
     }
     else
@@ -111,10 +337,10 @@ bool JsonReader::parseString(std::string& value)
 
 bool JsonReader::parseNull(JsonValue& value)
 {
-    if (!fail() && m_tokenizer->getToken().type == TokenType::NULL_)
+    if (m_tokenizer->getToken().type == TokenType::NULL_)
     {
         value = JsonValue(nullptr);
-        m_tokenizer->advance();
+        SIMPSON_STATS(m_record, addValue(JsonValue::Type::Null));
         return true;
     }
     else
@@ -123,106 +349,32 @@ bool JsonReader::parseNull(JsonValue& value)
     }
 }
 
-bool JsonReader::parseObject(JsonValue& value)
+// read an object key and the colon after it, leaving the tokenizer at the start of the value
+bool JsonReader::parseKey()
 {
-    if (!fail() && m_tokenizer->getToken().type == TokenType::OBJECT_START)
-    {
-        int count = 0;
-        m_tokenizer->advance();
-        value = JsonValue(JsonValue::Type::Object);
-        while (!fail() && m_tokenizer->getToken().type != TokenType::OBJECT_END)
-        {
-            if (count > 0)
-            {
-                if (m_tokenizer->getToken().type != TokenType::COMMA)
-                {
-                    m_fail = true;
-                    return false;
-                }
-                m_tokenizer->advance();
-            }
-
-            std::string key;
-            JsonValue newValue;
-
-            if (!parseString(key))
-            {
-                m_fail = true;
-                return false;
-            }
-            if (m_tokenizer->getToken().type != TokenType::COLON)
-            {
-                m_fail = true;
-                return false;
-            }
-            m_tokenizer->advance();
-            if (parseValue(newValue))
-            {
-                value.set(key, newValue);
-            }
-            else
-            {
-                m_fail = true;
-                return false;
-            }
-            ++count;
-        }
-        m_tokenizer->advance();
-        return true;
-    }
-    else
+    const Token& token = m_tokenizer->getToken();
+    if (fail() || token.type != TokenType::STRING)
     {
+        m_fail = true;
         return false;
     }
-}
-
-bool JsonReader::parseArray(JsonValue& value)
-{
-    if (!fail() && m_tokenizer->getToken().type == TokenType::ARRAY_START)
+    std::string& key = m_stack.back().key;
+    size_t capacity = key.capacity();
+    key.assign(token.text.data(), token.text.size());
+    if (key.capacity() != capacity)
     {
-        int count = 0;
-        m_tokenizer->advance();
-        value = JsonValue(JsonValue::Type::Array);
-        while (m_tokenizer->getToken().type != TokenType::ARRAY_END)
-        {
-            if (count > 0)
-            {
-                if (m_tokenizer->getToken().type != TokenType::COMMA)
-                {
-                    m_fail = true;
-                    return false;
-                }
-                m_tokenizer->advance();
-            }
-            JsonValue newValue;
-            if (parseValue(newValue))
-            {
-                value.append(newValue);
-            }
-            else
-            {
-                m_fail = true;
-                return false;
-            }
-            ++count;
-        }
-        m_tokenizer->advance();
-        return true;
+        SIMPSON_STATS(m_record, addEstimatedAllocations(1)); // the key buffer grew
     }
-    else
+    SIMPSON_STATS(m_record, addString(token.text.size()));
+
+    m_tokenizer->advance();
+    if (fail() || m_tokenizer->getToken().type != TokenType::COLON)
     {
+        m_fail = true;
         return false;
     }
-}
-
-bool JsonReader::parseValue(JsonValue& value)
-{
-    return parseBoolean(value) ||
-           parseNumber(value) ||
-           parseString(value) ||
-           parseNull(value) ||
-           parseArray(value) ||
-           parseObject(value);
+    m_tokenizer->advance();
+    return true;
 }
 
 bool JsonReader::fail() const
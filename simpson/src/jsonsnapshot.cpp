@@ -0,0 +1,822 @@
+#include "simpson/jsonsnapshot.h"
+#include <cstring>
+#include <deque>
+#include <unordered_map>
+#include <algorithm>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Snapshot layout; all integers are little-endian, and all offsets are from the start of the snapshot
+// unless noted otherwise.
+//
+//   header:        "SJSN", uint32 version, uint32 string table offset, uint32 string table size, root slot
+//   slot:          uint32 tag, followed by 8 bytes that depend on the tag:
+//                    Boolean: uint32 0 or 1
+//                    Number: double, int64 or uint64 (integers that fit in an int64 are always stored as int64)
+//                    String: uint32 offset in string table, uint32 length
+//                    Array, Object: uint32 offset of block, uint32 count
+//   array block:   count slots
+//   object block:  count keys (uint32 offset in string table, uint32 length) sorted by key, then count slots
+//   string table:  strings, each followed by a null; each distinct string is stored once
+
+namespace Simpson 
+{
+
+namespace
+{
+    const char k_magic[4] = { 'S', 'J', 'S', 'N' };
+    const uint32_t k_version = 1;
+    const size_t k_headerSize = 16;
+    const size_t k_slotSize = 12;
+    const size_t k_keySize = 8;
+
+    enum Tag
+    {
+        k_null = 0,
+        k_boolean = 1,
+        k_number = 2,
+        k_string = 3,
+        k_array = 4,
+        k_object = 5,
+        k_int64 = 6,
+        k_uint64 = 7,
+    };
+
+    uint32_t read32(const uint8_t* p)
+    {
+        return (uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+    }
+
+    uint64_t read64(const uint8_t* p)
+    {
+        return (uint64_t) read32(p) | ((uint64_t) read32(p + 4) << 32);
+    }
+
+    void write32(uint8_t* p, uint32_t value)
+    {
+        p[0] = (uint8_t) value;
+        p[1] = (uint8_t) (value >> 8);
+        p[2] = (uint8_t) (value >> 16);
+        p[3] = (uint8_t) (value >> 24);
+    }
+
+    void write64(uint8_t* p, uint64_t value)
+    {
+        write32(p, (uint32_t) value);
+        write32(p + 4, (uint32_t) (value >> 32));
+    }
+
+    uint32_t checkOffset(size_t offset)
+    {
+        if (offset > 0xffffffff)
+        {
+            throw std::runtime_error("snapshot too large"); 
+        }
+        return (uint32_t) offset;
+    }
+
+    [[ noreturn ]] void throwCorrupt()
+    {
+        throw std::runtime_error("corrupt snapshot"); 
+    }
+
+}
+
+////////////////////////////////////////
+
+// Builds a snapshot of a value. It's part of JsonSnapshot so that it can read packed and columnar arrays
+// directly, without making JsonValues for their elements.
+class JsonSnapshot::Builder
+{
+public:
+    Builder(std::vector<uint8_t>& out) : m_out(out) {}
+
+    void build(const JsonValue& root)
+    {
+        m_out.resize(k_headerSize + k_slotSize);
+        memcpy(&m_out[0], k_magic, sizeof(k_magic));
+        write32(&m_out[4], k_version);
+
+        // breadth-first, so values are written in the order their slots were allocated
+        m_pending.push_back(Pending { &root, -1, k_headerSize });
+        while (!m_pending.empty())
+        {
+            Pending pending = m_pending.front();
+            m_pending.pop_front();
+            if (pending.row >= 0)
+            {
+                writeRow(*pending.value, pending.row, pending.slot);
+            }
+            else
+            {
+                writeSlot(*pending.value, pending.slot);
+            }
+        }
+
+        write32(&m_out[8], checkOffset(m_out.size()));
+        write32(&m_out[12], checkOffset(m_strings.size()));
+        m_out.insert(m_out.end(), m_strings.begin(), m_strings.end());
+    }
+
+private:
+    struct Pending
+    {
+        const JsonValue* value;
+        int row; // if not negative, this row of a columnar array, written as an object
+        size_t slot;
+    };
+
+    std::vector<uint8_t>& m_out;
+    std::string m_strings;
+    std::unordered_map<std::string, uint32_t> m_stringOffsets;
+    std::deque<Pending> m_pending;
+
+    uint32_t addString(const std::string& s)
+    {
+        auto it = m_stringOffsets.find(s);
+        if (it != m_stringOffsets.end())
+        {
+            return it->second;
+        }
+        uint32_t offset = checkOffset(m_strings.size());
+        m_strings.append(s);
+        m_strings += '\0';
+        m_stringOffsets[s] = offset;
+        return offset;
+    }
+
+    size_t allocate(size_t size)
+    {
+        size_t offset = m_out.size();
+        m_out.resize(offset + size);
+        return offset;
+    }
+
+    // write the slot of an array or object with its block, and return the block
+    size_t writeContainer(size_t slot, Tag tag, size_t count, size_t blockSize)
+    {
+        size_t block = allocate(blockSize);
+        write32(&m_out[slot], tag);
+        write32(&m_out[slot + 4], checkOffset(block));
+        write32(&m_out[slot + 8], (uint32_t) count);
+        return block;
+    }
+
+    // write the key of member i of an object's block, and return the slot for its value
+    size_t writeKey(size_t block, size_t count, size_t i, std::string_view key)
+    {
+        uint32_t offset = addString(std::string(key));
+        write32(&m_out[block + i*k_keySize], offset);
+        write32(&m_out[block + i*k_keySize + 4], checkOffset(key.size()));
+        return block + count*k_keySize + i*k_slotSize;
+    }
+
+    void writeSlot(const JsonValue& value, size_t slot)
+    {
+        // note that m_out may be reallocated by allocate(), so don't hold on to pointers into it
+        switch (value.type())
+        {
+            case JsonValue::Type::Boolean:
+                write32(&m_out[slot], k_boolean);
+                write32(&m_out[slot + 4], value.boolean() ? 1 : 0);
+                break;
+
+            case JsonValue::Type::Number:
+                if (value.isInteger())
+                {
+                    bool negative = value.number() < 0;
+                    write32(&m_out[slot], negative || value.uint64() <= (uint64_t) INT64_MAX ? k_int64 : k_uint64);
+                    write64(&m_out[slot + 4], negative ? (uint64_t) value.int64() : value.uint64());
+                }
+                else
+                {
+                    double d = value.number();
+                    uint64_t bits;
+                    memcpy(&bits, &d, sizeof(bits));
+                    write32(&m_out[slot], k_number);
+                    write64(&m_out[slot + 4], bits);
+                }
+                break;
+
+            case JsonValue::Type::String:
+            {
+                std::string s(value.stringView());
+                uint32_t offset = addString(s);
+                write32(&m_out[slot], k_string);
+                write32(&m_out[slot + 4], offset);
+                write32(&m_out[slot + 8], checkOffset(s.size()));
+                break;
+            }
+
+            case JsonValue::Type::Null:
+            case JsonValue::Type::Invalid:
+                write32(&m_out[slot], k_null);
+                break;
+
+            case JsonValue::Type::Array:
+            {
+                size_t count = value.size();
+                size_t block = writeContainer(slot, k_array, count, count * k_slotSize);
+                for (size_t i = 0; i < count; ++i)
+                {
+                    size_t elementSlot = block + i*k_slotSize;
+                    if (value.isColumnar())
+                    {
+                        m_pending.push_back(Pending { &value, (int) i, elementSlot });
+                    }
+                    else if (value.isPacked())
+                    {
+                        writeSlot(value.packedElement((int) i), elementSlot); // a scalar, so it's written now
+                    }
+                    else
+                    {
+                        m_pending.push_back(Pending { &value.m_data.array->value[i], -1, elementSlot });
+                    }
+                }
+                break;
+            }
+
+            case JsonValue::Type::Object:
+            {
+                const JsonValue::Object& members = value.m_data.object->value; // sorted by key
+                size_t count = members.size();
+                size_t block = writeContainer(slot, k_object, count, count * (k_keySize + k_slotSize));
+                for (size_t i = 0; i < count; ++i)
+                {
+                    size_t memberSlot = writeKey(block, count, i, members[i].key);
+                    m_pending.push_back(Pending { &members[i].value, -1, memberSlot });
+                }
+                break;
+            }
+        }
+    }
+
+    // a row of a columnar array, as an object with the row's value in each column
+    void writeRow(const JsonValue& array, int row, size_t slot)
+    {
+        const JsonValue::Object& columns = array.m_data.columns->value.columns.m_data.object->value; // sorted by key
+        size_t count = columns.size();
+        size_t block = writeContainer(slot, k_object, count, count * (k_keySize + k_slotSize));
+        for (size_t i = 0; i < count; ++i)
+        {
+            const JsonValue& column = columns[i].value;
+            size_t memberSlot = writeKey(block, count, i, columns[i].key);
+            if (column.isPacked())
+            {
+                writeSlot(column.packedElement(row), memberSlot);
+            }
+            else
+            {
+                m_pending.push_back(Pending { &column.m_data.array->value[row], -1, memberSlot });
+            }
+        }
+    }
+};
+
+////////////////////////////////////////
+
+JsonSnapshot::JsonSnapshot()
+{
+}
+
+JsonSnapshot::JsonSnapshot(const void* data, size_t size) :
+    m_data((const uint8_t*) data),
+    m_size(size)
+{
+}
+
+JsonSnapshot::~JsonSnapshot()
+{
+    close();
+}
+
+bool JsonSnapshot::open(const std::string& path)
+{
+    close();
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+    {
+        CloseHandle(file);
+        return false;
+    }
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if (!mapping)
+    {
+        return false;
+    }
+    void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if (!data)
+    {
+        return false;
+    }
+    m_size = (size_t) size.QuadPart;
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        ::close(fd);
+        return false;
+    }
+    void* data = mmap(nullptr, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED)
+    {
+        return false;
+    }
+    m_size = (size_t) st.st_size;
+#endif
+
+    m_mapping = data;
+    m_data = (const uint8_t*) data;
+    return isValid();
+}
+
+void JsonSnapshot::close()
+{
+    if (m_mapping)
+    {
+#ifdef _WIN32
+        UnmapViewOfFile(m_mapping);
+#else
+        munmap(m_mapping, m_size);
+#endif
+        m_mapping = nullptr;
+    }
+    m_data = nullptr;
+    m_size = 0;
+}
+
+bool JsonSnapshot::isValid() const
+{
+    if (!m_data || m_size < k_headerSize + k_slotSize || memcmp(m_data, k_magic, sizeof(k_magic)) != 0 || read32(m_data + 4) != k_version)
+    {
+        return false;
+    }
+    uint64_t stringTableEnd = (uint64_t) read32(m_data + 8) + read32(m_data + 12);
+    return stringTableEnd <= m_size;
+}
+
+JsonSnapshotValue JsonSnapshot::root() const
+{
+    if (isValid())
+    {
+        return JsonSnapshotValue(m_data, m_size, m_data + k_headerSize);
+    }
+    else
+    {
+        return JsonSnapshotValue();
+    }
+}
+
+void JsonSnapshot::write(const JsonValue& value, std::ostream& stream)
+{
+    std::vector<uint8_t> buffer;
+    write(value, buffer);
+    stream.write((const char*) buffer.data(), buffer.size());
+}
+
+void JsonSnapshot::write(const JsonValue& value, std::vector<uint8_t>& buffer)
+{
+    std::vector<uint8_t> out;
+    Builder(out).build(value);
+    if (buffer.empty())
+    {
+        buffer.swap(out);
+    }
+    else
+    {
+        buffer.insert(buffer.end(), out.begin(), out.end());
+    }
+}
+
+////////////////////////////////////////
+
+JsonSnapshotValue::JsonSnapshotValue()
+{
+}
+
+JsonSnapshotValue::JsonSnapshotValue(const uint8_t* data, size_t size, const uint8_t* slot) :
+    m_data(data),
+    m_size(size),
+    m_slot(slot)
+{
+}
+
+JsonValue::Type JsonSnapshotValue::type() const
+{
+    if (!m_slot)
+    {
+        return JsonValue::Type::Invalid;
+    }
+
+    switch (read32(m_slot))
+    {
+        case k_null:
+            return JsonValue::Type::Null;
+        case k_boolean:
+            return JsonValue::Type::Boolean;
+        case k_number:
+        case k_int64:
+        case k_uint64:
+            return JsonValue::Type::Number;
+        case k_string:
+            return JsonValue::Type::String;
+        case k_array:
+            return JsonValue::Type::Array;
+        case k_object:
+            return JsonValue::Type::Object;
+        default:
+            throwCorrupt();
+    }
+}
+
+bool JsonSnapshotValue::boolean() const
+{
+    assertType(JsonValue::Type::Boolean);
+    return read32(m_slot + 4) != 0;
+}
+
+bool JsonSnapshotValue::isInteger() const
+{
+    return m_slot && (read32(m_slot) == k_int64 || read32(m_slot) == k_uint64);
+}
+
+double JsonSnapshotValue::number() const
+{
+    return numberValue().number();
+}
+
+int64_t JsonSnapshotValue::int64() const
+{
+    return numberValue().int64();
+}
+
+uint64_t JsonSnapshotValue::uint64() const
+{
+    return numberValue().uint64();
+}
+
+const char* JsonSnapshotValue::string() const
+{
+    assertType(JsonValue::Type::String);
+    return text(read32(m_slot + 4), read32(m_slot + 8));
+}
+
+int JsonSnapshotValue::stringLength() const
+{
+    assertType(JsonValue::Type::String);
+    return (int) read32(m_slot + 8);
+}
+
+int JsonSnapshotValue::size() const
+{
+    JsonValue::Type t = type();
+    if (t != JsonValue::Type::Array && t != JsonValue::Type::Object)
+    {
+        throwTypeError();
+    }
+    return (int) read32(m_slot + 8);
+}
+
+JsonSnapshotValue JsonSnapshotValue::get(int index) const
+{
+    assertType(JsonValue::Type::Array);
+    if (index < 0 || index >= size())
+    {
+        throw std::runtime_error("index out of range"); 
+    }
+    return child(read32(m_slot + 4) + index*k_slotSize);
+}
+
+JsonSnapshotValue JsonSnapshotValue::operator[](int index) const
+{
+    if (isInvalid())
+    {
+        return JsonSnapshotValue();
+    }
+    assertType(JsonValue::Type::Array);
+    if (index < 0 || index >= size())
+    {
+        return JsonSnapshotValue();
+    }
+    return child(read32(m_slot + 4) + index*k_slotSize);
+}
+
+JsonSnapshotValue JsonSnapshotValue::get(std::string_view key) const
+{
+    return get(key.data(), key.size());
+}
+
+JsonSnapshotValue JsonSnapshotValue::operator[](std::string_view key) const
+{
+    return isInvalid() ? JsonSnapshotValue() : lookup(key.data(), key.size());
+}
+
+bool JsonSnapshotValue::contains(std::string_view key) const
+{
+    assertType(JsonValue::Type::Object);
+    return find(key.data(), key.size()) >= 0;
+}
+
+JsonSnapshotValue JsonSnapshotValue::get(const JsonKey& key) const
+{
+    assertType(JsonValue::Type::Object);
+    int index = find(key);
+    if (index < 0)
+    {
+        throw std::runtime_error("key does not exist"); 
+    }
+    return member(index);
+}
+
+JsonSnapshotValue JsonSnapshotValue::operator[](const JsonKey& key) const
+{
+    if (isInvalid())
+    {
+        return JsonSnapshotValue();
+    }
+    assertType(JsonValue::Type::Object);
+    int index = find(key);
+    return index < 0 ? JsonSnapshotValue() : member(index);
+}
+
+const char* JsonSnapshotValue::key(int index) const
+{
+    const uint8_t* entry = keyEntry(index);
+    return text(read32(entry), read32(entry + 4));
+}
+
+int JsonSnapshotValue::keyLength(int index) const
+{
+    return (int) read32(keyEntry(index) + 4);
+}
+
+JsonValue JsonSnapshotValue::toValue() const
+{
+    // Arrays and objects being copied are kept on a stack, rather than copying them recursively, so that
+    // a deeply nested snapshot can't overflow the call stack.
+    struct Frame
+    {
+        JsonSnapshotValue source;
+        JsonValue value;
+        int index; // of the next element or member
+    };
+    std::vector<Frame> stack;
+
+    JsonSnapshotValue next = *this;
+    for (;;)
+    {
+        JsonValue value = next.shallowValue();
+        if ((value.isArray() || value.isObject()) && next.size() > 0)
+        {
+            // blocks always come after the slots that refer to them, so corrupt data can't make a cycle
+            if (read32(next.m_slot + 4) <= (uint64_t) (next.m_slot - m_data))
+            {
+                throwCorrupt();
+            }
+            stack.push_back(Frame{ next, std::move(value), 0 });
+        }
+        else
+        {
+            // add the value to its container, and close the containers that end after it
+            for (;;)
+            {
+                if (stack.empty())
+                {
+                    return value;
+                }
+                Frame& frame = stack.back();
+                if (frame.value.isArray())
+                {
+                    frame.value.append(value);
+                }
+                else
+                {
+                    frame.value.set(std::string(frame.source.key(frame.index), frame.source.keyLength(frame.index)), value);
+                }
+                if (++frame.index < frame.source.size())
+                {
+                    break;
+                }
+                value = std::move(frame.value);
+                stack.pop_back();
+            }
+        }
+
+        const Frame& frame = stack.back();
+        next = frame.value.isArray() ? frame.source.get(frame.index) : frame.source.member(frame.index);
+    }
+}
+
+// a copy of a primitive value, or an empty array or object
+JsonValue JsonSnapshotValue::shallowValue() const
+{
+    switch (type())
+    {
+        case JsonValue::Type::Boolean:
+            return JsonValue(boolean());
+
+        case JsonValue::Type::Number:
+            return numberValue();
+
+        case JsonValue::Type::String:
+            return JsonValue(std::string(string(), stringLength()));
+
+        case JsonValue::Type::Null:
+            return JsonValue(nullptr);
+
+        case JsonValue::Type::Array:
+        {
+            JsonValue value(JsonValue::Type::Array);
+            value.reserve(size());
+            return value;
+        }
+
+        case JsonValue::Type::Object:
+            return JsonValue(JsonValue::Type::Object);
+
+        case JsonValue::Type::Invalid:
+            break;
+    }
+    return JsonValue();
+}
+
+////////////////////////////////////////
+
+JsonSnapshotValue JsonSnapshotValue::get(const char* key, size_t length) const
+{
+    assertType(JsonValue::Type::Object);
+    int index = find(key, length);
+    if (index < 0)
+    {
+        throw std::runtime_error("key does not exist"); 
+    }
+    return member(index);
+}
+
+JsonSnapshotValue JsonSnapshotValue::lookup(const char* key, size_t length) const
+{
+    assertType(JsonValue::Type::Object);
+    int index = find(key, length);
+    return index < 0 ? JsonSnapshotValue() : member(index);
+}
+
+// as JsonValue does, try where the key was last found before searching
+int JsonSnapshotValue::find(const JsonKey& key) const
+{
+    uint32_t slot = key.m_slot.load(std::memory_order_relaxed);
+    if (slot < (uint32_t) size())
+    {
+        const uint8_t* entry = keyEntry((int) slot);
+        uint32_t length = read32(entry + 4);
+        if (length == key.size() && memcmp(text(read32(entry), length), key.m_key.data(), length) == 0)
+        {
+            return (int) slot;
+        }
+    }
+
+    int index = find(key.m_key.data(), key.size());
+    if (index >= 0)
+    {
+        key.m_slot.store((uint32_t) index, std::memory_order_relaxed);
+    }
+    return index;
+}
+
+int JsonSnapshotValue::find(const char* key, size_t length) const
+{
+    // binary search of sorted keys; same ordering as std::string comparison
+    uint32_t block = read32(m_slot + 4);
+    int count = size();
+    if ((uint64_t) block + (uint64_t) count*(k_keySize + k_slotSize) > m_size)
+    {
+        throwCorrupt();
+    }
+
+    int lo = 0;
+    int hi = count;
+    while (lo < hi)
+    {
+        int mid = lo + (hi - lo)/2;
+        const uint8_t* entry = m_data + block + mid*k_keySize;
+        uint32_t entryLength = read32(entry + 4);
+        const char* entryText = text(read32(entry), entryLength);
+
+        int cmp = memcmp(entryText, key, std::min((size_t) entryLength, length));
+        if (cmp == 0)
+        {
+            cmp = entryLength < length ? -1 : (entryLength > length ? 1 : 0);
+        }
+
+        if (cmp == 0)
+        {
+            return mid;
+        }
+        else if (cmp < 0)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    return -1;
+}
+
+const uint8_t* JsonSnapshotValue::keyEntry(int index) const
+{
+    assertType(JsonValue::Type::Object);
+    if (index < 0 || index >= size())
+    {
+        throw std::runtime_error("index out of range"); 
+    }
+    uint64_t offset = (uint64_t) read32(m_slot + 4) + index*k_keySize;
+    if (offset + k_keySize > m_size)
+    {
+        throwCorrupt();
+    }
+    return m_data + offset;
+}
+
+JsonSnapshotValue JsonSnapshotValue::member(int index) const
+{
+    return child(read32(m_slot + 4) + size()*k_keySize + index*k_slotSize);
+}
+
+JsonSnapshotValue JsonSnapshotValue::child(uint64_t offset) const
+{
+    if (offset + k_slotSize > m_size)
+    {
+        throwCorrupt();
+    }
+    return JsonSnapshotValue(m_data, m_size, m_data + offset);
+}
+
+const char* JsonSnapshotValue::text(uint32_t offset, uint32_t length) const
+{
+    uint64_t start = (uint64_t) read32(m_data + 8) + offset;
+    if (start + length >= m_size)
+    {
+        throwCorrupt();
+    }
+    return (const char*) m_data + start;
+}
+
+JsonValue JsonSnapshotValue::numberValue() const
+{
+    assertType(JsonValue::Type::Number);
+    uint64_t bits = read64(m_slot + 4);
+    switch (read32(m_slot))
+    {
+        case k_int64:
+            return JsonValue((long long) bits);
+
+        case k_uint64:
+            return JsonValue((unsigned long long) bits);
+
+        default:
+        {
+            double d;
+            memcpy(&d, &bits, sizeof(d));
+            return JsonValue(d);
+        }
+    }
+}
+
+void JsonSnapshotValue::throwTypeError() const
+{
+    throw std::runtime_error("incorrect JSON type"); 
+}
+
+void JsonSnapshotValue::assertType(JsonValue::Type type) const
+{
+    if (this->type() != type) 
+    { 
+        throwTypeError();
+    }
+}
+
+} // namespace Simpson
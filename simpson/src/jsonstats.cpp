@@ -0,0 +1,42 @@
+#include "simpson/jsonstats.h"
+
+namespace Simpson
+{
+
+void JsonStats::reset()
+{
+    bytes = 0;
+    maxDepth = 0;
+    stringBytes = 0;
+    estimatedAllocations = 0;
+    for (uint64_t& n : m_tokens) { n = 0; }
+    for (uint64_t& n : m_values) { n = 0; }
+    for (double& s : m_seconds) { s = 0; }
+    m_depth = 0;
+}
+
+JsonStats& JsonStats::operator+=(const JsonStats& other)
+{
+    bytes += other.bytes;
+    if (other.maxDepth > maxDepth)
+    {
+        maxDepth = other.maxDepth;
+    }
+    stringBytes += other.stringBytes;
+    estimatedAllocations += other.estimatedAllocations;
+    for (int i = 0; i < (int) TokenType::COUNT; ++i)
+    {
+        m_tokens[i] += other.m_tokens[i];
+    }
+    for (int i = 0; i <= (int) JsonValue::Type::Invalid; ++i)
+    {
+        m_values[i] += other.m_values[i];
+    }
+    for (int i = 0; i < (int) Phase::COUNT; ++i)
+    {
+        m_seconds[i] += other.m_seconds[i];
+    }
+    return *this;
+}
+
+} // namespace Simpson
@@ -0,0 +1,118 @@
+#include "simpson/jsonreader.h"
+#include "simpson/src/tokenizer.h"
+#include "simpson/src/numbers.h"
+#include <vector>
+
+// see: https://www.json.org/json-en.html
+
+namespace Simpson
+{
+
+namespace
+{
+    // a key at the current token, and its colon; leaves the first token of the value read
+    bool checkKey(Tokenizer& tokenizer)
+    {
+        if (tokenizer.getToken().type != TokenType::STRING)
+        {
+            return false;
+        }
+        return tokenizer.advance() && tokenizer.getToken().type == TokenType::COLON && tokenizer.advance();
+    }
+
+    // Check the syntax of a document, token by token. The tokenizer checks the tokens themselves, without
+    // unescaping strings, and this checks how they fit together; nothing is converted or stored except
+    // the kind of each open container.
+    bool check(Tokenizer& tokenizer)
+    {
+        // containers are kept on a stack rather than checked recursively, so deep documents can't overflow the stack
+        std::vector<bool> stack; // for each open container, true for an array, false for an object
+        if (!tokenizer.advance())
+        {
+            return false;
+        }
+        for (;;)
+        {
+            // a value, whose first token has been read
+            const Token& token = tokenizer.getToken();
+            if (token.type == TokenType::ARRAY_START || token.type == TokenType::OBJECT_START)
+            {
+                bool isArray = (token.type == TokenType::ARRAY_START);
+                if (!tokenizer.advance())
+                {
+                    return false;
+                }
+                if (tokenizer.getToken().type != (isArray ? TokenType::ARRAY_END : TokenType::OBJECT_END))
+                {
+                    stack.push_back(isArray);
+                    if (!isArray && !checkKey(tokenizer))
+                    {
+                        return false;
+                    }
+                    continue;
+                }
+            }
+            else if (token.type == TokenType::NUMBER)
+            {
+                if (!isValidNumber(token.text.data(), token.text.size()))
+                {
+                    return false;
+                }
+            }
+            else if (token.type != TokenType::STRING && token.type != TokenType::BOOLEAN && token.type != TokenType::NULL_)
+            {
+                return false;
+            }
+
+            // after a value: the end of the containers it closes, then the next element or member
+            for (;;)
+            {
+                bool more = tokenizer.advance();
+                if (stack.empty())
+                {
+                    return !more && !tokenizer.fail(); // nothing but whitespace after the value
+                }
+                if (!more)
+                {
+                    return false;
+                }
+                TokenType type = tokenizer.getToken().type;
+                if (type == TokenType::COMMA)
+                {
+                    if (!tokenizer.advance() || (!stack.back() && !checkKey(tokenizer)))
+                    {
+                        return false;
+                    }
+                    break;
+                }
+                else if (type == (stack.back() ? TokenType::ARRAY_END : TokenType::OBJECT_END))
+                {
+                    stack.pop_back();
+                }
+                else
+                {
+                    return false;
+                }
+            }
+        }
+    }
+}
+
+////////////////////////////////////////
+
+bool validate(const char* data, size_t size, size_t* errorOffset)
+{
+    Tokenizer tokenizer(data, size);
+    tokenizer.setCheckOnly(true);
+    if (check(tokenizer))
+    {
+        return true;
+    }
+    if (errorOffset)
+    {
+        *errorOffset = (size_t) tokenizer.errorOffset();
+    }
+    return false;
+}
+
+} // namespace Simpson
@@ -1,6 +1,9 @@
 #include "simpson/jsonvalue.h"
 #include "simpson/jsonreader.h"
 #include "simpson/jsonwriter.h"
+#include "simpson/src/numbers.h"
+#include <cstring>
+#include <algorithm>
 
 namespace Simpson 
 {
@@ -8,9 +11,145 @@ namespace Simpson
 namespace
 {
     JsonValue k_invalid = JsonValue();
+
+    // Set in the reference count of an array or object that a non-const accessor has given out a reference
+    // into: the reference could be used to change it later, so it can't be shared, and copies copy it instead.
+    const int k_unshareable = 1 << 30;
+
+    template <typename Node>
+    int references(const Node* node)
+    {
+        return node->refCount.load(std::memory_order_acquire) & ~k_unshareable;
+    }
+
+    // nodes are allocated from their memory resource, and remember it so they can be freed
+    template <typename Node, typename... Args>
+    Node* newNode(std::pmr::memory_resource* resource, Args&&... args)
+    {
+        void* p = resource->allocate(sizeof(Node), alignof(Node));
+        try
+        {
+            return new (p) Node(resource, std::forward<Args>(args)...);
+        }
+        catch (...)
+        {
+            resource->deallocate(p, sizeof(Node), alignof(Node));
+            throw;
+        }
+    }
+
+    template <typename Node>
+    void releaseNode(Node* node)
+    {
+        if ((node->refCount.fetch_sub(1, std::memory_order_acq_rel) & ~k_unshareable) == 1)
+        {
+            std::pmr::memory_resource* resource = node->resource;
+            node->~Node();
+            resource->deallocate(node, sizeof(Node), alignof(Node));
+        }
+    }
+
+    // copy node contents, with containers using the same resource as the original
+    template <typename T>
+    T copyContents(const T& value, std::pmr::memory_resource* resource)
+    {
+        return T(value, resource);
+    }
+
+    // free the JsonValues made for the const accessors of a packed array, since it's changing
+    template <typename Packed>
+    void dropElements(Packed& packed)
+    {
+        if (auto* elements = packed.elements.exchange(nullptr, std::memory_order_acq_rel))
+        {
+            releaseNode(elements);
+        }
+    }
+
+    // make a private copy of a node if it's shared
+    template <typename Node>
+    void detachNode(Node*& node)
+    {
+        if (references(node) > 1)
+        {
+            Node* copy = newNode<Node>(node->resource, copyContents(node->value, node->resource));
+            releaseNode(node);
+            node = copy;
+        }
+    }
+
+    // hashing: each value's hash is 32 bits, mixed in 64 (see JsonValue::hash())
+    const uint64_t k_hashMultiplier = 0x9e3779b97f4a7c15ull;
+
+    enum class HashTag : uint64_t
+    {
+        Null = 1,
+        Invalid,
+        False,
+        True,
+        Integer,
+        Unsigned,
+        Double,
+        String,
+        Array,
+        Object,
+    };
+
+    // the finalizer of splitmix64
+    uint64_t mix(uint64_t x)
+    {
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+        return x ^ (x >> 31);
+    }
+
+    // a value's hash; never 0, which means "not computed yet"
+    uint32_t finishHash(uint64_t x, HashTag tag)
+    {
+        x = mix(x ^ ((uint64_t) tag * k_hashMultiplier));
+        uint32_t h = (uint32_t) (x ^ (x >> 32));
+        return h ? h : 1;
+    }
+
+    uint32_t hashInteger(int64_t i)
+    {
+        return finishHash((uint64_t) i, HashTag::Integer);
+    }
+
+    // doubles that hold integers hash like those integers, since they compare equal
+    uint32_t hashDouble(double d)
+    {
+        if (d >= -9223372036854775808.0 && d < 9223372036854775808.0 && (double) (int64_t) d == d)
+        {
+            return hashInteger((int64_t) d);
+        }
+        else if (d >= 9223372036854775808.0 && d < 18446744073709551616.0 && (double) (uint64_t) d == d)
+        {
+            return finishHash((uint64_t) d, HashTag::Unsigned);
+        }
+        uint64_t bits;
+        memcpy(&bits, &d, sizeof(bits));
+        return finishHash(bits, HashTag::Double);
+    }
+
+    // arrays combine their elements' hashes in order, and objects add up their members' hashes
+    uint64_t addElementHash(uint64_t h, uint32_t element)
+    {
+        return (h + element) * k_hashMultiplier;
+    }
+
+    uint64_t memberHash(uint32_t keyHash, uint32_t valueHash)
+    {
+        return mix(((uint64_t) keyHash << 32) | valueHash);
+    }
 }
 
 JsonValue::JsonValue(Type type) :
+    JsonValue(type, std::pmr::get_default_resource())
+{
+}
+
+JsonValue::JsonValue(Type type, std::pmr::memory_resource* resource) :
     m_type(type)
 {
     switch (type)
@@ -23,15 +162,15 @@ JsonValue::JsonValue(Type type) :
             break;
 
         case Type::String:
-            m_data.string = new std::string();
+            m_data.string = newNode<Shared<std::pmr::string>>(resource, resource);
             break;
 
         case Type::Array:
-            m_data.array = new std::vector<JsonValue>();
+            m_data.array = newNode<Shared<Array>>(resource, resource);
             break;
 
         case Type::Object:
-            m_data.object = new std::map<std::string, JsonValue>();
+            m_data.object = newNode<Shared<Object>>(resource, resource);
             break;
     }
 }
@@ -57,7 +196,37 @@ JsonValue::JsonValue(double value) :
 JsonValue::JsonValue(int value) :
     m_type(Type::Number)
 {
-    m_data.number = value;
+    setInteger(value);
+}
+
+JsonValue::JsonValue(unsigned int value) :
+    m_type(Type::Number)
+{
+    setInteger(value);
+}
+
+JsonValue::JsonValue(long value) :
+    m_type(Type::Number)
+{
+    setInteger(value);
+}
+
+JsonValue::JsonValue(unsigned long value) :
+    m_type(Type::Number)
+{
+    setUnsigned(value);
+}
+
+JsonValue::JsonValue(long long value) :
+    m_type(Type::Number)
+{
+    setInteger(value);
+}
+
+JsonValue::JsonValue(unsigned long long value) :
+    m_type(Type::Number)
+{
+    setUnsigned(value);
 }
 
 JsonValue::JsonValue(const char* value) :
@@ -65,69 +234,72 @@ JsonValue::JsonValue(const char* value) :
 {
     if (value)
     {
-        m_data.string = new std::string(value);
+        m_data.string = newNode<Shared<std::pmr::string>>(std::pmr::get_default_resource(), value, std::pmr::get_default_resource());
+    }
+    else
+    {
+        memset(&m_data, 0, sizeof(m_data));
     }
 }
 
 JsonValue::JsonValue(const std::string& value) :
+    JsonValue(value, std::pmr::get_default_resource())
+{
+}
+
+JsonValue::JsonValue(std::string_view value, std::pmr::memory_resource* resource) :
     m_type(Type::String)
 {
-    m_data.string = new std::string(value);
+    m_data.string = newNode<Shared<std::pmr::string>>(resource, value, resource);
 }
 
 JsonValue::~JsonValue()
 {
-    switch (m_type)
-    {
-        case Type::String:
-            delete m_data.string;
-            break;
-
-        case Type::Array:
-            delete m_data.array;
-            break;
-
-        case Type::Object:
-            delete m_data.object;
-            break;
-            
-        default:
-            break;
-    }
+    release();
 }
 
 JsonValue::JsonValue(const JsonValue& other):
-    m_type(other.m_type)
+    m_type(other.m_type),
+    m_numberType(other.m_numberType),
+    m_stringType(other.m_stringType),
+    m_arrayType(other.m_arrayType),
+    m_data(other.m_data)
 {
     if (this == &k_invalid)
     {
         throw std::runtime_error("can't modify returned invalid value"); 
     }
 
-    switch (m_type)
-    {
-        case Type::Boolean:
-        case Type::Number:
-        case Type::Null:
-        case Type::Invalid:
-            m_data = other.m_data;
-            break;
+    retain();
+}
 
-        case Type::String:
-            m_data.string = new std::string(*other.m_data.string);
-            break;
+JsonValue::JsonValue(JsonValue&& other) noexcept :
+    m_type(other.m_type),
+    m_numberType(other.m_numberType),
+    m_stringType(other.m_stringType),
+    m_arrayType(other.m_arrayType),
+    m_data(other.m_data)
+{
+    other.m_type = Type::Invalid;
+}
 
-        case Type::Array:
-            m_data.array = new std::vector<JsonValue>(*other.m_data.array);
-            break;
+JsonValue& JsonValue::operator=(const JsonValue& other)
+{
+    if (this != &other) 
+    { 
+        if (this == &k_invalid)
+        {
+            throw std::runtime_error("can't modify returned invalid value"); 
+        }
 
-        case Type::Object:
-            m_data.object = new std::map<std::string, JsonValue>(*other.m_data.object);
-            break;
+        // other may be owned by this value (e.g. value = value[0]), so copy it before releasing ours
+        *this = JsonValue(other);
     }
+
+    return *this;
 }
 
-JsonValue& JsonValue::operator=(const JsonValue& other)
+JsonValue& JsonValue::operator=(JsonValue&& other)
 {
     if (this != &other) 
     { 
@@ -136,97 +308,269 @@ JsonValue& JsonValue::operator=(const JsonValue& other)
             throw std::runtime_error("can't modify returned invalid value"); 
         }
 
-        switch (m_type)
+        Type type = other.m_type;
+        NumberType numberType = other.m_numberType;
+        StringType stringType = other.m_stringType;
+        ArrayType arrayType = other.m_arrayType;
+        Data data = other.m_data;
+        other.m_type = Type::Invalid;
+        release();
+        m_type = type;
+        m_numberType = numberType;
+        m_stringType = stringType;
+        m_arrayType = arrayType;
+        m_data = data;
+    }
+
+    return *this;
+}
+
+bool JsonValue::operator==(const JsonValue& other) const
+{
+    // compare pairs of values from a list rather than recursively, so deep values can't overflow the stack
+    std::vector<std::pair<const JsonValue*, const JsonValue*>> pending;
+    pending.emplace_back(this, &other);
+    while (!pending.empty())
+    {
+        const JsonValue& a = *pending.back().first;
+        const JsonValue& b = *pending.back().second;
+        pending.pop_back();
+
+        if (a.m_type != b.m_type) { return false; }
+
+        switch (a.m_type)
         {
             case Type::Boolean:
-            case Type::Number:
-            case Type::Null:
-            case Type::Invalid:
+                if (a.boolean() != b.boolean()) { return false; }
                 break;
 
-            case Type::String:
-                delete m_data.string;
+            case Type::Number:
+                if (!a.numberEquals(b)) { return false; }
                 break;
 
-            case Type::Array:
-                delete m_data.array;
+            case Type::String:
+            {
+                std::string_view sa = a.stringView();
+                std::string_view sb = b.stringView();
+                if ((sa.data() != sb.data() || sa.size() != sb.size()) && sa != sb) { return false; } // not shared, and not equal
                 break;
+            }
 
-            case Type::Object:
-                delete m_data.object;
-                break;
-        }
-        switch (other.m_type)
-        {
-            case Type::Boolean:
-            case Type::Number:
             case Type::Null:
             case Type::Invalid:
-                m_data = other.m_data;
-                break;
-
-            case Type::String:
-                m_data.string = new std::string(*other.m_data.string);
                 break;
 
             case Type::Array:
-                m_data.array = new std::vector<JsonValue>(*other.m_data.array);
+            {
+                if (a.m_data.array == b.m_data.array) { break; } // shared (or the same packed node)
+                if (a.cachedHash() && b.cachedHash() && a.cachedHash() != b.cachedHash()) { return false; } // hashed, and different
+                if (!a.isGenericArray() || !b.isGenericArray())
+                {
+                    if (a.size() != b.size()) { return false; }
+                    if (a.isPacked() && a.m_arrayType == b.m_arrayType)
+                    {
+                        const Packed& pa = a.m_data.packed->value;
+                        const Packed& pb = b.m_data.packed->value;
+                        if (pa.doubles != pb.doubles || pa.integers != pb.integers || pa.booleans != pb.booleans) { return false; }
+                        break;
+                    }
+                    if (a.isColumnar() && b.isColumnar())
+                    {
+                        // the rows are equal if the keys and columns are
+                        pending.emplace_back(&a.m_data.columns->value.columns, &b.m_data.columns->value.columns);
+                        break;
+                    }
+                    // otherwise compare the elements (made as JsonValues, if need be)
+                    const Array& ea = a.elements();
+                    const Array& eb = b.elements();
+                    for (size_t i = 0; i < ea.size(); ++i)
+                    {
+                        pending.emplace_back(&ea[i], &eb[i]);
+                    }
+                    break;
+                }
+                const Array& ea = a.m_data.array->value;
+                const Array& eb = b.m_data.array->value;
+                if (ea.size() != eb.size()) { return false; }
+                for (size_t i = 0; i < ea.size(); ++i)
+                {
+                    pending.emplace_back(&ea[i], &eb[i]);
+                }
                 break;
+            }
 
             case Type::Object:
-                m_data.object = new std::map<std::string, JsonValue>(*other.m_data.object);
+            {
+                if (a.m_data.object == b.m_data.object) { break; } // shared
+                if (a.cachedHash() && b.cachedHash() && a.cachedHash() != b.cachedHash()) { return false; } // hashed, and different
+                const Object& ma = a.m_data.object->value;
+                const Object& mb = b.m_data.object->value;
+                if (ma.size() != mb.size()) { return false; }
+                // the keys are sorted, so equal objects have equal keys in the same order
+                for (size_t i = 0; i < ma.size(); ++i)
+                {
+                    if (ma[i].hash != mb[i].hash || ma[i].key != mb[i].key) { return false; }
+                    pending.emplace_back(&ma[i].value, &mb[i].value);
+                }
                 break;
+            }
         }
-        m_type = other.m_type;
     }
+    return true;
+}
 
-    return *this;
+bool JsonValue::operator!=(const JsonValue& other) const
+{
+    return !(*this == other);
 }
 
-bool JsonValue::operator==(const JsonValue& other) const
+size_t JsonValue::hash() const
 {
-    if (m_type != other.m_type) { return false; }
+    std::atomic<uint32_t>* slot = hashSlot();
+    if (!slot)
+    {
+        return scalarHash();
+    }
+    else if (uint32_t h = slot->load(std::memory_order_relaxed))
+    {
+        return h;
+    }
 
-    switch (m_type)
+    // Hash arrays and objects from a stack rather than recursively, so deep values can't overflow the stack.
+    // When an element is an array or object that hasn't been hashed, it's pushed, and the element is looked
+    // at again after it's been hashed (and has kept its hash).
+    struct Frame
     {
-        case Type::Boolean:
-            return boolean() == other.boolean();
+        const JsonValue* value;
+        size_t index;
+        uint64_t h;
+        uint64_t row; // the hash of the current row, for columnar arrays
+    };
+    std::vector<Frame> stack;
+    stack.push_back(Frame{ this, 0, 0, 0 });
+    while (!stack.empty())
+    {
+        Frame& frame = stack.back();
+        const JsonValue& value = *frame.value;
+        uint32_t result = 0;
+        if (value.m_type == Type::Object)
+        {
+            const Object& members = value.m_data.object->value;
+            for (; frame.index < members.size(); ++frame.index)
+            {
+                const Member& member = members[frame.index];
+                uint32_t h = member.value.cachedHash();
+                if (!h)
+                {
+                    break;
+                }
+                frame.h += memberHash(member.hash, h);
+            }
+            if (frame.index == members.size())
+            {
+                result = finishHash(frame.h + members.size(), HashTag::Object);
+            }
+            else
+            {
+                stack.push_back(Frame{ &members[frame.index].value, 0, 0, 0 });
+            }
+        }
+        else if (value.isColumnar())
+        {
+            // hash each row as the object it would be, from the columns
+            const Object& columns = value.m_data.columns->value.columns.m_data.object->value;
+            size_t count = (size_t) value.m_data.columns->value.rows * columns.size();
+            for (; frame.index < count; ++frame.index)
+            {
+                int row = (int) (frame.index / columns.size());
+                size_t k = frame.index % columns.size();
+                const Member& column = columns[k];
+                uint32_t h = column.value.isGenericArray() ? column.value.m_data.array->value[row].cachedHash() : column.value.packedHash(row);
+                if (!h)
+                {
+                    break;
+                }
+                frame.row += memberHash(column.hash, h);
+                if (k + 1 == columns.size())
+                {
+                    frame.h = addElementHash(frame.h, finishHash(frame.row + columns.size(), HashTag::Object));
+                    frame.row = 0;
+                }
+            }
+            if (frame.index == count)
+            {
+                result = finishHash(frame.h + value.m_data.columns->value.rows, HashTag::Array);
+            }
+            else
+            {
+                const Member& column = columns[frame.index % columns.size()];
+                stack.push_back(Frame{ &column.value.m_data.array->value[frame.index / columns.size()], 0, 0, 0 });
+            }
+        }
+        else if (value.isPacked())
+        {
+            int count = value.packedSize();
+            for (int i = 0; i < count; ++i)
+            {
+                frame.h = addElementHash(frame.h, value.packedHash(i));
+            }
+            result = finishHash(frame.h + count, HashTag::Array);
+        }
+        else
+        {
+            const Array& elements = value.m_data.array->value;
+            for (; frame.index < elements.size(); ++frame.index)
+            {
+                uint32_t h = elements[frame.index].cachedHash();
+                if (!h)
+                {
+                    break;
+                }
+                frame.h = addElementHash(frame.h, h);
+            }
+            if (frame.index == elements.size())
+            {
+                result = finishHash(frame.h + elements.size(), HashTag::Array);
+            }
+            else
+            {
+                stack.push_back(Frame{ &elements[frame.index], 0, 0, 0 });
+            }
+        }
 
-        case Type::Number:
-            return number() == other.number();
+        if (result)
+        {
+            value.hashSlot()->store(result, std::memory_order_relaxed);
+            stack.pop_back();
+        }
+    }
+    return slot->load(std::memory_order_relaxed);
+}
 
+std::pmr::memory_resource* JsonValue::resource() const
+{
+    switch (m_type)
+    {
         case Type::String:
-            return string() == other.string();
-
-        case Type::Null:
-        case Type::Invalid:
-            return true;
+            return m_stringType == StringType::Buffer ? m_data.buffer->resource : m_data.string->resource;
 
         case Type::Array:
-            if (size() != other.size()) { return false; }
-            for (int i = 0; i < size(); ++i)
+            switch (m_arrayType)
             {
-                if (get(i) != other.get(i)) { return false; }
+                case ArrayType::Generic: return m_data.array->resource;
+                case ArrayType::Columns: return m_data.columns->resource;
+                default: return m_data.packed->resource;
             }
-            return true;
 
         case Type::Object:
-            if (size() != other.size()) { return false; }
-            for (int i = 0; i < size(); ++i)
-            {
-                const std::string& k = key(i);
-                if (!other.contains(k)) { return false; }
-                if (get(k) != other.get(k)) { return false; }
-            }
-            return true;
-    }
+            return m_data.object->resource;
 
-    return false; // we'll never get here, but MSVC warns about it anyway
-}
+        case Type::Number:
+            return isRawNumber() ? m_data.string->resource : std::pmr::get_default_resource();
 
-bool JsonValue::operator!=(const JsonValue& other) const
-{
-    return !(*this == other);
+        default:
+            return std::pmr::get_default_resource();
+    }
 }
 
 bool JsonValue::boolean() const
@@ -235,68 +579,198 @@ bool JsonValue::boolean() const
     return m_data.boolean;
 }
 
-double JsonValue::number() const 
-{ 
-    assertType(Type::Number);
-    return m_data.number; 
-}
-
-const std::string& JsonValue::string() const 
-{ 
-    assertType(Type::String);
-    return *m_data.string; 
-}
-
-bool JsonValue::boolean(bool def) const
-{
-    return isBoolean() ? boolean() : def;
-}
-
-double JsonValue::number(double def) const
-{
-    return isNumber() ? number() : def;
-}
-
-float JsonValue::numberFloat(float def) const
-{
-    return isNumber() ? numberFloat() : def;
-}
-
-int JsonValue::numberInt(int def) const
-{
-    return isNumber() ? numberInt() : def;
-}
-
-const std::string& JsonValue::string(const std::string& def) const
+bool JsonValue::isInteger() const
 {
-    return isString() ? string() : def;
-}
-
-int JsonValue::size() const
-{
-    if (m_type == Type::Array)
+    if (m_type != Type::Number)
     {
-        return (int) m_data.array->size();
+        return false;
     }
-    else if (m_type == Type::Object)
+    else if (m_numberType == NumberType::Raw)
     {
-        return (int) m_data.object->size();
+        return decodeNumber().isInteger();
     }
     else
     {
-        throwTypeError();
+        return m_numberType != NumberType::Double;
     }
 }
 
-void JsonValue::clear()
+const std::pmr::string& JsonValue::numberText() const
+{
+    if (!isRawNumber())
+    {
+        throwTypeError();
+    }
+    return m_data.string->value;
+}
+
+double JsonValue::number() const 
+{ 
+    assertType(Type::Number);
+    switch (m_numberType)
+    {
+        case NumberType::Raw:
+            return decodeNumber().number();
+        case NumberType::Int64:
+            return (double) m_data.int64;
+        case NumberType::UInt64:
+            return (double) m_data.uint64;
+        default:
+            return m_data.number;
+    }
+}
+
+int64_t JsonValue::int64() const
+{
+    assertType(Type::Number);
+    switch (m_numberType)
+    {
+        case NumberType::Raw:
+            return decodeNumber().int64();
+
+        case NumberType::Int64:
+            return m_data.int64;
+
+        case NumberType::UInt64:
+            break; // always greater than INT64_MAX
+
+        default:
+            // 2^63 is exactly representable as a double, but is one past the largest int64_t
+            if (m_data.number >= -9223372036854775808.0 && m_data.number < 9223372036854775808.0)
+            {
+                return (int64_t) m_data.number;
+            }
+            break;
+    }
+    throw std::runtime_error("number out of range");
+}
+
+uint64_t JsonValue::uint64() const
+{
+    assertType(Type::Number);
+    switch (m_numberType)
+    {
+        case NumberType::Raw:
+            return decodeNumber().uint64();
+
+        case NumberType::Int64:
+            if (m_data.int64 >= 0)
+            {
+                return (uint64_t) m_data.int64;
+            }
+            break;
+
+        case NumberType::UInt64:
+            return m_data.uint64;
+
+        default:
+            if (m_data.number > -1.0 && m_data.number < 18446744073709551616.0)
+            {
+                return (uint64_t) m_data.number;
+            }
+            break;
+    }
+    throw std::runtime_error("number out of range");
+}
+
+const std::pmr::string& JsonValue::string() const 
+{ 
+    assertType(Type::String);
+    if (m_stringType == StringType::Buffer)
+    {
+        // copies of the value may be used on other threads, so make sure only one copy is kept
+        BufferString& s = m_data.buffer->value;
+        Shared<std::pmr::string>* copy = s.copy.load(std::memory_order_acquire);
+        if (!copy)
+        {
+            std::pmr::memory_resource* resource = m_data.buffer->resource;
+            Shared<std::pmr::string>* newCopy = newNode<Shared<std::pmr::string>>(resource, s.view, resource);
+            if (s.copy.compare_exchange_strong(copy, newCopy, std::memory_order_acq_rel, std::memory_order_acquire))
+            {
+                copy = newCopy;
+            }
+            else
+            {
+                releaseNode(newCopy); // another thread got there first
+            }
+        }
+        return copy->value;
+    }
+    return m_data.string->value; 
+}
+
+std::string_view JsonValue::stringView() const
+{
+    assertType(Type::String);
+    if (m_stringType == StringType::Buffer)
+    {
+        return m_data.buffer->value.view;
+    }
+    return m_data.string->value;
+}
+
+bool JsonValue::boolean(bool def) const
+{
+    return isBoolean() ? boolean() : def;
+}
+
+double JsonValue::number(double def) const
+{
+    return isNumber() ? number() : def;
+}
+
+float JsonValue::numberFloat(float def) const
+{
+    return isNumber() ? numberFloat() : def;
+}
+
+int JsonValue::numberInt(int def) const
+{
+    return isNumber() ? numberInt() : def;
+}
+
+int64_t JsonValue::int64(int64_t def) const
+{
+    return isNumber() ? int64() : def;
+}
+
+uint64_t JsonValue::uint64(uint64_t def) const
+{
+    return isNumber() ? uint64() : def;
+}
+
+const std::pmr::string& JsonValue::string(const std::pmr::string& def) const
+{
+    return isString() ? string() : def;
+}
+
+int JsonValue::size() const
 {
     if (m_type == Type::Array)
     {
-        m_data.array->clear();
+        switch (m_arrayType)
+        {
+            case ArrayType::Generic: return (int) m_data.array->value.size();
+            case ArrayType::Columns: return m_data.columns->value.rows;
+            default: return packedSize();
+        }
     }
     else if (m_type == Type::Object)
     {
-        m_data.object->clear();
+        return (int) m_data.object->value.size();
+    }
+    else
+    {
+        throwTypeError();
+    }
+}
+
+void JsonValue::clear()
+{
+    if (m_type == Type::Array || m_type == Type::Object)
+    {
+        // no point copying shared contents just to clear them
+        *this = JsonValue(m_type, resource());
     }
     else
     {
@@ -306,6 +780,8 @@ void JsonValue::clear()
 
 JsonValue& JsonValue::get(int index)
 {
+    unpack();
+    makeUnshareable();
     const JsonValue& me = const_cast<const JsonValue&>(*this);
     return const_cast<JsonValue&>(me.get(index));
 }
@@ -317,11 +793,13 @@ const JsonValue& JsonValue::get(int index) const
     {
         throw std::runtime_error("index out of range"); 
     }
-    return (*m_data.array)[index];
+    return elements()[index];
 }
 
 JsonValue& JsonValue::operator[](int index)
 {
+    unpack();
+    makeUnshareable();
     const JsonValue& me = const_cast<const JsonValue&>(*this);
     return const_cast<JsonValue&>(me[index]);
 }
@@ -340,7 +818,7 @@ const JsonValue& JsonValue::operator[](int index) const
         }
         else
         {
-            return (*m_data.array)[index];
+            return elements()[index];
         }
     }
     else
@@ -352,19 +830,67 @@ const JsonValue& JsonValue::operator[](int index) const
 void JsonValue::set(int index, const JsonValue& value)
 {
     assertType(Type::Array);
-    (*m_data.array)[index] = value;
+    if (isPacked() && packedType(value) == m_arrayType && index >= 0 && index < packedSize())
+    {
+        detach();
+        Packed& packed = m_data.packed->value;
+        switch (m_arrayType)
+        {
+            case ArrayType::Doubles: packed.doubles[index] = value.m_data.number; break;
+            case ArrayType::Integers: packed.integers[index] = value.m_data.int64; break;
+            default: packed.booleans[index] = value.m_data.boolean; break;
+        }
+        dropElements(packed);
+        return;
+    }
+    unpack();
+    detach();
+    m_data.array->value[index] = value;
 }
 
 void JsonValue::remove(int index)
 {
     assertType(Type::Array);
-    m_data.array->erase(m_data.array->begin() + index);
+    if (isColumnar())
+    {
+        unpack();
+    }
+    detach();
+    if (isPacked())
+    {
+        Packed& packed = m_data.packed->value;
+        switch (m_arrayType)
+        {
+            case ArrayType::Doubles: packed.doubles.erase(packed.doubles.begin() + index); break;
+            case ArrayType::Integers: packed.integers.erase(packed.integers.begin() + index); break;
+            default: packed.booleans.erase(packed.booleans.begin() + index); break;
+        }
+        dropElements(packed);
+        return;
+    }
+    m_data.array->value.erase(m_data.array->value.begin() + index);
 }
 
 void JsonValue::reserve(int size)
 {
     assertType(Type::Array);
-    m_data.array->reserve(size);
+    if (isColumnar())
+    {
+        return; // can't be added to without unpacking
+    }
+    detach();
+    if (isPacked())
+    {
+        Packed& packed = m_data.packed->value;
+        switch (m_arrayType)
+        {
+            case ArrayType::Doubles: packed.doubles.reserve(size); break;
+            case ArrayType::Integers: packed.integers.reserve(size); break;
+            default: packed.booleans.reserve(size); break;
+        }
+        return;
+    }
+    m_data.array->value.reserve(size);
 }
 
 void JsonValue::append(const JsonValue& value)
@@ -381,36 +907,204 @@ void JsonValue::append(const JsonValue& value)
     }
 
     assertType(Type::Array);
-    m_data.array->push_back(value);
+    if (appendPacked(value))
+    {
+        return;
+    }
+    unpack();
+    detach();
+    m_data.array->value.push_back(value);
+}
+
+bool JsonValue::pack()
+{
+    assertType(Type::Array);
+    if (!isGenericArray())
+    {
+        return isPacked();
+    }
+    const Array& array = m_data.array->value;
+    if (array.empty())
+    {
+        return false;
+    }
+    ArrayType type = packedType(array[0]);
+    if (type == ArrayType::Generic)
+    {
+        return false;
+    }
+    for (const JsonValue& element : array)
+    {
+        if (packedType(element) != type)
+        {
+            return false;
+        }
+    }
+
+    std::pmr::memory_resource* resource = m_data.array->resource;
+    Shared<Packed>* node = newNode<Shared<Packed>>(resource, resource);
+    Packed& packed = node->value;
+    switch (type)
+    {
+        case ArrayType::Doubles:
+            packed.doubles.reserve(array.size());
+            for (const JsonValue& element : array) { packed.doubles.push_back(element.m_data.number); }
+            break;
+        case ArrayType::Integers:
+            packed.integers.reserve(array.size());
+            for (const JsonValue& element : array) { packed.integers.push_back(element.m_data.int64); }
+            break;
+        default:
+            packed.booleans.reserve(array.size());
+            for (const JsonValue& element : array) { packed.booleans.push_back(element.m_data.boolean); }
+            break;
+    }
+    releaseContainer();
+    m_data.packed = node;
+    m_arrayType = type;
+    return true;
+}
+
+bool JsonValue::toColumns()
+{
+    assertType(Type::Array);
+    if (!isGenericArray())
+    {
+        return isColumnar();
+    }
+
+    // the rows must be objects with the same keys (which are sorted, so they're in the same order)
+    const Array& rows = m_data.array->value;
+    if (rows.empty() || !rows[0].isObject() || rows[0].size() == 0)
+    {
+        return false;
+    }
+    const Object& first = rows[0].m_data.object->value;
+    for (const JsonValue& row : rows)
+    {
+        if (!row.isObject() || row.m_data.object->value.size() != first.size())
+        {
+            return false;
+        }
+        const Object& members = row.m_data.object->value;
+        for (size_t k = 0; k < members.size(); ++k)
+        {
+            if (members[k].hash != first[k].hash || members[k].key != first[k].key)
+            {
+                return false;
+            }
+        }
+    }
+
+    std::pmr::memory_resource* resource = m_data.array->resource;
+    JsonValue columns(Type::Object, resource);
+    Object& members = columns.m_data.object->value;
+    members.reserve(first.size());
+    for (size_t k = 0; k < first.size(); ++k)
+    {
+        JsonValue column(Type::Array, resource);
+        Array& values = column.m_data.array->value;
+        values.reserve(rows.size());
+        for (const JsonValue& row : rows)
+        {
+            values.push_back(row.m_data.object->value[k].value);
+        }
+        column.pack();
+        members.emplace_back(first[k].key, first[k].hash, std::move(column));
+    }
+
+    Shared<Columns>* node = newNode<Shared<Columns>>(resource, columns, (int) rows.size());
+    releaseContainer();
+    m_data.columns = node;
+    m_arrayType = ArrayType::Columns;
+    return true;
+}
+
+const JsonValue& JsonValue::column(std::string_view key) const
+{
+    if (!isColumnar())
+    {
+        return k_invalid;
+    }
+    const JsonValue& columns = m_data.columns->value.columns;
+    return columns[key];
+}
+
+void JsonValue::unpack()
+{
+    if (m_type != Type::Array || isGenericArray())
+    {
+        return;
+    }
+    std::pmr::memory_resource* resource = this->resource();
+    Shared<Array>* node = newNode<Shared<Array>>(resource, resource);
+    int count = size();
+    node->value.reserve(count);
+    for (int i = 0; i < count; ++i)
+    {
+        node->value.push_back(element(i));
+    }
+    if (isColumnar())
+    {
+        releaseNode(m_data.columns);
+    }
+    else
+    {
+        releaseNode(m_data.packed);
+    }
+    m_data.array = node;
+    m_arrayType = ArrayType::Generic;
+}
+
+JsonValue::Span<double> JsonValue::doubles() const
+{
+    if (m_type != Type::Array || m_arrayType != ArrayType::Doubles)
+    {
+        return Span<double>();
+    }
+    const std::pmr::vector<double>& values = m_data.packed->value.doubles;
+    return Span<double>(values.data(), values.size());
+}
+
+JsonValue::Span<int64_t> JsonValue::integers() const
+{
+    if (m_type != Type::Array || m_arrayType != ArrayType::Integers)
+    {
+        return Span<int64_t>();
+    }
+    const std::pmr::vector<int64_t>& values = m_data.packed->value.integers;
+    return Span<int64_t>(values.data(), values.size());
 }
 
-JsonValue& JsonValue::get(const std::string& key)
+JsonValue& JsonValue::get(std::string_view key)
 {
+    makeUnshareable();
     const JsonValue& me = const_cast<const JsonValue&>(*this);
     return const_cast<JsonValue&>(me.get(key));
 }
 
-const JsonValue& JsonValue::get(const std::string& key) const
+const JsonValue& JsonValue::get(std::string_view key) const
 {
     assertType(Type::Object);
-    auto it = m_data.object->find(key);
-    if (it == m_data.object->end())
+    int index = findMember(key);
+    if (index < 0)
     {
         throw std::runtime_error("key does not exist"); 
     }
     else
     {
-        return it->second;
+        return m_data.object->value[index].value;
     }
 }
 
-JsonValue& JsonValue::operator[](const std::string& key)
+JsonValue& JsonValue::operator[](std::string_view key)
 {
+    makeUnshareable();
     const JsonValue& me = const_cast<const JsonValue&>(*this);
     return const_cast<JsonValue&>(me[key]);
 }
 
-const JsonValue& JsonValue::operator[](const std::string& key) const
+const JsonValue& JsonValue::operator[](std::string_view key) const
 {
     if (m_type == Type::Invalid)
     {
@@ -418,14 +1112,14 @@ const JsonValue& JsonValue::operator[](const std::string& key) const
     }
     else if (m_type == Type::Object)
     {
-        auto it = m_data.object->find(key);
-        if (it == m_data.object->end())
+        int index = findMember(key);
+        if (index < 0)
         {
             return k_invalid;
         }
         else
         {
-            return it->second;
+            return m_data.object->value[index].value;
         }
     }
     else
@@ -434,7 +1128,7 @@ const JsonValue& JsonValue::operator[](const std::string& key) const
     }
 }
 
-void JsonValue::set(const std::string& key, const JsonValue& value)
+void JsonValue::set(std::string_view key, const JsonValue& value)
 {
     // for convenience, set type of Invalid value to object if it wasn't a return value,
     // so you can do this:
@@ -447,26 +1141,92 @@ void JsonValue::set(const std::string& key, const JsonValue& value)
     }
 
     assertType(Type::Object);
-    (*m_data.object)[key] = value;
+    detach();
+    Object& members = m_data.object->value;
+    if (members.empty() || std::string_view(members.back().key) < key)
+    {
+        // keys added in order go on the end, without searching or moving the others
+        members.emplace_back(key, JsonKey::hash(key), value);
+        return;
+    }
+    auto it = std::lower_bound(members.begin(), members.end(), key, [](const Member& m, std::string_view k) { return m.key < k; });
+    if (it != members.end() && it->key == key)
+    {
+        it->value = value;
+    }
+    else
+    {
+        members.emplace(it, key, JsonKey::hash(key), value);
+    }
 }
 
-void JsonValue::remove(const std::string& key)
+void JsonValue::remove(std::string_view key)
 {
-    m_data.object->erase(key);
+    assertType(Type::Object);
+    detach();
+    int index = findMember(key);
+    if (index >= 0)
+    {
+        m_data.object->value.erase(m_data.object->value.begin() + index);
+    }
 }
 
-bool JsonValue::contains(const std::string& key) const
+bool JsonValue::contains(std::string_view key) const
 {
     assertType(Type::Object);
-    return m_data.object->find(key) != m_data.object->end();
+    return findMember(key) >= 0;
 }
 
-const std::string& JsonValue::key(int index) const 
+const std::pmr::string& JsonValue::key(int index) const 
 { 
     assertType(Type::Object);
-    auto it = m_data.object->begin();
-    std::advance(it, index);
-    return it->first; 
+    if (index < 0 || index >= size())
+    {
+        throw std::runtime_error("index out of range"); 
+    }
+    return m_data.object->value[index].key;
+}
+
+JsonValue& JsonValue::get(const JsonKey& key)
+{
+    makeUnshareable();
+    const JsonValue& me = const_cast<const JsonValue&>(*this);
+    return const_cast<JsonValue&>(me.get(key));
+}
+
+const JsonValue& JsonValue::get(const JsonKey& key) const
+{
+    assertType(Type::Object);
+    const JsonValue* value = findMember(key);
+    if (!value)
+    {
+        throw std::runtime_error("key does not exist"); 
+    }
+    return *value;
+}
+
+JsonValue& JsonValue::operator[](const JsonKey& key)
+{
+    makeUnshareable();
+    const JsonValue& me = const_cast<const JsonValue&>(*this);
+    return const_cast<JsonValue&>(me[key]);
+}
+
+const JsonValue& JsonValue::operator[](const JsonKey& key) const
+{
+    if (m_type == Type::Invalid)
+    {
+        return k_invalid;
+    }
+    else if (m_type == Type::Object)
+    {
+        const JsonValue* value = findMember(key);
+        return value ? *value : k_invalid;
+    }
+    else
+    {
+        throwTypeError();
+    }
 }
 
 bool JsonValue::read(std::istream& stream)
@@ -487,6 +1247,576 @@ void JsonValue::write(std::ostream& stream, bool compact) const
 
 ////////////////////////////////////////
 
+JsonValue JsonValue::rawNumber(std::string_view text, std::pmr::memory_resource* resource)
+{
+    // the caller has checked the syntax
+    JsonValue value(Type::Number);
+    value.m_numberType = NumberType::Raw;
+    value.m_data.string = newNode<Shared<std::pmr::string>>(resource, text, resource);
+    return value;
+}
+
+JsonValue JsonValue::bufferString(std::string_view view, std::pmr::memory_resource* resource)
+{
+    JsonValue value(Type::Null);
+    value.m_type = Type::String;
+    value.m_stringType = StringType::Buffer;
+    value.m_data.buffer = newNode<Shared<BufferString>>(resource, view);
+    return value;
+}
+
+JsonValue JsonValue::decodeNumber() const
+{
+    if (m_numberType != NumberType::Raw)
+    {
+        return *this;
+    }
+
+    JsonValue value;
+    if (!parseNumber(m_data.string->value.data(), m_data.string->value.size(), value))
+    {
+        throw std::runtime_error("number out of range"); // the syntax was checked when it was read
+    }
+    return value;
+}
+
+int JsonValue::findMember(std::string_view key) const
+{
+    const Object& members = m_data.object->value;
+    auto it = std::lower_bound(members.begin(), members.end(), key, [](const Member& m, std::string_view k) { return m.key < k; });
+    if (it != members.end() && it->key == key)
+    {
+        return (int) (it - members.begin());
+    }
+    return -1;
+}
+
+const JsonValue* JsonValue::findMember(const JsonKey& key) const
+{
+    // objects in an array of records usually have the same keys, so the key is probably where it was last time
+    const Object& members = m_data.object->value;
+    uint32_t slot = key.m_slot.load(std::memory_order_relaxed);
+    if (slot < members.size() && members[slot].hash == key.m_hash && members[slot].key == key.m_key)
+    {
+        return &members[slot].value;
+    }
+
+    int index = findMember(key.m_key);
+    if (index < 0)
+    {
+        return nullptr;
+    }
+    key.m_slot.store((uint32_t) index, std::memory_order_relaxed);
+    return &members[index].value;
+}
+
+// sort members read in any order; if a key appears more than once, the last value is kept
+void JsonValue::sortMembers(Object& members)
+{
+    std::stable_sort(members.begin(), members.end(), [](const Member& a, const Member& b) { return a.key < b.key; });
+    size_t count = 0;
+    for (size_t i = 0; i < members.size(); ++i)
+    {
+        if (i + 1 < members.size() && members[i + 1].key == members[i].key)
+        {
+            continue; // a later value replaces this one
+        }
+        if (count != i)
+        {
+            members[count] = std::move(members[i]);
+        }
+        ++count;
+    }
+    members.erase(members.begin() + count, members.end());
+}
+
+void JsonValue::setInteger(int64_t value)
+{
+    m_numberType = NumberType::Int64;
+    m_data.int64 = value;
+}
+
+void JsonValue::setUnsigned(uint64_t value)
+{
+    if (value <= (uint64_t) INT64_MAX)
+    {
+        setInteger((int64_t) value);
+    }
+    else
+    {
+        m_numberType = NumberType::UInt64;
+        m_data.uint64 = value;
+    }
+}
+
+bool JsonValue::numberEquals(const JsonValue& other) const
+{
+    if (m_numberType == NumberType::Raw || other.m_numberType == NumberType::Raw)
+    {
+        // compare by value, so 1.0 equals 1.00
+        return decodeNumber().numberEquals(other.decodeNumber());
+    }
+    else if (m_numberType == NumberType::Double && other.m_numberType == NumberType::Double)
+    {
+        return m_data.number == other.m_data.number;
+    }
+    else if (m_numberType != NumberType::Double && other.m_numberType != NumberType::Double)
+    {
+        // each integer has only one representation
+        return m_numberType == other.m_numberType && m_data.int64 == other.m_data.int64;
+    }
+    else
+    {
+        // an integer and a double are equal only if the double holds exactly that integer
+        const JsonValue& i = (m_numberType == NumberType::Double) ? other : *this;
+        double d = (m_numberType == NumberType::Double) ? m_data.number : other.m_data.number;
+        if (i.m_numberType == NumberType::Int64)
+        {
+            return d >= -9223372036854775808.0 && d < 9223372036854775808.0 && (int64_t) d == i.m_data.int64 && (double) (int64_t) d == d;
+        }
+        else
+        {
+            return d >= 9223372036854775808.0 && d < 18446744073709551616.0 && (uint64_t) d == i.m_data.uint64;
+        }
+    }
+}
+
+// the hash of a value other than an array or object
+uint32_t JsonValue::scalarHash() const
+{
+    switch (m_type)
+    {
+        case Type::Boolean:
+            return finishHash(0, m_data.boolean ? HashTag::True : HashTag::False);
+
+        case Type::Number:
+            switch (m_numberType)
+            {
+                case NumberType::Raw:
+                    return decodeNumber().scalarHash();
+                case NumberType::Int64:
+                    return hashInteger(m_data.int64);
+                case NumberType::UInt64:
+                    return finishHash(m_data.uint64, HashTag::Unsigned);
+                default:
+                    return hashDouble(m_data.number);
+            }
+
+        case Type::String:
+            return finishHash(std::hash<std::string_view>()(stringView()), HashTag::String);
+
+        case Type::Null:
+            return finishHash(0, HashTag::Null);
+
+        default:
+            return finishHash(0, HashTag::Invalid);
+    }
+}
+
+// the hash of an element of a packed array, which is the same as if it were a JsonValue
+uint32_t JsonValue::packedHash(int index) const
+{
+    const Packed& packed = m_data.packed->value;
+    switch (m_arrayType)
+    {
+        case ArrayType::Doubles:
+            return hashDouble(packed.doubles[index]);
+        case ArrayType::Integers:
+            return hashInteger(packed.integers[index]);
+        default:
+            return finishHash(0, packed.booleans[index] ? HashTag::True : HashTag::False);
+    }
+}
+
+// where an array or object keeps its hash, or null for other types
+std::atomic<uint32_t>* JsonValue::hashSlot() const
+{
+    if (m_type == Type::Object)
+    {
+        return &m_data.object->hash;
+    }
+    else if (m_type != Type::Array)
+    {
+        return nullptr;
+    }
+    switch (m_arrayType)
+    {
+        case ArrayType::Generic:
+            return &m_data.array->hash;
+        case ArrayType::Columns:
+            return &m_data.columns->hash;
+        default:
+            return &m_data.packed->hash;
+    }
+}
+
+// the hash if it's known without looking at any elements or members, or 0
+uint32_t JsonValue::cachedHash() const
+{
+    std::atomic<uint32_t>* slot = hashSlot();
+    return slot ? slot->load(std::memory_order_relaxed) : scalarHash();
+}
+
+JsonValue::Packed::Packed(std::pmr::memory_resource* resource) :
+    doubles(resource),
+    integers(resource),
+    booleans(resource),
+    elements(nullptr)
+{
+}
+
+JsonValue::Packed::Packed(const Packed& other, std::pmr::memory_resource* resource) :
+    doubles(other.doubles, resource),
+    integers(other.integers, resource),
+    booleans(other.booleans, resource),
+    elements(nullptr)
+{
+}
+
+JsonValue::Packed::Packed(Packed&& other) :
+    doubles(std::move(other.doubles)),
+    integers(std::move(other.integers)),
+    booleans(std::move(other.booleans)),
+    elements(other.elements.exchange(nullptr))
+{
+}
+
+JsonValue::Packed::~Packed()
+{
+    dropElements(*this);
+}
+
+JsonValue::Columns::~Columns()
+{
+    dropElements(*this);
+}
+
+JsonValue::BufferString::~BufferString()
+{
+    if (auto* c = copy.load(std::memory_order_relaxed))
+    {
+        releaseNode(c);
+    }
+}
+
+// the type of packed array that can hold the value, or Generic if none can
+JsonValue::ArrayType JsonValue::packedType(const JsonValue& element)
+{
+    if (element.m_type == Type::Boolean)
+    {
+        return ArrayType::Booleans;
+    }
+    else if (element.m_type == Type::Number)
+    {
+        switch (element.m_numberType)
+        {
+            case NumberType::Double: return ArrayType::Doubles;
+            case NumberType::Int64: return ArrayType::Integers;
+            default: break;
+        }
+    }
+    return ArrayType::Generic;
+}
+
+int JsonValue::packedSize() const
+{
+    const Packed& packed = m_data.packed->value;
+    switch (m_arrayType)
+    {
+        case ArrayType::Doubles: return (int) packed.doubles.size();
+        case ArrayType::Integers: return (int) packed.integers.size();
+        default: return (int) packed.booleans.size();
+    }
+}
+
+JsonValue JsonValue::packedElement(int index) const
+{
+    const Packed& packed = m_data.packed->value;
+    switch (m_arrayType)
+    {
+        case ArrayType::Doubles: return JsonValue(packed.doubles[index]);
+        case ArrayType::Integers: return JsonValue((long long) packed.integers[index]);
+        default: return JsonValue((bool) packed.booleans[index]);
+    }
+}
+
+// an element of an array that isn't generic, made as a JsonValue
+JsonValue JsonValue::element(int index) const
+{
+    if (isColumnar())
+    {
+        const Object& columns = m_data.columns->value.columns.m_data.object->value;
+        JsonValue row(Type::Object, resource());
+        Object& members = row.m_data.object->value;
+        members.reserve(columns.size());
+        for (const Member& column : columns)
+        {
+            members.emplace_back(column.key, column.hash, column.value.element(index));
+        }
+        return row;
+    }
+    else if (isPacked())
+    {
+        return packedElement(index);
+    }
+    return m_data.array->value[index];
+}
+
+// append to a packed array if the value is the right type; returns false if it isn't
+bool JsonValue::appendPacked(const JsonValue& value)
+{
+    if (!isPacked() || packedType(value) != m_arrayType)
+    {
+        return false;
+    }
+    detach();
+    Packed& packed = m_data.packed->value;
+    switch (m_arrayType)
+    {
+        case ArrayType::Doubles: packed.doubles.push_back(value.m_data.number); break;
+        case ArrayType::Integers: packed.integers.push_back(value.m_data.int64); break;
+        default: packed.booleans.push_back(value.m_data.boolean); break;
+    }
+    dropElements(packed);
+    return true;
+}
+
+// the elements of an array as JsonValues; for a packed or columnar array, they're made the first time
+// they're needed, and kept until the array changes
+const JsonValue::Array& JsonValue::elements() const
+{
+    if (isGenericArray())
+    {
+        return m_data.array->value;
+    }
+    std::atomic<Shared<Array>*>& cache = isColumnar() ? m_data.columns->value.elements : m_data.packed->value.elements;
+    Shared<Array>* elements = cache.load(std::memory_order_acquire);
+    if (!elements)
+    {
+        std::pmr::memory_resource* resource = this->resource();
+        Shared<Array>* made = newNode<Shared<Array>>(resource, resource);
+        int count = size();
+        made->value.reserve(count);
+        for (int i = 0; i < count; ++i)
+        {
+            made->value.push_back(element(i));
+        }
+        if (cache.compare_exchange_strong(elements, made, std::memory_order_acq_rel))
+        {
+            elements = made;
+        }
+        else
+        {
+            releaseNode(made); // another thread made them first
+        }
+    }
+    return elements->value;
+}
+
+// take a reference to the storage in m_data, which was copied from another value; storage that can't be
+// shared is copied
+void JsonValue::retain()
+{
+    switch (m_type)
+    {
+        case Type::String:
+            if (m_stringType == StringType::Buffer)
+            {
+                m_data.buffer->refCount.fetch_add(1, std::memory_order_relaxed);
+            }
+            else
+            {
+                m_data.string->refCount.fetch_add(1, std::memory_order_relaxed);
+            }
+            break;
+
+        case Type::Number:
+            if (m_numberType == NumberType::Raw)
+            {
+                m_data.string->refCount.fetch_add(1, std::memory_order_relaxed);
+            }
+            break;
+
+        case Type::Array:
+            if (isColumnar())
+            {
+                m_data.columns->refCount.fetch_add(1, std::memory_order_relaxed);
+            }
+            else if (isPacked())
+            {
+                m_data.packed->refCount.fetch_add(1, std::memory_order_relaxed);
+            }
+            else if (m_data.array->refCount.load(std::memory_order_relaxed) & k_unshareable)
+            {
+                m_data.array = newNode<Shared<Array>>(m_data.array->resource, copyContents(m_data.array->value, m_data.array->resource));
+            }
+            else
+            {
+                m_data.array->refCount.fetch_add(1, std::memory_order_relaxed);
+            }
+            break;
+
+        case Type::Object:
+            if (m_data.object->refCount.load(std::memory_order_relaxed) & k_unshareable)
+            {
+                m_data.object = newNode<Shared<Object>>(m_data.object->resource, copyContents(m_data.object->value, m_data.object->resource));
+            }
+            else
+            {
+                m_data.object->refCount.fetch_add(1, std::memory_order_relaxed);
+            }
+            break;
+            
+        default:
+            break;
+    }
+}
+
+// called before giving out a reference to an element or member, which could be used to change it later
+void JsonValue::makeUnshareable()
+{
+    detach();
+    if (m_type == Type::Object)
+    {
+        m_data.object->refCount.fetch_or(k_unshareable, std::memory_order_relaxed);
+    }
+    else if (m_type == Type::Array)
+    {
+        m_data.array->refCount.fetch_or(k_unshareable, std::memory_order_relaxed);
+    }
+}
+
+void JsonValue::release()
+{
+    switch (m_type)
+    {
+        case Type::String:
+            if (m_stringType == StringType::Buffer)
+            {
+                releaseNode(m_data.buffer);
+            }
+            else
+            {
+                releaseNode(m_data.string);
+            }
+            break;
+
+        case Type::Number:
+            if (m_numberType == NumberType::Raw)
+            {
+                releaseNode(m_data.string);
+            }
+            break;
+
+        case Type::Array:
+        case Type::Object:
+            if (isColumnar())
+            {
+                releaseNode(m_data.columns); // its columns are released like any other object
+            }
+            else if (isPacked())
+            {
+                releaseNode(m_data.packed); // only holds scalars, so there's no recursion to avoid
+            }
+            else
+            {
+                releaseContainer();
+            }
+            break;
+            
+        default:
+            break;
+    }
+}
+
+namespace
+{
+    // containers waiting to be freed by the outermost releaseContainer() on this thread, if any
+    thread_local std::vector<JsonValue>* t_pendingRelease = nullptr;
+}
+
+void JsonValue::releaseContainer()
+{
+    // Freeing a container releases its children, which would recurse as deeply as the value is nested;
+    // so while one container is being freed, children that need freeing too are queued instead.
+    if (t_pendingRelease)
+    {
+        bool last = (m_type == Type::Array ? references(m_data.array) : references(m_data.object)) == 1;
+        if (last)
+        {
+            t_pendingRelease->push_back(std::move(*this));
+        }
+        else
+        {
+            releaseContainerNode();
+        }
+        return;
+    }
+
+    std::vector<JsonValue> pending;
+    t_pendingRelease = &pending;
+    releaseContainerNode();
+    while (!pending.empty())
+    {
+        JsonValue value = std::move(pending.back());
+        pending.pop_back();
+        value.releaseContainerNode();
+        value.m_type = Type::Invalid; // already released
+    }
+    t_pendingRelease = nullptr;
+}
+
+void JsonValue::releaseContainerNode()
+{
+    if (m_type == Type::Array)
+    {
+        releaseNode(m_data.array);
+    }
+    else
+    {
+        releaseNode(m_data.object);
+    }
+}
+
+void JsonValue::detach()
+{
+    switch (m_type)
+    {
+        case Type::String:
+            if (m_stringType == StringType::Owned) // buffer strings can't be modified
+            {
+                detachNode(m_data.string);
+            }
+            break;
+
+        case Type::Array:
+            if (isColumnar())
+            {
+                detachNode(m_data.columns);
+            }
+            else if (isPacked())
+            {
+                detachNode(m_data.packed);
+            }
+            else
+            {
+                detachNode(m_data.array);
+            }
+            break;
+
+        case Type::Object:
+            detachNode(m_data.object);
+            break;
+            
+        default:
+            return;
+    }
+    if (std::atomic<uint32_t>* slot = hashSlot())
+    {
+        slot->store(0, std::memory_order_relaxed); // the value may be about to change
+    }
+}
+
 void JsonValue::throwTypeError() const
 {
     throw std::runtime_error("incorrect JSON type"); 
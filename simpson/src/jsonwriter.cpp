@@ -1,66 +1,77 @@
 #include "simpson/jsonwriter.h"
+#include "simpson/src/stats.h"
+#include "simpson/src/numbers.h"
+#include "simpson/src/text.h"
+#include "simpson/src/workerpool.h"
 #include <iomanip>
+#include <chrono>
+#include <sstream>
+#include <thread>
+#include <future>
+#include <algorithm>
+#include <cstring>
 
 namespace Simpson 
 {
 
-namespace
+const int JsonWriter::k_parallelSize;
+
+////////////////////////////////////////
+
+JsonWriter::JsonWriter(std::ostream& stream) :
+    m_stream(stream)
+{
+}
+
+JsonWriter::~JsonWriter()
+{
+    delete m_pool;
+}
+
+void JsonWriter::write(const JsonValue& value)
 {
-    std::string escape(const std::string& s)
+#if SIMPSON_ENABLE_STATS
+    if (m_stats)
     {
-        std::string result = s;
-        for (int i = 0; i < (int) result.length(); ++i)
-        {
-            std::string repl;
-            switch (result[i])
-            {
-                case '"':
-                    repl = "\\\"";
-                    break;
-                case '\\':
-                    repl = "\\\\";
-                    break;
-                case '\b':
-                    repl = "\\b";
-                    break;
-                case '\f':
-                    repl = "\\f";
-                    break;
-                case '\n':
-                    repl = "\\n";
-                    break;
-                case '\r':
-                    repl = "\\r";
-                    break;
-                case '\t':
-                    repl = "\\t";
-                    break;
+        m_current.reset();
+        m_record = &m_current;
+        long long start = (long long) m_stream.rdbuf()->pubseekoff(0, std::ios::cur, std::ios::out);
+        auto startTime = std::chrono::steady_clock::now();
 
-                // TODO: optionally escape forward slash
-                // TODO: optionally escape unicode chars > U+007f
+        writeImpl(value);
 
-                default: 
-                    break;
-            }
-            if (!repl.empty())
-            {
-                result.replace(i++, 1, repl);
-            }
+        m_current.addSeconds(JsonStats::Phase::Write, std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count());
+        long long end = (long long) m_stream.rdbuf()->pubseekoff(0, std::ios::cur, std::ios::out);
+        if (start >= 0 && end >= start)
+        {
+            m_current.bytes = end - start;
+        }
+        m_record = nullptr;
+
+        *m_stats += m_current;
+        if (m_stats->hook())
+        {
+            m_stats->hook()->onWrite(m_current);
         }
-        return result;
+        return;
     }
+#endif
+    writeImpl(value);
 }
 
-////////////////////////////////////////
-
-JsonWriter::JsonWriter(std::ostream& stream) :
-    m_stream(stream)
+void JsonWriter::setStats(JsonStats* stats)
 {
+    m_stats = stats;
 }
 
-void JsonWriter::write(const JsonValue& value)
+void JsonWriter::setThreads(int threads)
 {
-    writeImpl(value);
+    m_threads = (threads > 0) ? threads : std::max(1, (int) std::thread::hardware_concurrency());
+    if (m_pool && m_pool->threads() != m_threads)
+    {
+        delete m_pool; // a new pool is made by the next write that needs one
+        m_pool = nullptr;
+    }
 }
 
 void JsonWriter::setIndent(int spaces)
@@ -68,20 +79,318 @@ void JsonWriter::setIndent(int spaces)
     m_indent = std::string(spaces, ' ');
 }
 
+void JsonWriter::setAsciiOnly(bool asciiOnly)
+{
+    m_asciiOnly = asciiOnly;
+}
+
+void JsonWriter::setEscapeSlash(bool escapeSlash)
+{
+    m_escapeSlash = escapeSlash;
+}
+
 ////////////////////////////////////////
 
 void JsonWriter::writeIndent(int level)
 {
+    if (m_indent.empty())
+    {
+        return;
+    }
     for (int i = 0; i < level; ++i)
     {
         m_stream << m_indent;
     }
 }
 
-void JsonWriter::writeImpl(const JsonValue& value, int level, const std::string& prefix)
+// a string, quoted and escaped
+void JsonWriter::writeString(std::string_view s)
+{
+    // write runs of characters that don't need escaping at once, skipping them a word at a time
+    m_stream.put('"');
+    const char* run = s.data();
+    const char* end = s.data() + s.size();
+    const char* p = run;
+    for (;;)
+    {
+        while (end - p >= 8)
+        {
+            uint64_t word;
+            memcpy(&word, p, sizeof(word));
+            if (hasByte(word, '"') || hasByte(word, '\\') || hasByteLess(word, 0x20) || (m_asciiOnly && hasHighByte(word)) || (m_escapeSlash && hasByte(word, '/')))
+            {
+                break;
+            }
+            p += 8;
+        }
+        while (p < end && !needsEscape((unsigned char) *p))
+        {
+            ++p;
+        }
+        m_stream.write(run, p - run);
+        if (p == end)
+        {
+            break;
+        }
+
+        unsigned char c = (unsigned char) *p++;
+        switch (c)
+        {
+            case '"': m_stream.write("\\\"", 2); break;
+            case '\\': m_stream.write("\\\\", 2); break;
+            case '/': m_stream.write("\\/", 2); break;
+            case '\b': m_stream.write("\\b", 2); break;
+            case '\f': m_stream.write("\\f", 2); break;
+            case '\n': m_stream.write("\\n", 2); break;
+            case '\r': m_stream.write("\\r", 2); break;
+            case '\t': m_stream.write("\\t", 2); break;
+            default:
+            {
+                if (c < 0x80)
+                {
+                    writeUnicodeEscape(c); // another control character
+                    break;
+                }
+                // decode UTF-8 (or replace an invalid sequence)
+                int length = utf8Sequence(p - 1, end);
+                if (length > 0)
+                {
+                    uint32_t value = decodeUtf8(p - 1, length);
+                    if (value > 0xffff)
+                    {
+                        // a UTF-16 surrogate pair
+                        value -= 0x10000;
+                        writeUnicodeEscape(0xd800 + (value >> 10));
+                        writeUnicodeEscape(0xdc00 + (value & 0x3ff));
+                    }
+                    else
+                    {
+                        writeUnicodeEscape(value);
+                    }
+                }
+                else
+                {
+                    writeUnicodeEscape(0xfffd);
+                    length = -length;
+                }
+                p += length - 1;
+                break;
+            }
+        }
+        run = p;
+    }
+    m_stream.put('"');
+}
+
+bool JsonWriter::needsEscape(unsigned char c) const
+{
+    return c < 0x20 || c == '"' || c == '\\' || (c >= 0x80 && m_asciiOnly) || (c == '/' && m_escapeSlash);
+}
+
+void JsonWriter::writeUnicodeEscape(uint32_t value)
+{
+    const char hex[] = "0123456789abcdef";
+    char escape[6] = { '\\', 'u', hex[(value >> 12) & 0xf], hex[(value >> 8) & 0xf], hex[(value >> 4) & 0xf], hex[value & 0xf] };
+    m_stream.write(escape, 6);
+}
+
+void JsonWriter::writeImpl(const JsonValue& root)
+{
+    // Containers being written are kept on a stack, rather than writing them recursively, so that deeply
+    // nested values can't overflow the call stack.
+    m_stack.clear();
+    writeValue(root, 0, nullptr);
+    while (!m_stack.empty())
+    {
+        const Frame& frame = m_stack.back();
+        if (m_threads > 1 && frame.index == 0 && frame.row < 0 && frameSize(frame) >= k_parallelSize)
+        {
+            writeParallel();
+        }
+        writeNext();
+    }
+}
+
+// number of elements (or members) of a frame
+int JsonWriter::frameSize(const Frame& frame) const
+{
+    return frame.row >= 0 ? (int) frame.value->m_data.columns->value.columns.m_data.object->value.size() : frame.value->size();
+}
+
+// write the next element of the container at the top of the stack, or its end if there are no more
+void JsonWriter::writeNext()
+{
+    Frame& frame = m_stack.back();
+    int level = frame.level + 1;
+    const JsonValue::Object* columns = frame.value->isColumnar() ? &frame.value->m_data.columns->value.columns.m_data.object->value : nullptr;
+    if (frame.index < frameSize(frame))
+    {
+        if (frame.index > 0)
+        {
+            m_stream << ",";
+        }
+        m_stream << std::endl;
+
+        // the frame reference isn't valid after writeValue() adds a container to the stack
+        int index = frame.index++;
+        if (frame.row >= 0)
+        {
+            // a member of a row: the row's value in the key's column
+            const JsonValue::Member& column = (*columns)[index];
+            if (column.value.isPacked())
+            {
+                writeValue(column.value.packedElement(frame.row), level, &column.key);
+            }
+            else
+            {
+                writeValue(column.value.m_data.array->value[frame.row], level, &column.key);
+            }
+        }
+        else if (columns)
+        {
+            // a row, which always has members
+            writeIndent(level);
+            SIMPSON_STATS(m_record, addValue(JsonValue::Type::Object));
+            SIMPSON_STATS(m_record, enter());
+            m_stream << "{";
+            m_stack.push_back(Frame{ frame.value, 0, index, level });
+        }
+        else if (frame.value->isPacked())
+        {
+            writeValue(frame.value->packedElement(index), level, nullptr); // a scalar, so it isn't kept
+        }
+        else if (frame.value->isArray())
+        {
+            writeValue(frame.value->m_data.array->value[index], level, nullptr);
+        }
+        else
+        {
+            const JsonValue::Member& member = frame.value->m_data.object->value[index];
+            writeValue(member.value, level, &member.key);
+        }
+    }
+    else
+    {
+        m_stream << std::endl;
+        writeIndent(frame.level);
+        m_stream << ((frame.value->isArray() && frame.row < 0) ? "]" : "}");
+        m_stack.pop_back();
+        SIMPSON_STATS(m_record, leave());
+    }
+}
+
+// Write all the elements of the container at the top of the stack, split into ranges that the writer's
+// pool of threads writes to separate buffers; the buffers are output in order as they're finished.
+void JsonWriter::writeParallel()
+{
+    if (!m_pool)
+    {
+        m_pool = new WorkerPool(m_threads);
+    }
+
+    Frame container = m_stack.back();
+    int size = frameSize(container);
+    int rangeCount = std::min(size, m_threads * 4); // more ranges than threads, to balance the load
+
+    struct Range
+    {
+        std::string text;
+        JsonStats stats;
+        std::promise<void> done;
+    };
+    std::vector<Range> ranges(rangeCount);
+    for (int r = 0; r < rangeCount; ++r)
+    {
+        m_pool->run([&, r]()
+        {
+            Range& range = ranges[r];
+            try
+            {
+                std::ostringstream stream;
+                stream.copyfmt(m_stream); // the same formatting of doubles
+                JsonWriter writer(stream);
+                writer.m_indent = m_indent;
+                writer.m_asciiOnly = m_asciiOnly;
+                writer.m_escapeSlash = m_escapeSlash;
+#if SIMPSON_ENABLE_STATS
+                if (m_record)
+                {
+                    writer.m_record = &range.stats;
+                    int depth = (int) m_stack.size(); // containers open
+                    for (int i = 0; i < depth; ++i)
+                    {
+                        range.stats.enter();
+                    }
+                }
+#endif
+                writer.writeRange(container, (int) ((int64_t) size * r / rangeCount), (int) ((int64_t) size * (r + 1) / rangeCount));
+                range.text = stream.str();
+                range.done.set_value();
+            }
+            catch (...)
+            {
+                range.done.set_exception(std::current_exception());
+            }
+        });
+    }
+
+    // the ranges refer to this frame, so wait for all of them even if one fails
+    std::exception_ptr error;
+    for (Range& range : ranges)
+    {
+        try
+        {
+            range.done.get_future().get(); // rethrows anything thrown while writing the range
+        }
+        catch (...)
+        {
+            if (!error)
+            {
+                error = std::current_exception();
+            }
+        }
+        if (!error)
+        {
+            m_stream.write(range.text.data(), range.text.size());
+#if SIMPSON_ENABLE_STATS
+            if (m_record)
+            {
+                *m_record += range.stats;
+            }
+#endif
+        }
+        std::string().swap(range.text);
+    }
+    if (error)
+    {
+        std::rethrow_exception(error);
+    }
+    m_stack.back().index = size;
+}
+
+// write elements [begin, end) of a container, as part of writing the whole container
+void JsonWriter::writeRange(const Frame& container, int begin, int end)
+{
+    m_stack.clear();
+    m_stack.push_back(container);
+    m_stack.back().index = begin;
+    while (m_stack.size() > 1 || m_stack.back().index < end)
+    {
+        writeNext();
+    }
+}
+
+// write a value, or the start of an array or object, which is added to the stack
+void JsonWriter::writeValue(const JsonValue& value, int level, const std::pmr::string* key)
 {
     writeIndent(level);
-    m_stream << prefix;
+    if (key)
+    {
+        writeString(*key);
+        m_stream << ": ";
+        SIMPSON_STATS(m_record, addString(key->size()));
+    }
+    SIMPSON_STATS(m_record, addValue(value.type()));
     switch (value.type())
     {
         case JsonValue::Type::Boolean:
@@ -89,11 +398,25 @@ void JsonWriter::writeImpl(const JsonValue& value, int level, const std::string&
             break;
 
         case JsonValue::Type::Number:
-            m_stream << std::setprecision(17) << value.number();
+            if (value.isRawNumber())
+            {
+                m_stream << value.numberText();
+            }
+            else if (value.isInteger())
+            {
+                char buffer[k_maxIntegerLength];
+                size_t length = value.number() < 0 ? formatInteger(value.int64(), buffer) : formatUnsigned(value.uint64(), buffer);
+                m_stream.write(buffer, length);
+            }
+            else
+            {
+                m_stream << std::setprecision(17) << value.number();
+            }
             break;
 
         case JsonValue::Type::String:
-            m_stream << "\"" << escape(value.string()) << "\"";
+            writeString(value.stringView());
+            SIMPSON_STATS(m_record, addString(value.stringView().size()));
             break;
 
         case JsonValue::Type::Null:
@@ -104,51 +427,22 @@ void JsonWriter::writeImpl(const JsonValue& value, int level, const std::string&
             break;
 
         case JsonValue::Type::Array:
-            if (value.size() == 0)
-            {
-                m_stream << "[]";
-            }
-            else
-            {
-                m_stream << "[" << std::endl;
-                for (int i = 0; i < value.size(); ++i)
-                {
-                    writeImpl(value.get(i), level+1);
-                    if (i < value.size()-1)
-                    {
-                        m_stream << ",";
-                    }
-                    m_stream << std::endl;
-                }
-                writeIndent(level);
-                m_stream << "]";
-            }
-            break;
-
         case JsonValue::Type::Object:
+        {
+            bool isArray = value.isArray();
+            SIMPSON_STATS(m_record, enter());
             if (value.size() == 0)
             {
-                m_stream << "{}";
+                m_stream << (isArray ? "[]" : "{}");
+                SIMPSON_STATS(m_record, leave());
             }
             else
             {
-                m_stream << "{" << std::endl;
-                for (int i = 0; i < value.size(); ++i)
-                {
-                    const std::string& key = value.key(i);
-                    const JsonValue& keyValue = value.get(key);
-                    std::string prefix = "\"" + key + "\": ";
-                    writeImpl(keyValue, level+1, prefix);
-                    if (i < value.size()-1)
-                    {
-                        m_stream << ",";
-                    }
-                    m_stream << std::endl;
-                }
-                writeIndent(level);
-                m_stream << "}";
+                m_stream << (isArray ? "[" : "{");
+                m_stack.push_back(Frame{ &value, 0, -1, level });
             }
             break;
+        }
     }
 }
 
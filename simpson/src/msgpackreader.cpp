@@ -0,0 +1,319 @@
+#include "simpson/msgpackreader.h"
+#include "simpson/src/binaryio.h"
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+namespace Simpson 
+{
+
+const int MsgPackReader::k_defaultMaxDepth;
+
+namespace
+{
+    // don't trust sizes in the input for more than this when reserving space
+    const uint64_t k_maxReserve = 4096;
+
+    void setFloat(JsonValue& value, double d)
+    {
+        // there's no JSON representation of NaN or infinity
+        if (std::isfinite(d))
+        {
+            value = d;
+        }
+        else
+        {
+            value = nullptr;
+        }
+    }
+}
+
+////////////////////////////////////////
+
+MsgPackReader::MsgPackReader(std::istream& stream) :
+    m_input(new ByteInput(stream))
+{
+}
+
+MsgPackReader::MsgPackReader(const void* data, size_t size) :
+    m_input(new ByteInput(data, size))
+{
+}
+
+MsgPackReader::~MsgPackReader()
+{
+    delete m_input;
+}
+
+bool MsgPackReader::read(JsonValue& value)
+{
+    value = JsonValue(); // clear
+    return readValue(value);
+}
+
+void MsgPackReader::setMaxDepth(int depth)
+{
+    m_maxDepth = depth;
+}
+
+int MsgPackReader::pos() const
+{
+    return (int) m_input->pos();
+}
+
+////////////////////////////////////////
+
+bool MsgPackReader::readValue(JsonValue& result)
+{
+    // Arrays and maps that are being read are kept on a stack, rather than reading them recursively, so that
+    // deeply nested input can't overflow the call stack.
+    m_stack.clear();
+
+    for (;;)
+    {
+        JsonValue value;
+        if (!m_stack.empty() && m_stack.back().remaining == 0)
+        {
+            // the container at the top of the stack has all its items
+            Frame& frame = m_stack.back();
+            if (!frame.sorted)
+            {
+                JsonValue::sortMembers(frame.value.m_data.object->value);
+            }
+            value = std::move(frame.value);
+            m_stack.pop_back();
+        }
+        else
+        {
+            if (!m_stack.empty())
+            {
+                Frame& frame = m_stack.back();
+                --frame.remaining;
+                if (frame.value.isObject() && !readKey(frame.key))
+                {
+                    return false;
+                }
+            }
+
+            uint8_t c;
+            if (!m_input->get(c))
+            {
+                return false;
+            }
+
+            bool isContainer = true;
+            bool isArray = false;
+            uint64_t size = 0;
+            if (c >= 0x80 && c <= 0x9f)
+            {
+                // fixmap or fixarray
+                isArray = (c >= 0x90);
+                size = c & 0x0f;
+            }
+            else if (c >= 0xdc && c <= 0xdf)
+            {
+                // array 16, array 32, map 16 or map 32
+                isArray = (c <= 0xdd);
+                if (!m_input->readBigEndian(size, (c & 1) ? 4 : 2))
+                {
+                    return false;
+                }
+            }
+            else
+            {
+                isContainer = false;
+            }
+
+            if (isContainer)
+            {
+                if (m_maxDepth > 0 && (int) m_stack.size() >= m_maxDepth)
+                {
+                    return false;
+                }
+                m_stack.push_back(Frame{ JsonValue(isArray ? JsonValue::Type::Array : JsonValue::Type::Object), std::string(), size, true });
+                if (isArray)
+                {
+                    m_stack.back().value.reserve((int) std::min(size, k_maxReserve));
+                }
+                else
+                {
+                    m_stack.back().value.m_data.object->value.reserve(std::min(size, k_maxReserve));
+                }
+                continue; // read the first item
+            }
+
+            if (!readScalar(c, value))
+            {
+                return false;
+            }
+        }
+
+        // add the value to its container
+        if (m_stack.empty())
+        {
+            result = std::move(value);
+            return true;
+        }
+        Frame& container = m_stack.back();
+        if (container.value.isArray())
+        {
+            container.value.append(value);
+        }
+        else
+        {
+            // members are sorted when the map ends, if they weren't in order
+            JsonValue::Object& members = container.value.m_data.object->value;
+            std::string_view key = container.key;
+            if (!members.empty() && !(std::string_view(members.back().key) < key))
+            {
+                container.sorted = false;
+            }
+            members.emplace_back(key, JsonKey::hash(key), std::move(value));
+        }
+    }
+}
+
+// a key in a map, which must be a string
+bool MsgPackReader::readKey(std::string& key)
+{
+    uint8_t c;
+    JsonValue value;
+    if (!m_input->get(c) || !readScalar(c, value) || !value.isString())
+    {
+        return false;
+    }
+    key = value.string();
+    return true;
+}
+
+// a value that isn't an array or map
+bool MsgPackReader::readScalar(uint8_t c, JsonValue& value)
+{
+    if (c <= 0x7f)
+    {
+        // positive fixint
+        value = JsonValue((int) c);
+        return true;
+    }
+    else if (c <= 0x9f)
+    {
+        return false; // fixmap or fixarray
+    }
+    else if (c <= 0xbf)
+    {
+        // fixstr
+        std::string str;
+        if (!m_input->read(str, c & 0x1f))
+        {
+            return false;
+        }
+        value = str;
+        return true;
+    }
+    else if (c >= 0xe0)
+    {
+        // negative fixint
+        value = JsonValue((int) (int8_t) c);
+        return true;
+    }
+
+    uint64_t arg;
+    switch (c)
+    {
+        case 0xc0:
+            value = nullptr;
+            return true;
+
+        case 0xc2:
+            value = false;
+            return true;
+
+        case 0xc3:
+            value = true;
+            return true;
+
+        case 0xc4: // bin 8
+        case 0xc5: // bin 16
+        case 0xc6: // bin 32
+        {
+            std::string bytes;
+            if (!m_input->readBigEndian(arg, 1 << (c - 0xc4)) || !m_input->read(bytes, arg))
+            {
+                return false;
+            }
+            value = base64Url((const uint8_t*) bytes.data(), bytes.size());
+            return true;
+        }
+
+        case 0xca: // float 32
+        {
+            if (!m_input->readBigEndian(arg, 4))
+            {
+                return false;
+            }
+            uint32_t bits = (uint32_t) arg;
+            float f;
+            memcpy(&f, &bits, sizeof(f));
+            setFloat(value, f);
+            return true;
+        }
+
+        case 0xcb: // float 64
+        {
+            if (!m_input->readBigEndian(arg, 8))
+            {
+                return false;
+            }
+            double d;
+            memcpy(&d, &arg, sizeof(d));
+            setFloat(value, d);
+            return true;
+        }
+
+        case 0xcc: // uint 8
+        case 0xcd: // uint 16
+        case 0xce: // uint 32
+        case 0xcf: // uint 64
+            if (!m_input->readBigEndian(arg, 1 << (c - 0xcc)))
+            {
+                return false;
+            }
+            value = JsonValue((unsigned long long) arg);
+            return true;
+
+        case 0xd0: // int 8
+        case 0xd1: // int 16
+        case 0xd2: // int 32
+        case 0xd3: // int 64
+        {
+            int bytes = 1 << (c - 0xd0);
+            if (!m_input->readBigEndian(arg, bytes))
+            {
+                return false;
+            }
+            // sign-extend
+            int shift = 64 - 8*bytes;
+            value = JsonValue((long long) ((int64_t) (arg << shift) >> shift));
+            return true;
+        }
+
+        case 0xd9: // str 8
+        case 0xda: // str 16
+        case 0xdb: // str 32
+        {
+            std::string str;
+            if (!m_input->readBigEndian(arg, 1 << (c - 0xd9)) || !m_input->read(str, arg))
+            {
+                return false;
+            }
+            value = str;
+            return true;
+        }
+
+        default:
+            // 0xc1 (never used), extension types, which have no JSON equivalent, and arrays and maps
+            return false;
+    }
+}
+
+} // namespace Simpson
@@ -0,0 +1,275 @@
+#include "simpson/msgpackwriter.h"
+#include "simpson/src/binaryio.h"
+#include <cstring>
+
+namespace Simpson 
+{
+
+MsgPackWriter::MsgPackWriter(std::ostream& stream) :
+    m_output(new ByteOutput(stream))
+{
+}
+
+MsgPackWriter::MsgPackWriter(std::vector<uint8_t>& buffer) :
+    m_output(new ByteOutput(buffer))
+{
+}
+
+MsgPackWriter::~MsgPackWriter()
+{
+    delete m_output;
+}
+
+void MsgPackWriter::write(const JsonValue& value)
+{
+    writeImpl(value);
+    m_output->flush();
+}
+
+////////////////////////////////////////
+
+void MsgPackWriter::writeNumber(const JsonValue& value)
+{
+    if (value.isInteger())
+    {
+        if (value.number() < 0)
+        {
+            writeInteger(value.int64());
+        }
+        else
+        {
+            writeUnsigned(value.uint64());
+        }
+        return;
+    }
+
+    double d = value.number();
+    int64_t i;
+    if (toExactInteger(d, i))
+    {
+        writeInteger(i);
+    }
+    else if (isExactFloat(d))
+    {
+        float f = (float) d;
+        uint32_t bits;
+        memcpy(&bits, &f, sizeof(bits));
+        m_output->put(0xca);
+        m_output->writeBigEndian(bits, 4);
+    }
+    else
+    {
+        uint64_t bits;
+        memcpy(&bits, &d, sizeof(bits));
+        m_output->put(0xcb);
+        m_output->writeBigEndian(bits, 8);
+    }
+}
+
+void MsgPackWriter::writeInteger(int64_t i)
+{
+    if (i >= 0)
+    {
+        writeUnsigned((uint64_t) i);
+    }
+    else if (i >= -32)
+    {
+        m_output->put((uint8_t) i); // negative fixint
+    }
+    else if (i >= INT8_MIN)
+    {
+        m_output->put(0xd0);
+        m_output->writeBigEndian((uint64_t) i, 1);
+    }
+    else if (i >= INT16_MIN)
+    {
+        m_output->put(0xd1);
+        m_output->writeBigEndian((uint64_t) i, 2);
+    }
+    else if (i >= INT32_MIN)
+    {
+        m_output->put(0xd2);
+        m_output->writeBigEndian((uint64_t) i, 4);
+    }
+    else
+    {
+        m_output->put(0xd3);
+        m_output->writeBigEndian((uint64_t) i, 8);
+    }
+}
+
+void MsgPackWriter::writeUnsigned(uint64_t u)
+{
+    if (u <= 0x7f)
+    {
+        m_output->put((uint8_t) u); // positive fixint
+    }
+    else if (u <= 0xff)
+    {
+        m_output->put(0xcc);
+        m_output->writeBigEndian(u, 1);
+    }
+    else if (u <= 0xffff)
+    {
+        m_output->put(0xcd);
+        m_output->writeBigEndian(u, 2);
+    }
+    else if (u <= 0xffffffff)
+    {
+        m_output->put(0xce);
+        m_output->writeBigEndian(u, 4);
+    }
+    else
+    {
+        m_output->put(0xcf);
+        m_output->writeBigEndian(u, 8);
+    }
+}
+
+void MsgPackWriter::writeString(std::string_view s)
+{
+    size_t size = s.size();
+    if (size < 32)
+    {
+        m_output->put(0xa0 | (uint8_t) size); // fixstr
+    }
+    else if (size <= 0xff)
+    {
+        m_output->put(0xd9);
+        m_output->writeBigEndian(size, 1);
+    }
+    else if (size <= 0xffff)
+    {
+        m_output->put(0xda);
+        m_output->writeBigEndian(size, 2);
+    }
+    else
+    {
+        m_output->put(0xdb);
+        m_output->writeBigEndian(size, 4);
+    }
+    m_output->write(s.data(), size);
+}
+
+void MsgPackWriter::writeContainerHead(int fixBase, uint8_t code16, uint8_t code32, size_t size)
+{
+    if (size < 16)
+    {
+        m_output->put((uint8_t) (fixBase | size));
+    }
+    else if (size <= 0xffff)
+    {
+        m_output->put(code16);
+        m_output->writeBigEndian(size, 2);
+    }
+    else
+    {
+        m_output->put(code32);
+        m_output->writeBigEndian(size, 4);
+    }
+}
+
+void MsgPackWriter::writeImpl(const JsonValue& root)
+{
+    // Containers being written are kept on a stack, rather than writing them recursively, so that deeply
+    // nested values can't overflow the call stack.
+    m_stack.clear();
+    writeValue(root);
+    while (!m_stack.empty())
+    {
+        Frame& frame = m_stack.back();
+        if (frame.index == frameSize(frame))
+        {
+            m_stack.pop_back();
+            continue;
+        }
+
+        // the frame reference isn't valid after writeValue() adds a container to the stack
+        const JsonValue& container = *frame.value;
+        int index = frame.index++;
+        int row = frame.row;
+        if (row >= 0)
+        {
+            // a member of a row: the row's value in the key's column
+            const JsonValue::Member& column = container.m_data.columns->value.columns.m_data.object->value[index];
+            writeString(column.key);
+            if (column.value.isPacked())
+            {
+                writeValue(column.value.packedElement(row));
+            }
+            else
+            {
+                writeValue(column.value.m_data.array->value[row]);
+            }
+        }
+        else if (container.isColumnar())
+        {
+            // a row, which is written from the columns rather than made as an object
+            const JsonValue::Object& columns = container.m_data.columns->value.columns.m_data.object->value;
+            writeContainerHead(0x80, 0xde, 0xdf, columns.size());
+            m_stack.push_back(Frame{ &container, 0, index });
+        }
+        else if (container.isPacked())
+        {
+            writeValue(container.packedElement(index)); // a scalar, so it isn't kept
+        }
+        else if (container.isArray())
+        {
+            writeValue(container.m_data.array->value[index]);
+        }
+        else
+        {
+            const JsonValue::Member& member = container.m_data.object->value[index];
+            writeString(member.key);
+            writeValue(member.value);
+        }
+    }
+}
+
+// number of elements (or members) of a frame
+int MsgPackWriter::frameSize(const Frame& frame) const
+{
+    return frame.row >= 0 ? (int) frame.value->m_data.columns->value.columns.m_data.object->value.size() : frame.value->size();
+}
+
+// write a value, or the head of an array or object, which is added to the stack
+void MsgPackWriter::writeValue(const JsonValue& value)
+{
+    switch (value.type())
+    {
+        case JsonValue::Type::Boolean:
+            m_output->put(value.boolean() ? 0xc3 : 0xc2);
+            break;
+
+        case JsonValue::Type::Number:
+            writeNumber(value);
+            break;
+
+        case JsonValue::Type::String:
+            writeString(value.stringView());
+            break;
+
+        case JsonValue::Type::Null:
+        case JsonValue::Type::Invalid:
+            m_output->put(0xc0);
+            break;
+
+        case JsonValue::Type::Array:
+            writeContainerHead(0x90, 0xdc, 0xdd, value.size());
+            if (value.size() > 0)
+            {
+                m_stack.push_back(Frame{ &value, 0, -1 });
+            }
+            break;
+
+        case JsonValue::Type::Object:
+            writeContainerHead(0x80, 0xde, 0xdf, value.size());
+            if (value.size() > 0)
+            {
+                m_stack.push_back(Frame{ &value, 0, -1 });
+            }
+            break;
+    }
+}
+
+} // namespace Simpson
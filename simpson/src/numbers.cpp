@@ -0,0 +1,218 @@
+#include "simpson/src/numbers.h"
+#include <charconv>
+#include <sstream>
+#include <locale>
+#include <cstring>
+#include <algorithm>
+
+namespace Simpson
+{
+
+namespace
+{
+    bool isDigit(char c)
+    {
+        return c >= '0' && c <= '9';
+    }
+
+    const char* skipDigits(const char* p, const char* end)
+    {
+        while (p < end && isDigit(*p))
+        {
+            ++p;
+        }
+        return p;
+    }
+
+    bool parseDouble(const char* text, size_t length, double& d)
+    {
+#if defined(__cpp_lib_to_chars)
+        // from_chars is locale-independent, and much faster than a stream; but it may reject
+        // numbers that underflow to subnormals or zero, so leave those to the stream
+        std::from_chars_result result = std::from_chars(text, text + length, d);
+        if (result.ec == std::errc() && result.ptr == text + length)
+        {
+            return true;
+        }
+#endif
+        std::istringstream stream(std::string(text, length));
+        stream.imbue(std::locale::classic());
+        stream >> d;
+        return stream && stream.eof();
+    }
+
+    // pairs of digits "00" to "99", so we can convert two digits at a time
+    const char k_digitPairs[] =
+        "00010203040506070809"
+        "10111213141516171819"
+        "20212223242526272829"
+        "30313233343536373839"
+        "40414243444546474849"
+        "50515253545556575859"
+        "60616263646566676869"
+        "70717273747576777879"
+        "80818283848586878889"
+        "90919293949596979899";
+}
+
+////////////////////////////////////////
+
+bool isValidNumber(const char* text, size_t length, bool* integer)
+{
+    // -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)?
+    const char* p = text;
+    const char* end = text + length;
+    if (p < end && *p == '-')
+    {
+        ++p;
+    }
+    if (p == end || !isDigit(*p))
+    {
+        return false;
+    }
+    p = (*p == '0') ? p + 1 : skipDigits(p, end);
+
+    bool isInteger = true;
+    if (p < end && *p == '.')
+    {
+        ++p;
+        if (p == end || !isDigit(*p))
+        {
+            return false;
+        }
+        p = skipDigits(p, end);
+        isInteger = false;
+    }
+    if (p < end && (*p == 'e' || *p == 'E'))
+    {
+        ++p;
+        if (p < end && (*p == '+' || *p == '-'))
+        {
+            ++p;
+        }
+        if (p == end || !isDigit(*p))
+        {
+            return false;
+        }
+        p = skipDigits(p, end);
+        isInteger = false;
+    }
+    if (integer)
+    {
+        *integer = isInteger;
+    }
+    return p == end;
+}
+
+bool parseNumber(const char* text, size_t length, JsonValue& value)
+{
+    bool integer;
+    if (!isValidNumber(text, length, &integer))
+    {
+        return false;
+    }
+
+    bool negative = (*text == '-');
+    const char* digits = text + (negative ? 1 : 0);
+    const char* digitsEnd = text + length;
+
+    // integer fast path; -0 is left to the double path, so it keeps its sign
+    if (integer && digitsEnd - digits <= 20 && !(negative && *digits == '0'))
+    {
+        uint64_t u = 0;
+        const char* q = digits;
+        for (; q < digitsEnd; ++q)
+        {
+            unsigned int digit = *q - '0';
+            if (u > (UINT64_MAX - digit) / 10)
+            {
+                break; // overflow
+            }
+            u = u*10 + digit;
+        }
+
+        if (q == digitsEnd)
+        {
+            if (!negative)
+            {
+                value = JsonValue((unsigned long long) u);
+                return true;
+            }
+            else if (u <= (uint64_t) INT64_MAX + 1)
+            {
+                value = JsonValue((long long) (0 - u)); // two's complement negation, which also works for INT64_MIN
+                return true;
+            }
+        }
+    }
+
+    double d;
+    if (!parseDouble(text, length, d))
+    {
+        return false;
+    }
+    value = d;
+    return true;
+}
+
+size_t formatUnsigned(uint64_t value, char* buffer)
+{
+    // write digits backwards from the end of a temporary buffer, two at a time
+    char digits[k_maxIntegerLength];
+    char* p = digits + k_maxIntegerLength;
+    while (value >= 100)
+    {
+        int pair = (int) (value % 100) * 2;
+        value /= 100;
+        *--p = k_digitPairs[pair + 1];
+        *--p = k_digitPairs[pair];
+    }
+    if (value >= 10)
+    {
+        int pair = (int) value * 2;
+        *--p = k_digitPairs[pair + 1];
+        *--p = k_digitPairs[pair];
+    }
+    else
+    {
+        *--p = (char) ('0' + value);
+    }
+
+    size_t length = digits + k_maxIntegerLength - p;
+    memcpy(buffer, p, length);
+    return length;
+}
+
+size_t formatInteger(int64_t value, char* buffer)
+{
+    if (value < 0)
+    {
+        *buffer = '-';
+        return 1 + formatUnsigned(0 - (uint64_t) value, buffer + 1);
+    }
+    else
+    {
+        return formatUnsigned((uint64_t) value, buffer);
+    }
+}
+
+size_t formatDouble(double value, char* buffer)
+{
+#if defined(__cpp_lib_to_chars)
+    std::to_chars_result result = std::to_chars(buffer, buffer + k_maxDoubleLength, value);
+    if (result.ec == std::errc())
+    {
+        return result.ptr - buffer;
+    }
+#endif
+    std::ostringstream stream;
+    stream.imbue(std::locale::classic());
+    stream.precision(17);
+    stream << value;
+    std::string text = stream.str();
+    size_t length = std::min(text.size(), k_maxDoubleLength);
+    memcpy(buffer, text.data(), length);
+    return length;
+}
+
+} // namespace Simpson
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "simpson/jsonvalue.h"
+#include <cstdint>
+#include <cstddef>
+
+namespace Simpson
+{
+
+// Check the syntax of a JSON number, and optionally whether it's an integer (with no fraction or exponent).
+bool isValidNumber(const char* text, size_t length, bool* integer = nullptr);
+
+// Parse the text of a JSON number. Integers (with no fraction or exponent) that fit in 64 bits are stored
+// as integers, and anything else as a double. Returns false if the text isn't a valid JSON number, or is
+// too large for a double.
+bool parseNumber(const char* text, size_t length, JsonValue&);
+
+// Write the decimal representation of an integer to the buffer, which must have room for at least
+// k_maxIntegerLength characters (no null is added); return the number of characters written.
+const size_t k_maxIntegerLength = 20;
+size_t formatInteger(int64_t, char* buffer);
+size_t formatUnsigned(uint64_t, char* buffer);
+
+// Write the shortest representation of a finite double that reads back as the same value, in the same way.
+const size_t k_maxDoubleLength = 32;
+size_t formatDouble(double, char* buffer);
+
+} // namespace Simpson
@@ -0,0 +1,11 @@
+#pragma once
+
+#include "simpson/jsonstats.h"
+
+// Record statistics if a JsonStats object is attached, e.g. SIMPSON_STATS(m_stats, addToken(type));
+// expands to nothing if statistics are compiled out.
+#if SIMPSON_ENABLE_STATS
+#define SIMPSON_STATS(stats, expr) do { if (stats) { (stats)->expr; } } while (false)
+#else
+#define SIMPSON_STATS(stats, expr) do {} while (false)
+#endif
@@ -0,0 +1,60 @@
+#include "simpson/src/text.h"
+
+namespace Simpson
+{
+
+// see: https://www.unicode.org/versions/latest/ch03.pdf (table 3-7)
+int utf8Sequence(const char* p, const char* end)
+{
+    unsigned char c = (unsigned char) *p;
+    unsigned char low = 0x80; // range of the second byte
+    unsigned char high = 0xbf;
+    int length;
+    if (c < 0x80)
+    {
+        return 1;
+    }
+    else if (c >= 0xc2 && c <= 0xdf)
+    {
+        length = 2;
+    }
+    else if (c >= 0xe0 && c <= 0xef)
+    {
+        length = 3;
+        low = (c == 0xe0) ? 0xa0 : 0x80; // not overlong
+        high = (c == 0xed) ? 0x9f : 0xbf; // not a surrogate
+    }
+    else if (c >= 0xf0 && c <= 0xf4)
+    {
+        length = 4;
+        low = (c == 0xf0) ? 0x90 : 0x80; // not overlong
+        high = (c == 0xf4) ? 0x8f : 0xbf; // not over U+10FFFF
+    }
+    else
+    {
+        return -1;
+    }
+    for (int i = 1; i < length; ++i)
+    {
+        if (p + i == end || (unsigned char) p[i] < low || (unsigned char) p[i] > high)
+        {
+            return -i;
+        }
+        low = 0x80;
+        high = 0xbf;
+    }
+    return length;
+}
+
+uint32_t decodeUtf8(const char* p, int length)
+{
+    static const unsigned char k_leadMasks[] = { 0, 0x7f, 0x1f, 0x0f, 0x07 };
+    uint32_t value = (unsigned char) p[0] & k_leadMasks[length];
+    for (int i = 1; i < length; ++i)
+    {
+        value = (value << 6) | ((unsigned char) p[i] & 0x3f);
+    }
+    return value;
+}
+
+} // namespace Simpson
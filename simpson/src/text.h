@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+namespace Simpson
+{
+
+// Scanning text a word (8 bytes) at a time: tests for bytes of interest in a word read with memcpy.
+const uint64_t k_wordOnes = 0x0101010101010101ull;
+const uint64_t k_wordHighBits = 0x8080808080808080ull;
+
+// true if any byte of the word is less than n (for n <= 128)
+inline bool hasByteLess(uint64_t word, uint64_t n)
+{
+    return ((word - k_wordOnes * n) & ~word & k_wordHighBits) != 0;
+}
+
+// true if any byte of the word is c
+inline bool hasByte(uint64_t word, uint64_t c)
+{
+    return hasByteLess(word ^ (k_wordOnes * c), 1);
+}
+
+// true if any byte of the word is over 0x7f
+inline bool hasHighByte(uint64_t word)
+{
+    return (word & k_wordHighBits) != 0;
+}
+
+// The length of the UTF-8 sequence at p, if it's valid, or minus the length of its maximal invalid subpart
+// (the longest start of a valid sequence, or 1), which should be replaced with a single U+FFFD.
+int utf8Sequence(const char* p, const char* end);
+
+// the code point of a valid UTF-8 sequence of the given length
+uint32_t decodeUtf8(const char* p, int length);
+
+} // namespace Simpson
@@ -1,14 +1,16 @@
 #pragma once
-#include "simpson/src/tokentype.h"
-#include <string>
+#include "simpson/tokentype.h"
+#include <string_view>
 
 namespace Simpson 
 {
 
+// A token refers to the tokenizer's window or scratch buffer, so it's only valid until the next token is read.
 struct Token
 {
     TokenType type;
-    std::string value;
+    bool boolean;          // value of a BOOLEAN
+    std::string_view text; // unescaped contents of a STRING, or text of a NUMBER
 };
 
 } // namespace Simpson
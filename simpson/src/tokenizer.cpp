@@ -1,5 +1,8 @@
 #include "simpson/src/tokenizer.h"
+#include "simpson/src/text.h"
 #include <iostream>
+#include <cstring>
+#include <algorithm>
 
 // see: https://www.json.org/json-en.html
 
@@ -52,30 +55,75 @@ namespace
         }
         return value;
     }
+
+    bool isNumberChar(char c)
+    {
+        return isDigit(c) || c == '-' || c == '+' || c == 'e' || c == 'E' || c == '.';
+    }
+
+    const char k_replacement[] = "\xef\xbf\xbd"; // U+FFFD in UTF-8
+    const size_t k_replacementLength = 3;
+
+    const size_t k_readBlockSize = 64 * 1024;
 }
 
 ////////////////////////////////////////
 
 Tokenizer::Tokenizer(std::istream& stream) :
-    m_stream(stream)
+    m_stream(&stream)
+{
+}
+
+Tokenizer::Tokenizer(const char* data, size_t size) :
+    m_begin(const_cast<char*>(data)), // never written, since we're not in situ
+    m_pos(m_begin),
+    m_end(m_begin + size)
+{
+}
+
+Tokenizer::Tokenizer(char* buffer, size_t size, bool inSitu) :
+    m_begin(buffer),
+    m_pos(buffer),
+    m_end(buffer + size),
+    m_inSitu(inSitu)
 {
 }
 
 bool Tokenizer::advance()
 {
-    while (isSpace(m_stream.peek()))
+    m_tokenStart = nullptr;
+    for (;;)
     {
-        if (m_stream.peek() == '\n')
+        if (m_pos == m_end && !more())
+        {
+            // end of input; leave it to the parser to decide if that's an error
+            m_token.type = TokenType::END;
+            m_token.text = std::string_view();
+            return false;
+        }
+        char c = *m_pos;
+        if (!isSpace(c))
+        {
+            break;
+        }
+        uint64_t word;
+        if (c == ' ' && m_end - m_pos >= 8 && (memcpy(&word, m_pos, sizeof(word)), word == k_wordOnes * ' '))
+        {
+            // skip indentation a word at a time
+            m_pos += 8;
+            continue;
+        }
+        if (c == '\n')
         {
             ++m_line;
-            m_lineStart = (int) m_stream.tellg() + 1;
+            m_lineStart = offset() + 1;
         }
-        m_stream.ignore();
+        ++m_pos;
     }
-    if (m_stream.eof()) { return false; }
 
-    char c = m_stream.get();
-    m_token.value = c;
+    m_tokenStart = m_pos;
+    char c = *m_pos++;
+    m_token.text = std::string_view();
 
     // TODO handle comments ("//", "/*", etc) as an extension?
 
@@ -92,11 +140,13 @@ bool Tokenizer::advance()
     else if (c == 't')
     {
         m_token.type = TokenType::BOOLEAN;
+        m_token.boolean = true;
         readLiteral("true");
     }
     else if (c == 'f')
     {
         m_token.type = TokenType::BOOLEAN;
+        m_token.boolean = false;
         readLiteral("false");
     }
     else if (c == 'n')
@@ -130,68 +180,156 @@ bool Tokenizer::advance()
     }
     else
     {
-        m_fail = true;
+        setError(offset() - 1);
     }
 
-    return !fail() && !eof();
-}
+    if (!m_fail)
+    {
+        SIMPSON_STATS(m_stats, addToken(m_token.type));
+    }
 
-bool Tokenizer::eof() const
-{
-    return m_stream.eof();
+    return !m_fail;
 }
 
-bool Tokenizer::fail() const
+// Read the next block of a stream into the window, keeping the unread part of the window, and the
+// current token so that it can refer to the window; returns false if there is no more input.
+bool Tokenizer::more()
 {
-    return m_stream.fail() || m_fail;
+    if (!m_stream || !*m_stream)
+    {
+        return false;
+    }
+
+    char* keepFrom = m_tokenStart ? m_tokenStart : m_pos;
+    size_t start = keepFrom - m_begin;
+    size_t keep = m_end - keepFrom;
+    size_t pos = m_pos - keepFrom;
+
+    // read at least as much as we're keeping, so a long token is moved only a few times
+    size_t blockSize = std::max(k_readBlockSize, keep);
+    m_offset += start;
+    m_buffer.resize(keep + blockSize);
+    memmove(m_buffer.data(), m_buffer.data() + start, keep);
+    m_stream->read(m_buffer.data() + keep, blockSize);
+    size_t count = (size_t) m_stream->gcount();
+
+    m_begin = m_buffer.data();
+    m_pos = m_begin + pos;
+    m_end = m_begin + keep + count;
+    if (m_tokenStart)
+    {
+        m_tokenStart = m_begin;
+    }
+    return count > 0;
 }
 
-void Tokenizer::readLiteral(const std::string& literalValue)
+// make sure at least count characters are available in the window
+bool Tokenizer::ensure(size_t count)
 {
-    while (!m_fail && m_token.value.size() < literalValue.size())
+    while ((size_t) (m_end - m_pos) < count)
     {
-        char c = m_stream.get();
-        if (literalValue[m_token.value.size()] == c)
+        if (!more())
         {
-            m_token.value += c;
+            return false;
         }
-        else
+    }
+    return true;
+}
+
+// next character, or -1 at the end of the input
+int Tokenizer::next()
+{
+    if (m_pos == m_end && !more())
+    {
+        return -1;
+    }
+    return (unsigned char) *m_pos++;
+}
+
+void Tokenizer::setError(long long offset)
+{
+    m_fail = true;
+    m_errorOffset = offset;
+}
+
+long long Tokenizer::errorOffset() const
+{
+    if (m_fail)
+    {
+        return m_errorOffset;
+    }
+    return m_tokenStart ? m_offset + (m_tokenStart - m_begin) : offset();
+}
+
+// Add unescaped characters to the string being read: in situ, they're written to the buffer at out, which
+// never passes the characters being read, since unescaping only makes strings shorter; otherwise they're
+// added to the scratch buffer.
+void Tokenizer::append(char*& out, const char* chars, size_t count)
+{
+    if (m_checkOnly)
+    {
+        return;
+    }
+    if (m_inPlace)
+    {
+        if (out != chars)
         {
-            m_fail = true;
-            break;
+            memmove(out, chars, count);
         }
+        out += count;
+    }
+    else
+    {
+        m_scratch.append(chars, count);
     }
 }
 
+void Tokenizer::readLiteral(const char* literalValue)
+{
+    // we've already read the first character
+    size_t length = strlen(literalValue) - 1;
+    if (!ensure(length) || memcmp(m_pos, literalValue + 1, length) != 0)
+    {
+        setError(offset() - 1); // the start of the literal
+        return;
+    }
+    m_pos += length;
+}
+
 void Tokenizer::readNumber()
 {
     // TODO optionally handle NaN/Infinity/-Infinity?
-    char c;
-    while ((isDigit(c = m_stream.peek())) || c == '-' || c == '+' || c == 'e' || c == 'E' || c == '.')
+    for (;;)
     {
-        m_token.value += m_stream.get();
+        while (m_pos < m_end && isNumberChar(*m_pos))
+        {
+            ++m_pos;
+        }
+        if (m_pos < m_end || !more())
+        {
+            break;
+        }
     }
+    m_token.text = std::string_view(m_tokenStart, m_pos - m_tokenStart);
 }
 
-
-void Tokenizer::readUnicodeEscape()
+void Tokenizer::readUnicodeEscape(char*& out)
 {
-    char buf[4];
-
-    m_stream.read(buf, 4);
-    if (m_stream.eof())
+    long long escape = offset() - 1; // the u, where errors are reported
+    if (!ensure(4))
     {
-        m_fail = true;
+        setError(escape);
         return;
     }
 
     // parse hex
-    int value1 = parseHex4(buf);
+    int value1 = parseHex4(m_pos);
     if (value1 < 0) 
     {
-        m_fail = true;
+        setError(escape);
         return;
     }
+    m_pos += 4;
 
     unsigned int value = value1;
 
@@ -199,147 +337,254 @@ void Tokenizer::readUnicodeEscape()
     {
         // the unicode escape was a UTF-16 "high surrogate" (i.e. the first of a UTF-16 surrogate pair).
         // look ahead to see if we have a second unicode escape
-        if (m_stream.get() == '\\')
+        if (ensure(2) && m_pos[0] == '\\' && m_pos[1] == 'u')
         {
-            if (m_stream.get() == 'u')
+            if (!ensure(6))
             {
-                m_stream.read(buf, 4);
-                if (m_stream.eof())
-                {
-                    m_fail = true;
-                    return;
-                }
-
-                int value2 = parseHex4(buf);
-                if (value2 < 0)
-                {
-                    m_fail = true;
-                    return;
-                }
+                setError(offset() + 1);
+                return;
+            }
 
-                if (value2 >= 0xdc00 && value2 <= 0xdfff)
-                {
-                    // decode UTF-16
-                    value = (((value1 - 0xd800) << 10) | (value2 - 0xdc00)) + 0x10000;
-                }
-                else
-                {
-                    // the second escape is not a valid UTF-16 "low surrogate", so it's not a valid UTF-16 pair.
-                    // this is almost definitely a mistake, but is not invalid JSON, so we'll interpret both escapes as UTF-8,
-                    // even though they're not printable characters.
-                    for (int i = 0; i < 6; ++i) { m_stream.unget(); }
-                }
+            int value2 = parseHex4(m_pos + 2);
+            if (value2 < 0)
+            {
+                setError(offset() + 1);
+                return;
             }
-            else
+
+            if (value2 >= 0xdc00 && value2 <= 0xdfff)
             {
-                m_stream.unget();
+                // decode UTF-16
+                value = (((value1 - 0xd800) << 10) | (value2 - 0xdc00)) + 0x10000;
+                m_pos += 6;
             }
+            // otherwise the second escape is not a valid UTF-16 "low surrogate", so it's not a valid UTF-16 pair.
+            // this is almost definitely a mistake, but is not invalid JSON, so we'll interpret both escapes as UTF-8,
+            // even though they're not printable characters.
         }
-        else
+    }
+
+    if (value >= 0xd800 && value <= 0xdfff && m_invalidUtf8 != JsonReader::InvalidUtf8::Accept)
+    {
+        // an unpaired surrogate, which can't be encoded in valid UTF-8
+        if (m_invalidUtf8 == JsonReader::InvalidUtf8::Reject)
         {
-            m_stream.unget();
+            setError(escape);
+            return;
         }
+        value = 0xfffd;
     }
 
-
     // UTF-8 encode
+    char buf[4];
+    size_t length;
     if (value <= 0x7f)
     {
-        m_token.value += (char) value;
+        buf[0] = (char) value;
+        length = 1;
     }
     else if (value <= 0x7ff)
     {
         // 0xxx xxxx xxxx -> 110xxxxx 10xxxxxx  (11 bits -> 16 bits)
-        m_token.value += (char) (0xc0 | (value >> 6));
-        m_token.value += (char) (0x80 | (value & 0x3f));
+        buf[0] = (char) (0xc0 | (value >> 6));
+        buf[1] = (char) (0x80 | (value & 0x3f));
+        length = 2;
     }
     else if (value <= 0xffff)
     {
         // xxxx xxxx xxxx xxxx -> 1110xxxx 10xxxxxx 10xxxxxx (16 bits -> 24 bits)
-        m_token.value += (char) (0xe0 | (value >> 12));
-        m_token.value += (char) (0x80 | ((value >> 6) & 0x3f));
-        m_token.value += (char) (0x80 | (value & 0x3f));
+        buf[0] = (char) (0xe0 | (value >> 12));
+        buf[1] = (char) (0x80 | ((value >> 6) & 0x3f));
+        buf[2] = (char) (0x80 | (value & 0x3f));
+        length = 3;
     }
     else
     {
         // 000x xxxx xxxx xxxx xxxx xxxx -> 11110xxx 10xxxxxx 10xxxxxx 10xxxxxx (21 bits -> 32 bits)
-        m_token.value += (char) (0xf0 | (value >> 18));
-        m_token.value += (char) (0x80 | ((value >> 12) & 0x3f));
-        m_token.value += (char) (0x80 | ((value >> 6) & 0x3f));
-        m_token.value += (char) (0x80 | (value & 0x3f));
+        buf[0] = (char) (0xf0 | (value >> 18));
+        buf[1] = (char) (0x80 | ((value >> 12) & 0x3f));
+        buf[2] = (char) (0x80 | ((value >> 6) & 0x3f));
+        buf[3] = (char) (0x80 | (value & 0x3f));
+        length = 4;
     }
+    append(out, buf, length);
 }
 
 void Tokenizer::readString()
 {
-    char c = 0;
-    m_token.value.clear(); // skip quote
+    // Strings with no escapes are left where they are, in the window. Otherwise, once we reach an
+    // escape, the unescaped string is written in place (in situ), or copied to the scratch buffer.
+    char* out = m_pos; // where the string is written, in situ
+    bool copying = false;
+    m_inPlace = m_inSitu;
 
-    while (!m_fail && !m_stream.eof())
+    // when checking UTF-8, bytes over 0x7f stop the scan too
+    bool checkUtf8 = (m_invalidUtf8 != JsonReader::InvalidUtf8::Accept);
+    unsigned int stopFrom = checkUtf8 ? 0x80 : 0x100;
+
+    for (;;)
     {
-        c = m_stream.get();
-        if (c == '\\')
+        // scan runs of ordinary characters at once, a word at a time and then a byte at a time
+        char* p = m_pos;
+        while (m_end - p >= 8)
         {
-            readEscape();
+            uint64_t word;
+            memcpy(&word, p, sizeof(word));
+            if (hasByte(word, '"') || hasByte(word, '\\') || hasByteLess(word, 0x20) || (checkUtf8 && hasHighByte(word)))
+            {
+                break;
+            }
+            p += 8;
+        }
+        while (p < m_end && *p != '"' && *p != '\\' && (unsigned char) *p >= 0x20 && (unsigned char) *p < stopFrom)
+        {
+            ++p;
         }
-        else if (c >= 0x0 && c <= 0x1f)
+        if (m_inPlace || copying)
         {
-            // check for unescaped U+0000 through U+001F
-            m_fail = true;
+            append(out, m_pos, p - m_pos);
+        }
+        m_pos = p;
+
+        if (m_pos == m_end)
+        {
+            if (!more())
+            {
+                // we hit EOF before the string was closed
+                setError(offset());
+                return;
+            }
+            continue;
+        }
+
+        if ((unsigned char) *m_pos >= stopFrom)
+        {
+            // a UTF-8 sequence; the bytes of a valid one are used as they are
+            ensure(4);
+            int length = utf8Sequence(m_pos, m_end);
+            if (length > 0)
+            {
+                if (m_inPlace || copying)
+                {
+                    append(out, m_pos, length);
+                }
+                m_pos += length;
+            }
+            else
+            {
+                readInvalidUtf8(out, copying);
+                if (m_fail)
+                {
+                    return;
+                }
+            }
+            continue;
         }
-        else if (c == '"')
+
+        char c = *m_pos++;
+        if (c == '"')
         {
             // end of string
             break;
         }
+        else if (c == '\\')
+        {
+            if (!m_inPlace && !copying && !m_checkOnly)
+            {
+                m_scratch.assign(m_tokenStart + 1, m_pos - 1); // everything before the escape
+                copying = true;
+            }
+            readEscape(out);
+            if (m_fail)
+            {
+                return;
+            }
+        }
         else
         {
-            m_token.value += c;
+            // unescaped U+0000 through U+001F
+            setError(offset() - 1);
+            return;
         }
     }
 
-    if (c != '"')
+    if (m_inPlace)
+    {
+        m_token.text = std::string_view(m_tokenStart + 1, out - (m_tokenStart + 1));
+    }
+    else if (copying)
+    {
+        m_token.text = m_scratch;
+    }
+    else
+    {
+        m_token.text = std::string_view(m_tokenStart + 1, m_pos - 1 - (m_tokenStart + 1)); // between the quotes
+    }
+}
+
+// an invalid UTF-8 sequence at m_pos, which fails, or is replaced with U+FFFD
+void Tokenizer::readInvalidUtf8(char*& out, bool& copying)
+{
+    if (m_invalidUtf8 == JsonReader::InvalidUtf8::Reject)
     {
-        // we hit EOF before the string was closed
-        m_fail = true;
+        setError(offset());
+        return;
+    }
+
+    char* invalid = m_pos;
+    m_pos += -utf8Sequence(m_pos, m_end); // the maximal invalid subpart, as Unicode recommends
+    if (m_inPlace && out + k_replacementLength > m_pos)
+    {
+        // the replacement is longer than the bytes it replaces, and there's no room for it, so copy the string
+        m_scratch.assign(m_tokenStart + 1, out);
+        m_inPlace = false;
+        copying = true;
     }
+    else if (!m_inPlace && !copying && !m_checkOnly)
+    {
+        m_scratch.assign(m_tokenStart + 1, invalid); // everything before the invalid sequence
+        copying = true;
+    }
+    append(out, k_replacement, k_replacementLength);
 }
 
-void Tokenizer::readEscape()
+void Tokenizer::readEscape(char*& out)
 {
-    char c = m_stream.get();
+    int c = next();
+    char unescaped;
     switch (c)
     {
         case '"': 
         case '\\':
         case '/':
-            m_token.value += c; 
+            unescaped = (char) c;
             break;
 
         case 'b':
-            m_token.value += '\b';
+            unescaped = '\b';
             break;
         case 'f':
-            m_token.value += '\f';
+            unescaped = '\f';
             break;
         case 'n':
-            m_token.value += '\n';
+            unescaped = '\n';
             break;
         case 'r':
-            m_token.value += '\r';
+            unescaped = '\r';
             break;
         case 't':
-            m_token.value += '\t';
+            unescaped = '\t';
             break;
 
         case 'u': 
-            readUnicodeEscape();
-            break;
+            readUnicodeEscape(out);
+            return;
 
         default:
-            m_fail = true;
-            break;
+            setError(c < 0 ? offset() : offset() - 1); // the end of the input, or the character after the backslash
+            return;
     }
+    append(out, &unescaped, 1);
 }
 
 } // namespace Simpson
@@ -1,39 +1,97 @@
 #pragma once
 
 #include "simpson/src/token.h"
+#include "simpson/jsonreader.h"
+#include "simpson/src/stats.h"
 #include <string>
+#include <vector>
 #include <iostream>
 
-namespace Simpson 
+namespace Simpson
 {
 
+// Splits JSON text into tokens. The text is scanned in a window of memory: either the caller's buffer,
+// or blocks read from a stream.
 class Tokenizer
 {
 public:
     Tokenizer(std::istream&);
 
+    // read from memory; if inSitu is true, strings are unescaped in place, so STRING tokens always refer to
+    // the buffer
+    Tokenizer(const char* data, size_t size);
+    Tokenizer(char* buffer, size_t size, bool inSitu);
+
+    // read the next token; returns false on an error, or at the end of the input (where the token type is END)
     bool advance();
-    bool eof() const;
-    bool fail() const;
+    bool fail() const { return m_fail; }
+    bool inSitu() const { return m_inSitu; }
+
+    // the last STRING was unescaped in place, in situ, so it refers to the buffer; this is true of every
+    // string in situ, unless replacing invalid UTF-8 made it longer, in which case it's in the scratch buffer
+    bool inPlace() const { return m_inPlace; }
+
+    // what to do with strings that aren't valid UTF-8 (see JsonReader::setInvalidUtf8())
+    void setInvalidUtf8(JsonReader::InvalidUtf8 invalidUtf8) { m_invalidUtf8 = invalidUtf8; }
+
+    // if enabled, strings are checked but not unescaped, so the text of a STRING token is as it was in the
+    // input, between the quotes; for checking syntax without using the values (see validate())
+    void setCheckOnly(bool checkOnly) { m_checkOnly = checkOnly; }
+
+    // where the input stops being valid: the first character that's wrong if advance() failed, or else the
+    // start of the current token (or the end of the input, at END)
+    long long errorOffset() const;
 
     int line() const { return m_line; }
-    int column() const { return (int) m_stream.tellg() - m_lineStart - 1; }
-    int pos() const { return (int) m_stream.tellg(); }
+    int column() const { return (int) (offset() - m_lineStart) - 1; }
+    int pos() const { return (int) offset(); }
+
+    // offset of the next unread character in the input
+    long long offset() const { return m_offset + (m_pos - m_begin); }
+
+    void setStats(JsonStats* stats) { m_stats = stats; }
 
     const Token& getToken() { return m_token; }
 
+    // the text of the last token as it was in the input (so a STRING with its quotes, and escapes unchanged),
+    // valid until the next token is read
+    std::string_view tokenText() const { return std::string_view(m_tokenStart, m_pos - m_tokenStart); }
+
 private:
-    std::istream& m_stream;
+    Tokenizer& operator=(const Tokenizer&) = delete;
+    Tokenizer(const Tokenizer&) = delete;
+
+    std::istream* m_stream = nullptr;
+    std::vector<char> m_buffer;     // window for stream input
+    char* m_begin = nullptr;        // window
+    char* m_pos = nullptr;
+    char* m_end = nullptr;
+    long long m_offset = 0;         // offset of the start of the window in the input
+    char* m_tokenStart = nullptr;   // start of the token being read, which is kept in the window
+    std::string m_scratch;          // strings with escapes, if not in situ
+    bool m_inSitu = false;
+    bool m_inPlace = false;         // the current string is being unescaped in place
+    JsonReader::InvalidUtf8 m_invalidUtf8 = JsonReader::InvalidUtf8::Accept;
+    bool m_checkOnly = false;
     bool m_fail = false;
+    long long m_errorOffset = 0;    // if m_fail
     int m_line = 0;
-    int m_lineStart = 1;
+    long long m_lineStart = 0;      // offset of the start of the current line
     Token m_token;
+    JsonStats* m_stats = nullptr;
+
+    bool more();
+    bool ensure(size_t count);
+    int next();
+    void setError(long long offset);
 
-    void readLiteral(const std::string& literalValue);
+    void append(char*& out, const char* chars, size_t count);
+    void readLiteral(const char* literalValue);
     void readNumber();
     void readString();
-    void readEscape();
-    void readUnicodeEscape();
+    void readInvalidUtf8(char*& out, bool& copying);
+    void readEscape(char*& out);
+    void readUnicodeEscape(char*& out);
 };
 
 } // namespace Simpson
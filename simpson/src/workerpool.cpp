@@ -0,0 +1,56 @@
+#include "simpson/src/workerpool.h"
+
+namespace Simpson
+{
+
+WorkerPool::WorkerPool(int threads)
+{
+    m_threads.reserve(threads);
+    for (int i = 0; i < threads; ++i)
+    {
+        m_threads.emplace_back([this]() { work(); });
+    }
+}
+
+WorkerPool::~WorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_wake.notify_all();
+    for (std::thread& thread : m_threads)
+    {
+        thread.join();
+    }
+}
+
+void WorkerPool::run(std::function<void()> job)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_jobs.push_back(std::move(job));
+    }
+    m_wake.notify_one();
+}
+
+void WorkerPool::work()
+{
+    for (;;)
+    {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wake.wait(lock, [this]() { return m_stopping || !m_jobs.empty(); });
+            if (m_jobs.empty())
+            {
+                return; // stopping, with nothing left to do
+            }
+            job = std::move(m_jobs.front());
+            m_jobs.pop_front();
+        }
+        job();
+    }
+}
+
+} // namespace Simpson
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+
+namespace Simpson
+{
+
+// A fixed set of threads that run jobs from a queue, in the order they were queued. The threads are kept
+// until the pool is destroyed, so work can be handed to them without starting new threads each time.
+class WorkerPool
+{
+public:
+    explicit WorkerPool(int threads);
+    ~WorkerPool(); // runs the jobs still queued, then stops the threads
+
+    int threads() const { return (int) m_threads.size(); }
+
+    // queue a job to run on one of the threads; the job must not throw
+    void run(std::function<void()> job);
+
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::deque<std::function<void()>> m_jobs;
+    bool m_stopping = false;
+    std::vector<std::thread> m_threads;
+
+    void work();
+
+    WorkerPool& operator=(const WorkerPool&) = delete;
+    WorkerPool(const WorkerPool&) = delete;
+};
+
+} // namespace Simpson
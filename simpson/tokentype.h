@@ -1,8 +1,9 @@
 #pragma once
 
-namespace Simpson 
+namespace Simpson
 {
 
+// the lexical tokens of JSON text
 enum class TokenType
 {
     STRING,
@@ -15,6 +16,9 @@ enum class TokenType
     OBJECT_END,
     COLON,
     COMMA,
+    END, // not a token; the end of the input
+
+    COUNT // not a token; the number of token types
 };
 
 } // namespace Simpson
@@ -1,6 +1,19 @@
 #include "simpson/jsonvalue.h"
+#include "simpson/cborreader.h"
+#include "simpson/cborwriter.h"
+#include "simpson/msgpackreader.h"
+#include "simpson/msgpackwriter.h"
+#include "simpson/jsonsnapshot.h"
+#include "simpson/jsonreader.h"
+#include "simpson/jsonwriter.h"
+#include "simpson/jsonbinding.h"
+#include "simpson/jsonformatter.h"
+#include "simpson/compressedstream.h"
 #include <fstream>
 #include <sstream>
+#include <cstring>
+#include <algorithm>
+#include <unordered_set>
 
 using namespace Simpson;
 
@@ -10,6 +23,41 @@ using namespace Simpson;
     return 1; \
 }
 
+// types for the binding tests
+namespace BindingTest
+{
+    enum class Color { Red, Green, Blue };
+    SIMPSON_ENUM(Color, { Color::Red, "red" }, { Color::Green, "green" }, { Color::Blue, "blue" })
+
+    enum class Level : uint8_t { Low, High };
+
+    struct Point
+    {
+        double x = 0;
+        double y = 0;
+    };
+    SIMPSON_FIELDS(Point, SIMPSON_FIELD(x), SIMPSON_FIELD(y))
+
+    struct Shape
+    {
+        std::string name;
+        int id = 0;
+        uint16_t count = 0;
+        bool visible = false;
+        Color color = Color::Red;
+        Level level = Level::Low;
+        std::vector<Point> points;
+        std::vector<std::vector<int>> grid;
+        std::optional<std::string> label;
+        std::optional<Point> origin;
+        std::vector<Shape> children;
+    };
+    SIMPSON_FIELDS(Shape,
+        SIMPSON_FIELD(name), SIMPSON_FIELD(id), SIMPSON_FIELD(count), SIMPSON_FIELD(visible),
+        SIMPSON_FIELD(color), SIMPSON_FIELD(level), SIMPSON_FIELD(points), SIMPSON_FIELD(grid),
+        SIMPSON_FIELD(label), SIMPSON_FIELD_NAMED(origin, "org\"in"), SIMPSON_FIELD(children))
+}
+
 int main()
 {
     std::cout << "testing..." << std::endl;
@@ -203,6 +251,1434 @@ int main()
 
     ////////////////////////////////////////
 
+    {
+        // CBOR and MessagePack round trips should be equivalent value
+
+        JsonValue value1;
+        std::ifstream stream("test.json");
+        VERIFY(value1.read(stream));
+
+        std::vector<uint8_t> cbor;
+        CborWriter(cbor).write(value1);
+        JsonValue value2;
+        CborReader cborReader(cbor.data(), cbor.size());
+        VERIFY(cborReader.read(value2));
+        VERIFY(value1 == value2);
+        VERIFY(cborReader.pos() == (int) cbor.size());
+
+        std::stringstream msgpack;
+        MsgPackWriter(msgpack).write(value1);
+        JsonValue value3;
+        VERIFY(MsgPackReader(msgpack).read(value3));
+        VERIFY(value1 == value3);
+    }
+
+    ////////////////////////////////////////
+
+    {
+        // numbers are stored as integers or single-precision floats when exact
+        std::vector<uint8_t> cbor;
+        CborWriter writer(cbor);
+        writer.write(1);
+        writer.write(-500);
+        writer.write(1.5);
+        writer.write(1.1);
+        const uint8_t expected[] = { 0x01, 0x39, 0x01, 0xf3, 0xfa, 0x3f, 0xc0, 0x00, 0x00, 0xfb, 0x3f, 0xf1, 0x99, 0x99, 0x99, 0x99, 0x99, 0x9a };
+        VERIFY(cbor == std::vector<uint8_t>(expected, expected + sizeof(expected)));
+
+        std::vector<uint8_t> msgpack;
+        MsgPackWriter(msgpack).write(-33);
+        VERIFY(msgpack.size() == 2 && msgpack[0] == 0xd0);
+
+        // indefinite-length items, half floats and byte strings (examples from RFC 8949 appendix A)
+        const uint8_t input[] = { 0xbf, 0x61, 0x61, 0x9f, 0xf9, 0x3e, 0x00, 0xff, 0x61, 0x62, 0x43, 0x01, 0x02, 0x03, 0xff };
+        JsonValue value;
+        VERIFY(CborReader(input, sizeof(input)).read(value));
+        VERIFY(value["a"][0] == 1.5);
+        VERIFY(value["b"] == "AQID");
+
+        // map keys out of order, and repeated (the last one wins, as in JSON)
+        const uint8_t cborMap[] = { 0xa3, 0x61, 0x62, 0x01, 0x61, 0x61, 0x02, 0x61, 0x62, 0x03 };
+        VERIFY(CborReader(cborMap, sizeof(cborMap)).read(value));
+        VERIFY(value.size() == 2 && value.key(0) == "a" && value["a"] == 2 && value["b"] == 3);
+        const uint8_t msgpackMap[] = { 0x83, 0xa1, 0x62, 0x01, 0xa1, 0x61, 0x02, 0xa1, 0x62, 0x03 };
+        VERIFY(MsgPackReader(msgpackMap, sizeof(msgpackMap)).read(value));
+        VERIFY(value.size() == 2 && value.key(0) == "a" && value["a"] == 2 && value["b"] == 3);
+
+        // truncated input, and break outside an indefinite-length item
+        VERIFY(!CborReader(input, sizeof(input)-1).read(value));
+        const uint8_t strayBreak[] = { 0x9f, 0x81, 0xff, 0xff };
+        VERIFY(!CborReader(strayBreak, sizeof(strayBreak)).read(value));
+    }
+
+    ////////////////////////////////////////
+
+    {
+        // deeply nested binary input is read without recursion, up to the maximum depth
+        const int depth = 100000;
+        std::vector<uint8_t> cbor(depth, 0x81); // one-element arrays
+        cbor.push_back(0x01);
+        std::vector<uint8_t> msgpack(depth, 0x91);
+        msgpack.push_back(0x01);
+
+        JsonValue value;
+        CborReader limitedCbor(cbor.data(), cbor.size());
+        VERIFY(limitedCbor.maxDepth() == JsonReader::k_defaultMaxDepth);
+        VERIFY(!limitedCbor.read(value));
+        MsgPackReader limitedMsgPack(msgpack.data(), msgpack.size());
+        VERIFY(limitedMsgPack.maxDepth() == JsonReader::k_defaultMaxDepth);
+        VERIFY(!limitedMsgPack.read(value));
+
+        CborReader cborReader(cbor.data(), cbor.size());
+        cborReader.setMaxDepth(0);
+        VERIFY(cborReader.read(value));
+        JsonValue other;
+        MsgPackReader msgPackReader(msgpack.data(), msgpack.size());
+        msgPackReader.setMaxDepth(depth);
+        VERIFY(msgPackReader.read(other));
+        VERIFY(other == value);
+
+        int levels = 0;
+        for (const JsonValue* v = &value; v->isArray(); v = &v->get(0))
+        {
+            VERIFY(v->size() == 1);
+            ++levels;
+        }
+        VERIFY(levels == depth);
+
+        // and written without recursion
+        std::vector<uint8_t> written;
+        CborWriter(written).write(value);
+        VERIFY(written == cbor);
+        written.clear();
+        MsgPackWriter(written).write(value);
+        VERIFY(written == msgpack);
+
+        // one level too deep, and input that ends early
+        CborReader shallowReader(cbor.data(), cbor.size());
+        shallowReader.setMaxDepth(depth - 1);
+        VERIFY(!shallowReader.read(value));
+        MsgPackReader truncatedReader(msgpack.data(), msgpack.size() - 1);
+        truncatedReader.setMaxDepth(0);
+        VERIFY(!truncatedReader.read(value));
+        const uint8_t unterminated[] = { 0xbf, 0x61, 0x61, 0x9f, 0x01 };
+        VERIFY(!CborReader(unterminated, sizeof(unterminated)).read(value));
+    }
+
+    ////////////////////////////////////////
+
+    {
+        // snapshot can be used in place, or converted back to an equivalent value
+
+        JsonValue value1;
+        {
+            std::ifstream stream("test.json");
+            VERIFY(value1.read(stream));
+        }
+
+        std::vector<uint8_t> buffer;
+        JsonSnapshot::write(value1, buffer);
+        JsonSnapshot snapshot(buffer.data(), buffer.size());
+        VERIFY(snapshot.isValid());
+        JsonSnapshotValue root = snapshot.root();
+        VERIFY(root.isArray());
+        VERIFY(root.size() == value1.size());
+        VERIFY(std::string(root[1].string()) == "hello\"");
+        VERIFY(root[14].number() == 1234.56);
+        VERIFY(root[28]["a"].number() == 1);
+        VERIFY(root[28]["b"].isInvalid());
+        VERIFY(root[29].contains("b"));
+        VERIFY(root[99]["x"][0].isInvalid());
+        VERIFY(root.toValue() == value1);
+
+        // keys are looked up as in a JsonValue
+        static const JsonKey k_a("a");
+        std::string b = "b";
+        VERIFY(root[28][k_a].number() == 1 && root[28].get(k_a).number() == 1 && root[28][k_a].number() == value1[28][k_a].number());
+        VERIFY(root[29][k_a].isInvalid() && root[29].contains(std::string_view(b)) && root[29].get(b).isValid());
+
+        // other versions of the format aren't read
+        std::vector<uint8_t> otherVersion = buffer;
+        otherVersion[4] = 2;
+        VERIFY(JsonSnapshot(otherVersion.data(), otherVersion.size()).root().isInvalid());
+
+        {
+            std::ofstream stream("test_out.snapshot", std::ios::binary);
+            JsonSnapshot::write(value1, stream);
+        }
+        JsonSnapshot mapped;
+        VERIFY(mapped.open("test_out.snapshot"));
+        VERIFY(mapped.root().toValue() == value1);
+
+        buffer[0] = 'X';
+        VERIFY(JsonSnapshot(buffer.data(), buffer.size()).root().isInvalid());
+    }
+
+    ////////////////////////////////////////
+
+    {
+        // copies share storage until one of them is modified
+        JsonValue a;
+        a.set("s", "hello");
+        a.set("list", JsonValue(JsonValue::Type::Array));
+        a["list"].append(1);
+
+        JsonValue b = a;
+        const JsonValue& constA = a;
+        const JsonValue& constB = b;
+        VERIFY(&constA["s"].string() == &constB["s"].string());
+
+        b["list"].append(2);
+        VERIFY(a["list"].size() == 1);
+        VERIFY(b["list"].size() == 2);
+        VERIFY(&constA["s"].string() == &constB["s"].string());
+        VERIFY(a != b);
+
+        b["list"].remove(1);
+        VERIFY(a == b);
+
+        a = a["list"]; // assign from a value owned by the target
+        VERIFY(a.isArray() && a.size() == 1);
+
+        JsonValue c = std::move(b);
+        VERIFY(b.isInvalid());
+        VERIFY(c["list"].size() == 1);
+        c.clear();
+        VERIFY(c.size() == 0);
+
+        // a reference from a non-const accessor, modified after its container is copied, doesn't change the copy
+        auto parse = [](const char* text)
+        {
+            JsonValue value;
+            std::istringstream stream(text);
+            value.read(stream);
+            return value;
+        };
+        JsonValue d = parse("{\"x\": 1, \"inner\": {\"y\": [2]}}");
+        JsonValue& x = d["x"];
+        JsonValue& y = d["inner"]["y"];
+        JsonValue e = d;
+        JsonValue f;
+        f = d;
+        x = 10;
+        y.append(3);
+        VERIFY(d == parse("{\"x\": 10, \"inner\": {\"y\": [2, 3]}}"));
+        VERIFY(e == parse("{\"x\": 1, \"inner\": {\"y\": [2]}}"));
+        VERIFY(f == e);
+        JsonValue g = e; // containers nobody holds references into are still shared
+        VERIFY(&static_cast<const JsonValue&>(g)["inner"] == &static_cast<const JsonValue&>(e)["inner"]);
+    }
+
+    ////////////////////////////////////////
+
+#if SIMPSON_ENABLE_STATS
+    {
+        // statistics collected by reader and writer, and passed to the hook for each value
+        struct Hook : public JsonStatsHook
+        {
+            int reads = 0;
+            int failures = 0;
+            int writes = 0;
+            uint64_t lastBytes = 0;
+            void onRead(const JsonStats& stats, bool success) override { ++reads; failures += !success; lastBytes = stats.bytes; }
+            void onWrite(const JsonStats&) override { ++writes; }
+        } hook;
+
+        JsonStats stats;
+        stats.setHook(&hook);
+
+        const char* texts[] = { "{\"a\": [1, 2, true, null], \"bc\": \"x\\ny\"}", "[[[]]]", "[1," };
+        for (const char* text : texts)
+        {
+            std::istringstream stream(text);
+            JsonReader reader(stream);
+            reader.setStats(&stats);
+            JsonValue value;
+            VERIFY(reader.read(value) == (text != texts[2]));
+            VERIFY(hook.lastBytes == strlen(text));
+        }
+        VERIFY(hook.reads == 3 && hook.failures == 1);
+        VERIFY(stats.tokens(TokenType::OBJECT_START) == 1);
+        VERIFY(stats.tokens(TokenType::ARRAY_START) == 5);
+        VERIFY(stats.tokens(TokenType::NUMBER) == 3);
+        VERIFY(stats.tokens(TokenType::COMMA) == 5);
+        VERIFY(stats.values(JsonValue::Type::Number) == 3);
+        VERIFY(stats.values(JsonValue::Type::String) == 1);
+        VERIFY(stats.values(JsonValue::Type::Array) == 5);
+        VERIFY(stats.maxDepth == 3);
+        VERIFY(stats.stringBytes == 6); // "a", "bc", "x\ny"
+        VERIFY(stats.estimatedAllocations > 0);
+        VERIFY(stats.seconds(JsonStats::Phase::Read) > 0);
+
+        stats.reset();
+        VERIFY(stats.bytes == 0 && stats.maxDepth == 0);
+
+        std::ostringstream out;
+        JsonWriter writer(out);
+        writer.setStats(&stats);
+        writer.setIndent(0);
+        JsonValue array(JsonValue::Type::Array);
+        array.append("abc");
+        array.append(JsonValue(JsonValue::Type::Object));
+        writer.write(array);
+        VERIFY(hook.writes == 1);
+        VERIFY(stats.bytes == out.str().size());
+        VERIFY(stats.values(JsonValue::Type::String) == 1);
+        VERIFY(stats.maxDepth == 2);
+    }
+#endif
+
+    ////////////////////////////////////////
+
+    {
+        // values read with a memory resource allocate their storage from it, including when copied on write
+        struct CountingResource : public std::pmr::memory_resource
+        {
+            int allocated = 0;
+            int live = 0;
+            size_t bytes = 0;
+            void* do_allocate(size_t n, size_t alignment) override { ++allocated; ++live; bytes += n; return std::pmr::new_delete_resource()->allocate(n, alignment); }
+            void do_deallocate(void* p, size_t n, size_t alignment) override { --live; std::pmr::new_delete_resource()->deallocate(p, n, alignment); }
+            bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+        } resource;
+
+        {
+            std::istringstream stream("{\"a\": [1, 2, \"three\"], \"b\": {\"c\": null}}");
+            JsonReader reader(stream);
+            reader.setResource(&resource);
+            JsonValue value;
+            VERIFY(reader.read(value));
+            VERIFY(value.resource() == &resource);
+            VERIFY(value["a"].resource() == &resource);
+            VERIFY(value["a"][2].resource() == &resource);
+            VERIFY(value["a"][0].resource() == std::pmr::get_default_resource());
+            int allocated = resource.allocated;
+            VERIFY(allocated > 0);
+
+            JsonValue copy = value;
+            copy["b"].set("d", true);
+            VERIFY(resource.allocated > allocated);
+            VERIFY(copy["b"].resource() == &resource);
+            VERIFY(!value["b"].contains("d"));
+
+            copy.clear();
+            VERIFY(copy.resource() == &resource);
+        }
+        VERIFY(resource.live == 0);
+
+        std::pmr::monotonic_buffer_resource arena;
+        JsonValue value(JsonValue::Type::Array, &arena);
+        value.append(JsonValue("hello", &arena));
+        VERIFY(value[0].resource() == &arena);
+
+        // strings and keys, too: none of a string-heavy value goes to the default resource, even when copied
+        std::string text = "{";
+        size_t textBytes = 0;
+        for (int i = 0; i < 50; ++i)
+        {
+            std::string key = "a key long enough not to fit in the string " + std::to_string(i);
+            std::string string = "and a string value that is also too long for that " + std::to_string(i);
+            text += (i ? ", \"" : "\"") + key + "\": [\"" + string + "\"]";
+            textBytes += key.size() + string.size();
+        }
+        text += "}";
+
+        CountingResource defaultResource;
+        std::pmr::memory_resource* previous = std::pmr::set_default_resource(&defaultResource);
+        {
+            JsonReader reader(text.data(), text.size());
+            reader.setResource(&resource);
+            JsonValue strings;
+            VERIFY(reader.read(strings) && strings.size() == 50);
+            VERIFY(resource.bytes > textBytes);
+            VERIFY(strings.key(0).get_allocator().resource() == &resource);
+            VERIFY(strings[strings.key(0)][0].string().get_allocator().resource() == &resource);
+
+            JsonValue copy = strings;
+            copy.set("another key that is long enough not to fit", JsonValue("x", &resource));
+            copy[copy.key(1)].append(JsonValue("another string, long enough not to fit", &resource));
+            VERIFY(copy.size() == 51 && strings.size() == 50);
+
+            std::vector<char> buffer(text.begin(), text.end());
+            JsonReader inSitu(buffer.data(), buffer.size(), JsonReader::InSitu());
+            inSitu.setResource(&resource);
+            VERIFY(inSitu.read(strings));
+            VERIFY(strings[strings.key(0)][0].string().get_allocator().resource() == &resource); // copied on demand
+        }
+        std::pmr::set_default_resource(previous);
+        VERIFY(defaultResource.bytes == 0);
+        VERIFY(resource.live == 0);
+    }
+
+    ////////////////////////////////////////
+
+    {
+        // integers are stored exactly, and written back unchanged
+        std::istringstream stream("[9007199254740993, -9223372036854775808, 18446744073709551615, 18446744073709551616, 1.5, 1e2, -0, 42]");
+        JsonValue value;
+        VERIFY(value.read(stream));
+        VERIFY(value[0].isInteger() && value[0].int64() == 9007199254740993LL);
+        VERIFY(value[1].isInteger() && value[1].int64() == INT64_MIN);
+        VERIFY(value[2].isInteger() && value[2].uint64() == UINT64_MAX);
+        VERIFY(!value[3].isInteger() && value[3].number() == 18446744073709551616.0);
+        VERIFY(!value[4].isInteger() && !value[5].isInteger() && !value[6].isInteger());
+        VERIFY(value[5].int64() == 100);
+        VERIFY(value[7].isInteger() && value[7].number() == 42 && value[7].numberInt() == 42);
+
+        std::ostringstream out;
+        value.write(out, true);
+        VERIFY(out.str() == "[\n9007199254740993,\n-9223372036854775808,\n18446744073709551615,\n1.8446744073709552e+19,\n1.5,\n100,\n-0,\n42\n]");
+
+        VERIFY(JsonValue(1) == JsonValue(1.0));
+        VERIFY(JsonValue(9007199254740993LL) != JsonValue(9007199254740992.0));
+        VERIFY(JsonValue(UINT64_MAX) == value[2]);
+        VERIFY(JsonValue(-1).int64(0) == -1);
+        VERIFY(JsonValue("x").int64(7) == 7);
+
+        bool threw = false;
+        try { JsonValue(-1).uint64(); } catch (const std::runtime_error&) { threw = true; }
+        VERIFY(threw);
+        threw = false;
+        try { value[2].int64(); } catch (const std::runtime_error&) { threw = true; }
+        VERIFY(threw);
+
+        // binary formats and snapshots keep integers exact
+        std::vector<uint8_t> buffer;
+        CborWriter(buffer).write(value);
+        JsonValue cbor;
+        VERIFY(CborReader(buffer.data(), buffer.size()).read(cbor));
+        VERIFY(cbor == value && cbor[0].isInteger() && cbor[2].uint64() == UINT64_MAX);
+        buffer.clear();
+        MsgPackWriter(buffer).write(value);
+        JsonValue msgpack;
+        VERIFY(MsgPackReader(buffer.data(), buffer.size()).read(msgpack));
+        VERIFY(msgpack == value && msgpack[1].int64() == INT64_MIN);
+        buffer.clear();
+        JsonSnapshot::write(value, buffer);
+        JsonSnapshot snapshot(buffer.data(), buffer.size());
+        VERIFY(snapshot.root()[0].isInteger() && snapshot.root()[0].int64() == 9007199254740993LL);
+        VERIFY(snapshot.root()[2].uint64() == UINT64_MAX);
+        VERIFY(snapshot.root().toValue() == value);
+
+        // number syntax is checked
+        const char* invalid[] = { "01", "1.", ".5", "-", "+1", "1e", "1e+", "--1", "1.5.2", "1-2" };
+        for (const char* text : invalid)
+        {
+            std::istringstream stream(text);
+            JsonValue number;
+            VERIFY(!number.read(stream));
+        }
+    }
+
+    ////////////////////////////////////////
+
+    {
+        // raw numbers keep their text, and are converted only when accessed
+        std::istringstream stream("[1.10, 12345678901234567890123, -0.0, 1e2, 7]");
+        JsonReader reader(stream);
+        reader.setRawNumbers(true);
+        JsonValue value;
+        VERIFY(reader.read(value));
+        VERIFY(value[0].isNumber() && value[0].isRawNumber());
+        VERIFY(value[0].numberText() == "1.10");
+        VERIFY(value[0].number() == 1.1);
+        VERIFY(value[0] == JsonValue(1.1));
+        VERIFY(value[3].int64() == 100 && !value[3].isInteger());
+        VERIFY(value[4].isInteger() && value[4] == JsonValue(7));
+
+        std::ostringstream out;
+        value.write(out, true);
+        VERIFY(out.str() == "[\n1.10,\n12345678901234567890123,\n-0.0,\n1e2,\n7\n]");
+
+        JsonValue copy = value;
+        copy.set(0, 2.5);
+        VERIFY(value[0].numberText() == "1.10");
+
+        std::istringstream invalid("[1.]");
+        JsonReader invalidReader(invalid);
+        invalidReader.setRawNumbers(true);
+        VERIFY(!invalidReader.read(value));
+    }
+
+    ////////////////////////////////////////
+
+    {
+        // in-situ reading unescapes strings in the buffer, and refers to them
+        char buffer[] = "{ \"a\": \"plain\", \"b\": \"tab\\there \\u00e9 \\ud83d\\ude00\", \"c\\n\": [\"x\", 1] }";
+        JsonReader reader(buffer, sizeof(buffer) - 1, JsonReader::InSitu());
+        JsonValue value;
+        VERIFY(reader.read(value));
+        VERIFY(value["a"].stringView() == "plain");
+        VERIFY(value["a"].stringView().data() > buffer && value["a"].stringView().data() < buffer + sizeof(buffer));
+        VERIFY(value["b"].stringView() == "tab\there \xc3\xa9 \xf0\x9f\x98\x80");
+        VERIFY(value["c\n"][0].string() == "x");
+
+        // string() copies, once; the copy stays valid with the value
+        const std::pmr::string& b = value["b"].string();
+        VERIFY(&b == &value["b"].string());
+        VERIFY(b == "tab\there \xc3\xa9 \xf0\x9f\x98\x80");
+
+        // buffer strings compare and write like any other string
+        JsonValue copy = value;
+        VERIFY(copy == value);
+        VERIFY(value["a"] == JsonValue("plain"));
+        std::ostringstream out;
+        value.write(out, true);
+        std::istringstream in(out.str());
+        JsonValue reread;
+        VERIFY(reread.read(in) && reread == value);
+
+        // reading from constant memory copies
+        const char* text = "[\"a\\\"b\", 2]";
+        JsonReader memoryReader(text, strlen(text));
+        VERIFY(memoryReader.read(value));
+        VERIFY(value[0].string() == "a\"b" && value[1].int64() == 2);
+
+        // errors are still detected
+        char invalid[] = "[\"abc";
+        JsonReader invalidReader(invalid, sizeof(invalid) - 1, JsonReader::InSitu());
+        VERIFY(!invalidReader.read(value));
+    }
+
+    ////////////////////////////////////////
+
+    {
+        // strings longer than the stream reader's buffer, with escapes across its boundaries
+        std::string text = "[\"";
+        std::string expected;
+        for (int i = 0; i < 100000; ++i)
+        {
+            text += (i % 7 == 0) ? "\\u00e9" : "x";
+            expected += (i % 7 == 0) ? "\xc3\xa9" : "x";
+        }
+        text += "\", tru]";
+        std::istringstream stream(text);
+        JsonValue value;
+        VERIFY(!value.read(stream)); // truncated literal
+
+        text.replace(text.size() - 4, 3, "true");
+        std::istringstream stream2(text);
+        VERIFY(value.read(stream2));
+        VERIFY(value[0].stringView() == expected && value[1].boolean());
+    }
+
+    ////////////////////////////////////////
+
+    {
+        // tokens refer to the stream reader's buffer, including tokens that span its blocks
+        std::string text = "[\"" + std::string(150000, 'y') + "\"";
+        for (int i = 0; i < 20000; ++i)
+        {
+            text += (i % 3 == 0) ? ", -12345.678e-3" : (i % 3 == 1) ? ", \"abc\\tdef\"" : ", true";
+        }
+        text += "]";
+        std::istringstream stream(text);
+        JsonValue value;
+        VERIFY(value.read(stream));
+        JsonReader memoryReader(text.data(), text.size());
+        JsonValue memoryValue;
+        VERIFY(memoryReader.read(memoryValue));
+        VERIFY(value == memoryValue);
+        VERIFY(value.size() == 20001 && value[0].string().size() == 150000);
+        VERIFY(value[1].number() == -12.345678 && value[2].string() == "abc\tdef" && value[3].boolean());
+        VERIFY(value[20000] == memoryValue[20000]);
+    }
+
+    ////////////////////////////////////////
+
+    {
+        // deeply nested values are read, compared, written and destroyed without recursion
+        const int depth = 100000;
+        std::string text;
+        for (int i = 0; i < depth; ++i)
+        {
+            text += (i % 2 == 0) ? "[" : "{\"a\":";
+        }
+        text += "1";
+        for (int i = depth - 1; i >= 0; --i)
+        {
+            text += (i % 2 == 0) ? "]" : "}";
+        }
+
+        JsonValue value;
+        JsonReader limited(text.data(), text.size());
+        VERIFY(limited.maxDepth() == JsonReader::k_defaultMaxDepth);
+        VERIFY(!limited.read(value));
+
+        JsonReader reader(text.data(), text.size());
+        reader.setMaxDepth(0);
+        VERIFY(reader.read(value));
+        JsonValue copy = value;
+        copy[0]["a"][0].set("a", 2); // copies only the path to the change
+        VERIFY(copy != value);
+        copy = value;
+        VERIFY(copy == value);
+
+        JsonValue other;
+        JsonReader otherReader(text.data(), text.size());
+        otherReader.setMaxDepth(depth);
+        VERIFY(otherReader.read(other));
+        VERIFY(other == value);
+
+        std::ostringstream out;
+        JsonWriter writer(out);
+        writer.setIndent(0);
+        writer.write(value);
+        std::string written = out.str();
+        written.erase(std::remove(written.begin(), written.end(), '\n'), written.end());
+        written.erase(std::remove(written.begin(), written.end(), ' '), written.end());
+        VERIFY(written == text);
+
+        std::vector<uint8_t> snapshot;
+        JsonSnapshot::write(value, snapshot);
+        VERIFY(JsonSnapshot(snapshot.data(), snapshot.size()).root().toValue() == value);
+
+        // a corrupt snapshot whose first array contains itself
+        memcpy(&snapshot[32], &snapshot[20], 4);
+        bool threw = false;
+        try { JsonSnapshot(snapshot.data(), snapshot.size()).root().toValue(); } catch (const std::runtime_error&) { threw = true; }
+        VERIFY(threw);
+
+        value = JsonValue();
+        VERIFY(copy == other);
+    }
+
+    ////////////////////////////////////////
+
+    {
+        // values are read one at a time, so a stream can hold several
+        std::istringstream stream("1 [2, {\"x\": 3}] \"four\" {} x");
+        JsonReader reader(stream);
+        JsonValue value;
+        VERIFY(reader.read(value) && value == JsonValue(1));
+        VERIFY(reader.read(value) && value[1]["x"] == JsonValue(3));
+        VERIFY(reader.read(value) && value.string() == "four");
+        VERIFY(reader.read(value) && value.isObject() && value.size() == 0);
+        VERIFY(!reader.read(value));
+
+        const char* invalid[] = { "[1,]", "[1 2]", "{\"a\" 1}", "{\"a\": 1,}", "{1: 2}", "[1}", "{\"a\": 1]", "]", "" };
+        for (const char* text : invalid)
+        {
+            JsonReader invalidReader(text, strlen(text));
+            VERIFY(!invalidReader.read(value));
+        }
+    }
+
+    ////////////////////////////////////////
+
+    {
+        // keys as string_views, or pointers and lengths, including keys that aren't null-terminated
+        JsonValue value;
+        const char* keys = "alphabetagamma";
+        value.set(std::string_view(keys, 5), 1);
+        value.set({ keys + 5, 4 }, 2);
+        value.set(std::string("gamma"), 3);
+        value.set(std::string_view("nul\0key", 7), 4);
+        VERIFY(value.size() == 4);
+        VERIFY(value["alpha"] == JsonValue(1));
+        VERIFY(value.get({ keys + 5, 4 }) == JsonValue(2));
+        VERIFY(value[std::string_view(keys + 9)] == JsonValue(3));
+        VERIFY(value.contains(std::string_view("nul\0key", 7)) && !value.contains("nul"));
+        VERIFY(value.key(3) == std::string_view("nul\0key", 7));
+
+        value.set(std::string_view(keys, 5), 5); // replaces
+        VERIFY(value.size() == 4 && value["alpha"] == JsonValue(5));
+        value.remove(std::string_view(keys, 5));
+        value.remove("missing");
+        VERIFY(value.size() == 3 && !value.contains("alpha"));
+        VERIFY(value[std::string_view(keys, 5)].isInvalid());
+    }
+
+    ////////////////////////////////////////
+
+    {
+        // precomputed keys
+        static constexpr JsonKey k_id("id");
+        static const JsonKey k_name(std::string_view("name"));
+        VERIFY(k_id.size() == 2 && k_id.hash() == JsonKey::hash("id"));
+
+        std::istringstream stream("[{\"id\": 1, \"name\": \"a\"}, {\"id\": 2, \"name\": \"b\"}, {\"name\": \"c\", \"extra\": true, \"id\": 3}, {\"name\": \"d\"}]");
+        JsonValue records;
+        VERIFY(records.read(stream));
+        VERIFY(records[0][k_id] == JsonValue(1) && records[0][k_name].string() == "a");
+        VERIFY(records[1][k_id] == JsonValue(2) && records[1][k_name].string() == "b");
+        VERIFY(records[2].get(k_id) == JsonValue(3) && records[2][k_name].string() == "c"); // different layout
+        VERIFY(records[3][k_id].isInvalid() && records[3][k_name].string() == "d");
+        VERIFY(records[4][k_id].isInvalid());
+        bool threw = false;
+        try { records[3].get(k_id); } catch (std::exception&) { threw = true; }
+        VERIFY(threw);
+
+        // modifying through a key
+        records[0][k_name] = "z";
+        VERIFY(records[0]["name"].string() == "z");
+
+        // keys are read in any order, and kept sorted; the last of duplicate keys wins
+        std::istringstream unsorted("{\"c\": 1, \"a\": 2, \"b\": 3, \"a\": 4}");
+        JsonValue object;
+        VERIFY(object.read(unsorted));
+        VERIFY(object.size() == 3 && object.key(0) == "a" && object.key(1) == "b" && object.key(2) == "c");
+        VERIFY(object["a"] == JsonValue(4));
+    }
+
+    ////////////////////////////////////////
+
+    {
+        // decoding into structs
+        using namespace BindingTest;
+        std::string text = "{\"name\": \"tri\\nangle\", \"id\": -3, \"count\": 2e2, \"visible\": true, \"color\": \"blue\", \"level\": 1, "
+            "\"unknown\": [1, {\"a\": [[], {}], \"b\": null}, \"x\"], \"points\": [{\"x\": 1, \"y\": 2.5}, {\"y\": -1, \"z\": 0}], "
+            "\"grid\": [[1, 2], [], [3]], \"label\": null, \"org\\\"in\": {\"x\": 7}, \"children\": [{\"name\": \"child\", \"children\": []}]}";
+        Shape shape = decode<Shape>(text);
+        VERIFY(shape.name == "tri\nangle" && shape.id == -3 && shape.count == 200 && shape.visible);
+        VERIFY(shape.color == Color::Blue && shape.level == Level::High);
+        VERIFY(shape.points.size() == 2 && shape.points[0].x == 1 && shape.points[0].y == 2.5);
+        VERIFY(shape.points[1].x == 0 && shape.points[1].y == -1); // missing field keeps its value
+        VERIFY(shape.grid.size() == 3 && shape.grid[0] == std::vector<int>({ 1, 2 }) && shape.grid[1].empty() && shape.grid[2][0] == 3);
+        VERIFY(!shape.label && shape.origin && shape.origin->x == 7);
+        VERIFY(shape.children.size() == 1 && shape.children[0].name == "child");
+
+        Point point;
+        VERIFY(decode(" {\"y\": 3} ", 10, point) && point.y == 3);
+        std::vector<int> numbers;
+        VERIFY(decode("[1, 2, 3]", 9, numbers) && numbers.size() == 3);
+
+        // invalid JSON, or values of the wrong type or out of range
+        const char* invalid[] = {
+            "{\"x\": 1", "{\"x\": 1,}", "{\"x\" 1}", "{\"x\": \"1\"}", "{\"x\": 1} 2", "[1]", "",
+            "{\"z\": [1 2]}", "{\"z\": {1: 2}}", "{\"z\": [}", "{\"x\": 1, \"z\": tru}" };
+        for (const char* s : invalid)
+        {
+            VERIFY(!decode(s, strlen(s), point));
+        }
+        Shape s;
+        VERIFY(!decode("{\"count\": 70000}", 16, s));
+        VERIFY(!decode("{\"id\": 1.5}", 11, s));
+        VERIFY(!decode("{\"color\": \"pink\"}", 17, s));
+        VERIFY(!decode("{\"visible\": 1}", 14, s));
+        bool threw = false;
+        try { decode<Point>("[]"); } catch (std::runtime_error&) { threw = true; }
+        VERIFY(threw);
+
+        // deep nesting fails cleanly
+        std::string deep;
+        for (int i = 0; i < 2000; ++i) { deep += "{\"children\": ["; }
+        VERIFY(!decode(deep.data(), deep.size(), s));
+    }
+
+    ////////////////////////////////////////
+
+    {
+        // encoding structs
+        using namespace BindingTest;
+        Point point;
+        point.x = 0.1;
+        point.y = -2;
+        VERIFY(encode(point) == "{\"x\":0.1,\"y\":-2}");
+
+        Shape shape;
+        shape.name = "a\"b\\c\n\x01";
+        shape.id = -7;
+        shape.count = 65535;
+        shape.color = Color::Green;
+        shape.level = Level::High;
+        shape.points = { point, Point() };
+        shape.grid = { { 1 }, {} };
+        shape.origin = Point();
+        shape.children.resize(1);
+        std::string text = encode(shape);
+        VERIFY(text == "{\"name\":\"a\\\"b\\\\c\\n\\u0001\",\"id\":-7,\"count\":65535,\"visible\":false,\"color\":\"green\",\"level\":1,"
+            "\"points\":[{\"x\":0.1,\"y\":-2},{\"x\":0,\"y\":0}],\"grid\":[[1],[]],\"label\":null,\"org\\\"in\":{\"x\":0,\"y\":0},"
+            "\"children\":[{\"name\":\"\",\"id\":0,\"count\":0,\"visible\":false,\"color\":\"red\",\"level\":0,\"points\":[],\"grid\":[],"
+            "\"label\":null,\"org\\\"in\":null,\"children\":[]}]}");
+
+        // round trip, through the reader too
+        Shape copy = decode<Shape>(text);
+        VERIFY(encode(copy) == text);
+        JsonValue value;
+        std::istringstream stream(text);
+        VERIFY(value.read(stream) && value["name"].stringView() == shape.name && value["org\"in"]["y"] == JsonValue(0));
+
+        // numbers round trip exactly; non-finite ones are null
+        std::vector<double> numbers = { 1e300, -1.5e-300, 0.30000000000000004, 123456789012345678.0, std::numeric_limits<double>::infinity() };
+        std::string numberText = encode(numbers);
+        VERIFY(numberText.substr(numberText.size() - 6) == ",null]");
+        numbers.pop_back();
+        VERIFY(decode<std::vector<double>>(encode(numbers)) == numbers);
+        std::vector<int64_t> integers = { INT64_MIN, INT64_MAX, 0 };
+        VERIFY(decode<std::vector<int64_t>>(encode(integers)) == integers);
+
+        std::ostringstream out;
+        encode(std::vector<bool>({ true, false }), out);
+        VERIFY(out.str() == "[true,false]");
+    }
+
+    ////////////////////////////////////////
+
+    {
+        // packed arrays
+        std::string text = "{\"d\": [";
+        for (int i = 0; i < 40; ++i) { text += (i ? ", " : "") + std::to_string(i) + ".5"; }
+        text += "], \"i\": [";
+        for (int i = 0; i < 40; ++i) { text += (i ? ", " : "") + std::to_string(i - 20); }
+        text += "], \"b\": [";
+        for (int i = 0; i < 40; ++i) { text += (i ? ", " : "") + std::string(i % 3 ? "true" : "false"); }
+        text += "], \"mixed\": [1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18.5], \"short\": [1, 2]}";
+
+        JsonValue value;
+        JsonReader reader(text.data(), text.size());
+        VERIFY(reader.read(value));
+        const JsonValue& v = value;
+        VERIFY(v["d"].isPacked() && v["i"].isPacked() && v["b"].isPacked());
+        VERIFY(!v["mixed"].isPacked() && !v["short"].isPacked() && v["mixed"].size() == 18);
+        VERIFY(v["d"].doubles().size() == 40 && v["d"].integers().empty() && v["short"].doubles().empty());
+        double sum = 0;
+        for (double d : v["d"].doubles()) { sum += d; }
+        VERIFY(sum == 800);
+        VERIFY(v["i"].integers()[0] == -20 && v["i"].integers()[39] == 19);
+        VERIFY(v["d"][1].number() == 1.5 && v["d"].get(1).number() == 1.5 && v["d"][40].isInvalid());
+        VERIFY(v["i"][2].isInteger() && v["i"][2].int64() == -18 && v["b"][0].boolean() == false && v["b"][1].boolean());
+
+        // the same as unpacked arrays, read and written
+        JsonValue unpacked;
+        JsonReader reader2(text.data(), text.size());
+        reader2.setPackArrays(false);
+        VERIFY(reader2.read(unpacked));
+        VERIFY(!unpacked["d"].isPacked() && unpacked == value && value == unpacked);
+        std::ostringstream out1, out2;
+        value.write(out1);
+        unpacked.write(out2);
+        VERIFY(out1.str() == out2.str());
+
+        // modifying: elements of the same kind keep the array packed; others unpack it
+        JsonValue d = value["d"];
+        d.append(100.5);
+        d.set(0, -1.0);
+        d.remove(1);
+        VERIFY(d.isPacked() && d.size() == 40 && d.doubles()[0] == -1.0 && d.doubles()[39] == 100.5);
+        VERIFY(value["d"].doubles().size() == 40 && v["d"].doubles()[0] == 0.5); // copy on write
+        d.append(1);
+        VERIFY(!d.isPacked() && d.size() == 41 && d[0].number() == -1.0 && d[40].isInteger());
+        VERIFY(d.pack() == false);
+        d.remove(40);
+        VERIFY(d.pack() && d.isPacked() && d.doubles().size() == 40);
+
+        JsonValue b = value["b"];
+        b[0] = "string"; // non-const access unpacks
+        VERIFY(!b.isPacked() && b[0].string() == "string" && b[1].boolean());
+
+        JsonValue empty(JsonValue::Type::Array);
+        VERIFY(!empty.pack());
+    }
+
+    ////////////////////////////////////////
+
+    {
+        // packed and columnar arrays are serialized from their storage, without making JsonValues for their elements
+        struct CountingResource : public std::pmr::memory_resource
+        {
+            int allocated = 0;
+            void* do_allocate(size_t bytes, size_t alignment) override { ++allocated; return std::pmr::new_delete_resource()->allocate(bytes, alignment); }
+            void do_deallocate(void* p, size_t bytes, size_t alignment) override { std::pmr::new_delete_resource()->deallocate(p, bytes, alignment); }
+            bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+        } resource;
+
+        std::string text = "{\"d\": [";
+        for (int i = 0; i < 20; ++i) { text += (i ? ", " : "") + std::to_string(i) + ".5"; }
+        text += "], \"i\": [";
+        for (int i = 0; i < 20; ++i) { text += (i ? ", " : "") + std::to_string(i - 10); }
+        text += "], \"b\": [";
+        for (int i = 0; i < 20; ++i) { text += (i ? ", " : "") + std::string(i % 3 ? "true" : "false"); }
+        text += "], \"rows\": [";
+        for (int i = 0; i < 20; ++i) { text += (i ? ", " : "") + std::string("{\"n\": ") + std::to_string(i) + ", \"s\": [" + std::to_string(i) + "]}"; }
+        text += "]}";
+
+        JsonValue value;
+        JsonReader reader(text.data(), text.size());
+        reader.setResource(&resource);
+        reader.setColumnarArrays(true);
+        VERIFY(reader.read(value));
+        const JsonValue& v = value;
+        VERIFY(v["d"].isPacked() && v["i"].isPacked() && v["b"].isPacked() && v["rows"].isColumnar());
+
+        int allocated = resource.allocated;
+        std::vector<uint8_t> cbor, msgpack, snapshot;
+        CborWriter(cbor).write(value);
+        MsgPackWriter(msgpack).write(value);
+        JsonSnapshot::write(value, snapshot);
+        std::ostringstream json;
+        value.write(json);
+        VERIFY(resource.allocated == allocated);
+
+        JsonValue plain;
+        JsonReader plainReader(text.data(), text.size());
+        plainReader.setPackArrays(false);
+        VERIFY(plainReader.read(plain));
+        JsonValue fromCbor, fromMsgPack;
+        VERIFY(CborReader(cbor.data(), cbor.size()).read(fromCbor) && fromCbor == plain);
+        VERIFY(MsgPackReader(msgpack.data(), msgpack.size()).read(fromMsgPack) && fromMsgPack == plain);
+        JsonSnapshot image(snapshot.data(), snapshot.size());
+        VERIFY(image.root().toValue() == plain && image.root()["rows"][3]["s"][0].int64() == 3);
+    }
+
+    ////////////////////////////////////////
+
+    {
+        // columnar arrays
+        std::string text = "[";
+        for (int i = 0; i < 30; ++i)
+        {
+            text += (i ? ", " : "") + std::string("{\"ts\": ") + std::to_string(1000 + i) + ", \"host\": \"h" + std::to_string(i % 3) +
+                "\", \"value\": " + std::to_string(i) + ".25, \"tags\": [" + std::to_string(i) + "]}";
+        }
+        text += "]";
+
+        JsonValue rows;
+        JsonReader reader(text.data(), text.size());
+        reader.setColumnarArrays(true);
+        VERIFY(reader.read(rows));
+        JsonValue plain;
+        JsonReader reader2(text.data(), text.size());
+        VERIFY(reader2.read(plain));
+        VERIFY(rows.isColumnar() && !plain.isColumnar() && rows.size() == 30);
+
+        const JsonValue& r = rows;
+        VERIFY(r.column("ts").integers().size() == 30 && r.column("ts").integers()[29] == 1029);
+        VERIFY(r.column("host")[2].string() == "h2" && r.column("missing").isInvalid() && plain.column("ts").isInvalid());
+        double sum = 0;
+        for (double v : r.column("value").doubles()) { sum += v; }
+        VERIFY(sum == 435 + 30 * 0.25);
+        VERIFY(r[4]["ts"].int64() == 1004 && r[4]["host"].string() == "h1" && r[4]["tags"][0] == JsonValue(4) && r[4].size() == 4);
+        VERIFY(r[30].isInvalid());
+
+        // compared and written the same as an ordinary array
+        VERIFY(rows == plain && plain == rows);
+        std::ostringstream out1, out2, out3, out4;
+        rows.write(out1);
+        plain.write(out2);
+        VERIFY(out1.str() == out2.str());
+        rows.write(out3, true);
+        plain.write(out4, true);
+        VERIFY(out3.str() == out4.str());
+        JsonValue copy = rows;
+        VERIFY(copy == rows);
+
+        // changes unpack it, without affecting copies
+        copy.append(JsonValue(JsonValue::Type::Object));
+        VERIFY(!copy.isColumnar() && copy.size() == 31 && copy[3]["host"].string() == "h0" && rows.isColumnar());
+        copy.remove(30);
+        VERIFY(copy == rows && copy.toColumns() && copy.isColumnar() && copy == rows);
+        copy[0]["ts"] = 1;
+        VERIFY(!copy.isColumnar() && copy[0]["ts"] == JsonValue(1) && r[0]["ts"] == JsonValue(1000));
+
+        // only arrays of objects with the same keys
+        std::istringstream differ("[{\"a\": 1}, {\"b\": 1}]"), scalars("[1, 2]"), empties("[{}, {}]");
+        JsonValue value;
+        VERIFY(value.read(differ) && !value.toColumns());
+        VERIFY(value.read(scalars) && !value.toColumns());
+        VERIFY(value.read(empties) && !value.toColumns());
+    }
+
+    ////////////////////////////////////////
+
+    {
+        // writing on several threads gives the same output
+        JsonValue root(JsonValue::Type::Object);
+        JsonValue items(JsonValue::Type::Array);
+        for (int i = 0; i < 10000; ++i)
+        {
+            JsonValue item;
+            item.set("id", i);
+            item.set("name", "item \"" + std::to_string(i) + "\"");
+            item.set("weight", i * 0.1);
+            if (i % 7 == 0)
+            {
+                JsonValue tags;
+                tags.append("x");
+                tags.append(JsonValue(nullptr));
+                item.set("tags", tags);
+            }
+            items.append(item);
+        }
+        root.set("items", items);
+        JsonValue numbers(JsonValue::Type::Array);
+        for (int i = 0; i < 5000; ++i) { numbers.append(i * 1.5); }
+        VERIFY(numbers.pack());
+        root.set("numbers", numbers);
+        JsonValue records(JsonValue::Type::Array);
+        for (int i = 0; i < 5000; ++i)
+        {
+            JsonValue record;
+            record.set("a", i);
+            record.set("b", JsonValue(JsonValue::Type::Array));
+            records.append(record);
+        }
+        VERIFY(records.toColumns());
+        root.set("records", records);
+        for (int i = 0; i < 5000; ++i) { root.set("key" + std::to_string(i), i % 2 == 0); }
+
+        for (int indent : { 2, 0, -1 })
+        {
+            const JsonValue& value = (indent >= 0) ? root : records; // a columnar array at the top
+            int spaces = (indent >= 0) ? indent : 1;
+            std::ostringstream serial, parallel;
+            JsonStats serialStats, parallelStats;
+            JsonWriter writer1(serial);
+            writer1.setIndent(spaces);
+            writer1.setStats(&serialStats);
+            writer1.write(value);
+            JsonWriter writer2(parallel);
+            writer2.setIndent(spaces);
+            writer2.setThreads(4);
+            writer2.setStats(&parallelStats);
+            writer2.write(value);
+            VERIFY(writer2.threads() == 4);
+            VERIFY(serial.str() == parallel.str());
+            VERIFY(serialStats.maxDepth == parallelStats.maxDepth && serialStats.stringBytes == parallelStats.stringBytes);
+            VERIFY(serialStats.values(JsonValue::Type::Object) == parallelStats.values(JsonValue::Type::Object));
+            VERIFY(serialStats.values(JsonValue::Type::Number) == parallelStats.values(JsonValue::Type::Number));
+        }
+
+        // the writer keeps its threads for later writes, and replaces them if the number changes
+        std::ostringstream serial, parallel;
+        JsonWriter(serial).write(root);
+        JsonWriter writer(parallel);
+        for (int threads : { 3, 3, 2 })
+        {
+            writer.setThreads(threads);
+            writer.write(root);
+            VERIFY(parallel.str() == serial.str());
+            parallel.str("");
+        }
+    }
+
+    ////////////////////////////////////////
+
+    {
+        // JSON Patch
+        auto parse = [](const char* text)
+        {
+            JsonValue value;
+            std::istringstream stream(text);
+            JsonReader reader(stream);
+            reader.setPackArrays(false);
+            reader.read(value); // invalid if the text is, which the tests below would notice
+            return value;
+        };
+
+        // diff gives a patch that applies to give the other value
+        const char* pairs[][2] =
+        {
+            { "{\"a\": 1, \"b\": [1, 2, 3], \"c\": {\"d\": \"x\"}}", "{\"a\": 2, \"b\": [1, 5], \"c\": {\"e\": null}, \"f\": true}" },
+            { "[1, [2, 3], {\"a/b\": 1, \"m~n\": 2}]", "[1, [2, 3, 4, 5], {\"a/b\": 3}, 6]" },
+            { "{\"a\": [1, 2]}", "[\"a\"]" },
+            { "[]", "[[], {}, null]" },
+            { "\"x\"", "\"x\"" },
+        };
+        for (auto& pair : pairs)
+        {
+            JsonValue a = parse(pair[0]);
+            JsonValue b = parse(pair[1]);
+            JsonValue patch = a.diff(b);
+            VERIFY(a.apply(patch));
+            VERIFY(a == b);
+            VERIFY(a.diff(b).size() == 0);
+        }
+        JsonValue escaped = parse("{\"a/b\": 1, \"m~n\": 2}").diff(parse("{\"a/b\": 3}"));
+        VERIFY(escaped == parse("[{\"op\": \"replace\", \"path\": \"/a~1b\", \"value\": 3}, {\"op\": \"remove\", \"path\": \"/m~0n\"}]"));
+
+        // shared parts aren't compared, or copied by apply
+        JsonValue big = parse("{\"list\": [1, 2, 3], \"other\": {\"x\": 1}}");
+        JsonValue changed = big;
+        changed.get("other").set("x", 2);
+        VERIFY(big.diff(changed) == parse("[{\"op\": \"replace\", \"path\": \"/other/x\", \"value\": 2}]"));
+        const JsonValue& list = big["list"];
+        JsonValue copy = big;
+        VERIFY(copy.apply(big.diff(changed)));
+        const JsonValue& patched = copy;
+        VERIFY(patched == changed && &patched["list"][0] == &list[0]);
+
+        // examples from RFC 6902
+        JsonValue value = parse("{\"foo\": [\"bar\", \"baz\"], \"qux\": {\"baz\": \"foo\"}}");
+        VERIFY(value.apply(parse("[{\"op\": \"add\", \"path\": \"/foo/1\", \"value\": \"qux\"}]")));
+        VERIFY(value == parse("{\"foo\": [\"bar\", \"qux\", \"baz\"], \"qux\": {\"baz\": \"foo\"}}"));
+        VERIFY(value.apply(parse("[{\"op\": \"move\", \"from\": \"/qux/baz\", \"path\": \"/foo/-\"}, {\"op\": \"copy\", \"from\": \"/foo/0\", \"path\": \"/bar\"}]")));
+        VERIFY(value == parse("{\"foo\": [\"bar\", \"qux\", \"baz\", \"foo\"], \"qux\": {}, \"bar\": \"bar\"}"));
+        VERIFY(value.apply(parse("[{\"op\": \"test\", \"path\": \"/foo/3\", \"value\": \"foo\"}, {\"op\": \"remove\", \"path\": \"/qux\"}]")));
+        VERIFY(value == parse("{\"foo\": [\"bar\", \"qux\", \"baz\", \"foo\"], \"bar\": \"bar\"}"));
+
+        // if anything fails, nothing changes
+        JsonValue before = value;
+        const char* failures[] =
+        {
+            "[{\"op\": \"remove\", \"path\": \"/bar\"}, {\"op\": \"test\", \"path\": \"/foo/0\", \"value\": \"baz\"}]",
+            "[{\"op\": \"add\", \"path\": \"/missing/a\", \"value\": 1}]",
+            "[{\"op\": \"add\", \"path\": \"/foo/5\", \"value\": 1}]",
+            "[{\"op\": \"remove\", \"path\": \"/foo/01\"}]",
+            "[{\"op\": \"move\", \"from\": \"/foo\", \"path\": \"/foo/0\"}]",
+            "[{\"op\": \"replace\", \"path\": \"/nothing\", \"value\": 1}]",
+            "[{\"op\": \"add\", \"path\": \"bar\", \"value\": 1}]",
+            "[{\"op\": \"launch\", \"path\": \"/bar\"}]",
+            "{\"op\": \"remove\", \"path\": \"/bar\"}",
+        };
+        for (const char* failure : failures)
+        {
+            VERIFY(!value.apply(parse(failure)));
+            VERIFY(value == before);
+        }
+        VERIFY(value.apply(parse("[{\"op\": \"replace\", \"path\": \"\", \"value\": [1]}]")));
+        VERIFY(value == parse("[1]"));
+    }
+
+    ////////////////////////////////////////
+
+    {
+        // hashing
+        auto parse = [](const char* text, bool raw, bool columnar)
+        {
+            JsonValue value;
+            std::istringstream stream(text);
+            JsonReader reader(stream);
+            reader.setRawNumbers(raw);
+            reader.setColumnarArrays(columnar);
+            reader.read(value);
+            return value;
+        };
+
+        // equal values hash the same, however they're stored
+        std::string rows = "[";
+        for (int i = 0; i < 20; ++i)
+        {
+            rows += (i > 0 ? ", " : "") + std::string("{\"b\": [") + std::to_string(i) + ", 2.5], \"a\": " + std::to_string(i) + ".0}";
+        }
+        rows += "]";
+        std::string numbers = "[1.0, 2, 3e0, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18446744073709551615]";
+        for (const std::string& text : { rows, numbers })
+        {
+            JsonValue a = parse(text.c_str(), false, false);
+            JsonValue b = parse(text.c_str(), true, true);
+            VERIFY(a == b && a.hash() == b.hash());
+            VERIFY(a.hash() == a.hash() && std::hash<JsonValue>()(a) == a.hash());
+        }
+        VERIFY(parse(rows.c_str(), false, true).isColumnar());
+        JsonValue packed = parse("[1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17]", false, false);
+        JsonValue unpacked = packed;
+        unpacked.unpack();
+        VERIFY(packed.isPacked() && !unpacked.isPacked() && packed.hash() == unpacked.hash());
+        VERIFY(JsonValue(1).hash() == JsonValue(1.0).hash() && JsonValue(0.0).hash() == JsonValue(-0.0).hash());
+
+        // member order doesn't matter, but element order does
+        JsonValue ab(JsonValue::Type::Object), ba(JsonValue::Type::Object);
+        ab.set("a", 1);
+        ab.set("b", "x");
+        ba.set("b", "x");
+        ba.set("a", 1);
+        VERIFY(ab.hash() == ba.hash());
+        VERIFY(parse("[1, 2]", false, false).hash() != parse("[2, 1]", false, false).hash());
+        VERIFY(parse("{\"a\": 1, \"b\": 2}", false, false).hash() != parse("{\"a\": 2, \"b\": 1}", false, false).hash());
+        VERIFY(parse("[[]]", false, false).hash() != parse("[{}]", false, false).hash());
+
+        // changing a value changes its hash, including through its children
+        JsonValue doc = parse("{\"a\": {\"b\": [1, {\"c\": true}]}}", false, false);
+        JsonValue copy = doc;
+        size_t before = doc.hash();
+        doc.get("a").get("b").get(1).set("c", false);
+        VERIFY(doc.hash() != before && copy.hash() == before);
+        VERIFY(doc != copy && doc.hash() == parse("{\"a\": {\"b\": [1, {\"c\": false}]}}", false, false).hash());
+        doc.get("a").get("b").get(1).set("c", true);
+        VERIFY(doc == copy && doc.hash() == before);
+
+        // values can be kept in unordered containers
+        std::unordered_set<JsonValue> set;
+        set.insert(parse("{\"id\": 1, \"tags\": [\"x\"]}", false, false));
+        set.insert(parse("{\"tags\": [\"x\"], \"id\": 1.0}", true, false));
+        set.insert(parse("{\"id\": 2, \"tags\": [\"x\"]}", false, false));
+        VERIFY(set.size() == 2);
+
+        // deep values don't overflow the stack
+        JsonValue deep;
+        for (int i = 0; i < 100000; ++i)
+        {
+            JsonValue outer(JsonValue::Type::Array);
+            outer.append(deep);
+            deep = std::move(outer);
+        }
+        VERIFY(deep.hash() != 0);
+    }
+
+    ////////////////////////////////////////
+
+    {
+        // validating without reading
+        std::ifstream file("test.json");
+        std::string text((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        VERIFY(!text.empty() && validate(text.data(), text.size()));
+
+        const char* valid[] = { "0", " [] ", "{}", "\"\"", "-1.5e+10", "[1, [true, false, null], {\"a\": {\"b\": []}}]",
+            "\"escapes \\\" \\\\ \\/ \\b \\f \\n \\r \\t \\u00e9 \\ud83d\\ude00\"", "\"long string without escapes, more than eight bytes\"",
+            "{\"a\" : 1 , \"b\" : [ 2 ] }\r\n" };
+        for (const char* s : valid)
+        {
+            JsonValue value;
+            JsonReader reader(s, strlen(s));
+            VERIFY(reader.read(value) && validate(s, strlen(s)));
+        }
+
+        // the offset of the first character that's wrong
+        struct Invalid { const char* text; size_t offset; };
+        const Invalid invalid[] = { { "", 0 }, { "  ", 2 }, { "[1,]", 3 }, { "[1 2]", 3 }, { "{\"a\" 1}", 5 }, { "{\"a\": 1,}", 8 },
+            { "{1: 2}", 1 }, { "[1}", 2 }, { "]", 0 }, { "[", 1 }, { "01", 0 }, { "[1.]", 1 }, { "tru", 0 }, { "nul1", 0 },
+            { "\"abc", 4 }, { "\"a\\x\"", 3 }, { "\"\\u12g4\"", 2 }, { "\"tab\tin a long string\"", 4 }, { "[1] x", 4 }, { "1 2", 2 } };
+        for (const Invalid& i : invalid)
+        {
+            size_t offset = 12345;
+            VERIFY(!validate(i.text, strlen(i.text), &offset) && offset == i.offset);
+        }
+
+        // no depth limit, and no recursion
+        std::string deep = std::string(100000, '[') + std::string(100000, ']');
+        VERIFY(validate(deep.data(), deep.size()));
+        deep.pop_back();
+        VERIFY(!validate(deep.data(), deep.size()));
+    }
+
+    ////////////////////////////////////////
+
+    {
+        // invalid UTF-8 in strings
+        using InvalidUtf8 = JsonReader::InvalidUtf8;
+        // read a document holding one string from memory, from a stream, and in situ, which should all agree
+        auto readString = [](const std::string& text, InvalidUtf8 invalidUtf8, std::string& result)
+        {
+            std::string results[3];
+            bool success[3];
+            for (int how = 0; how < 3; ++how)
+            {
+                std::vector<char> buffer(text.begin(), text.end());
+                std::istringstream stream(text);
+                JsonReader memoryReader(text.data(), text.size());
+                JsonReader streamReader(stream);
+                JsonReader inSituReader(buffer.data(), buffer.size(), JsonReader::InSitu());
+                JsonReader& reader = (how == 0) ? memoryReader : (how == 1) ? streamReader : inSituReader;
+                reader.setInvalidUtf8(invalidUtf8);
+                JsonValue value;
+                success[how] = reader.read(value) && value.isString();
+                results[how] = success[how] ? value.string() : "";
+            }
+            result = results[0];
+            return success[0] == success[1] && success[0] == success[2] && results[0] == results[1] && results[0] == results[2] && success[0];
+        };
+
+        const std::string replacement = "\xef\xbf\xbd";
+        const std::string valid = "\"h\xc3\xa9llo \xe2\x82\xac \xf0\x9f\x98\x80 \xf4\x8f\xbf\xbf \\u00e9 \\ud83d\\ude00 long enough to scan by words\"";
+        for (InvalidUtf8 mode : { InvalidUtf8::Accept, InvalidUtf8::Reject, InvalidUtf8::Replace })
+        {
+            std::string result;
+            VERIFY(readString(valid, mode, result));
+            VERIFY(result == "h\xc3\xa9llo \xe2\x82\xac \xf0\x9f\x98\x80 \xf4\x8f\xbf\xbf \xc3\xa9 \xf0\x9f\x98\x80 long enough to scan by words");
+        }
+
+        // each invalid sequence, and what it's replaced with
+        const char* invalid[][2] =
+        {
+            { "\x80", "R" },
+            { "\xff", "R" },
+            { "a\xc3(b", "aR(b" },            // truncated
+            { "\xc0\xaf", "RR" },             // overlong
+            { "\xe0\x80\x80", "RRR" },        // overlong
+            { "\xed\xa0\x80", "RRR" },        // surrogate
+            { "\xf4\x90\x80\x80", "RRRR" },   // over U+10FFFF
+            { "\xf0\x9f\x98", "R" },          // truncated: one replacement for the start of a valid sequence
+            { "\xf0\x9f\x98 text", "R text" },
+            { "\\ud800", "R" },               // escaped unpaired surrogate
+            { "\\udc00\\u0041", "RA" },
+            { "12345678\x80\\u0041\x80\\n\x80\x80\x80", "12345678RAR\nRRR" }, // some replacements fit in situ, and some don't
+        };
+        for (auto& i : invalid)
+        {
+            std::string text = std::string("\"") + i[0] + "\"";
+            std::string expected;
+            for (const char* c = i[1]; *c; ++c)
+            {
+                expected += (*c == 'R') ? replacement : std::string(1, *c);
+            }
+            std::string result;
+            VERIFY(readString(text, InvalidUtf8::Replace, result) && result == expected);
+            VERIFY(!readString(text, InvalidUtf8::Reject, result));
+            VERIFY(readString(text, InvalidUtf8::Accept, result));
+        }
+    }
+
+    ////////////////////////////////////////
+
+    {
+        // escaping strings
+        auto write = [](const JsonValue& value, bool asciiOnly, bool escapeSlash)
+        {
+            std::ostringstream stream;
+            JsonWriter writer(stream);
+            writer.setIndent(0);
+            writer.setAsciiOnly(asciiOnly);
+            writer.setEscapeSlash(escapeSlash);
+            writer.write(value);
+            return stream.str();
+        };
+        const std::string text = "caf\xc3\xa9 \xe2\x82\xac \xf0\x9f\x98\x80 </script> \"q\" \\ \x01\x1f\t";
+        JsonValue value(JsonValue::Type::Object);
+        value.set(text, text);
+        std::string escaped = "\"caf\xc3\xa9 \xe2\x82\xac \xf0\x9f\x98\x80 </script> \\\"q\\\" \\\\ \\u0001\\u001f\\t\"";
+        VERIFY(write(value, false, false) == "{\n" + escaped + ": " + escaped + "\n}");
+        VERIFY(write(JsonValue(text), true, true) == "\"caf\\u00e9 \\u20ac \\ud83d\\ude00 <\\/script> \\\"q\\\" \\\\ \\u0001\\u001f\\t\"");
+        VERIFY(write(JsonValue("a long string to be skipped by words/"), false, true) == "\"a long string to be skipped by words\\/\"");
+
+        // the output reads back as the same string, and invalid UTF-8 is replaced
+        for (bool asciiOnly : { false, true })
+        {
+            std::string out = write(JsonValue(text), asciiOnly, true);
+            JsonValue read;
+            JsonReader reader(out.data(), out.size());
+            VERIFY(reader.read(read) && read.stringView() == text);
+        }
+        VERIFY(write(JsonValue("a\xc3(\xed\xa0\x80\xff"), true, false) == "\"a\\ufffd(\\ufffd\\ufffd\\ufffd\\ufffd\"");
+        VERIFY(write(JsonValue("\xf4\x8f\xbf\xbf\xef\xbf\xbf"), true, false) == "\"\\udbff\\udfff\\uffff\"");
+    }
+
+    ////////////////////////////////////////
+
+    {
+        // reformatting without reading values
+        std::ifstream file("test.json");
+        std::string text((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        JsonValue original;
+        JsonReader originalReader(text.data(), text.size());
+        VERIFY(originalReader.read(original));
+
+        // minified, and then pretty-printed again, it's the same value
+        std::ostringstream minified;
+        JsonFormatter minifier(text.data(), text.size(), minified);
+        minifier.setIndent(JsonFormatter::k_minify);
+        VERIFY(minifier.format());
+        std::istringstream minifiedStream(minified.str());
+        std::ostringstream pretty;
+        JsonFormatter prettifier(minifiedStream, pretty);
+        VERIFY(prettifier.format());
+        for (const std::string& s : { minified.str(), pretty.str() })
+        {
+            JsonValue value;
+            JsonReader reader(s.data(), s.size());
+            VERIFY(reader.read(value) && value == original);
+        }
+        VERIFY(minified.str().find_first_of("\n\t") == std::string::npos && minified.str().size() < text.size());
+
+        // the same layout as JsonWriter, but with members in order, and strings and numbers as they were
+        const char* input = "  {\"b\":[1.10, 2e3,\"\\u00e9\\n\", [], {}, [[true]]],   \"a\" : {\"c\": null}}  [3] 4 ";
+        std::ostringstream out;
+        JsonFormatter formatter(input, strlen(input), out);
+        formatter.setIndent(1);
+        VERIFY(formatter.format() && formatter.format() && formatter.format() && !formatter.format());
+        VERIFY(out.str() == "{\n \"b\": [\n  1.10,\n  2e3,\n  \"\\u00e9\\n\",\n  [],\n  {},\n  [\n   [\n    true\n   ]\n  ]\n ],\n \"a\": {\n  \"c\": null\n }\n}[\n 3\n]4");
+        JsonValue sorted;
+        JsonReader sortedReader(input, strlen(input));
+        VERIFY(sortedReader.read(sorted));
+        sorted.set("b", JsonValue(JsonValue::Type::Array));
+        std::ostringstream written, reformatted;
+        JsonWriter writer(written);
+        writer.write(sorted);
+        std::string writtenText = written.str();
+        JsonFormatter formatter2(writtenText.data(), writtenText.size(), reformatted);
+        VERIFY(formatter2.format() && reformatted.str() == writtenText);
+
+        // invalid input
+        const char* invalid[] = { "[1,]", "{\"a\" 1}", "{1: 2}", "[1}", "]", "", "[1.]", "{\"a\": 1", "\"abc" };
+        for (const char* s : invalid)
+        {
+            std::ostringstream discard;
+            JsonFormatter f(s, strlen(s), discard);
+            VERIFY(!f.format());
+        }
+
+        // deep input doesn't overflow the stack
+        std::string deep = std::string(100000, '[') + std::string(100000, ']');
+        std::ostringstream deepOut;
+        JsonFormatter deepFormatter(deep.data(), deep.size(), deepOut);
+        deepFormatter.setIndent(JsonFormatter::k_minify);
+        VERIFY(deepFormatter.format() && deepOut.str() == deep);
+    }
+
+    ////////////////////////////////////////
+
+    {
+        // compressed streams
+        JsonValue records(JsonValue::Type::Array);
+        for (int i = 0; i < 20000; ++i)
+        {
+            JsonValue record;
+            record.set("id", i);
+            record.set("name", "record " + std::to_string(i * 7919 % 10007));
+            records.append(record);
+        }
+        std::ostringstream plain;
+        records.write(plain);
+
+        for (Compression compression : { Compression::None, Compression::Gzip, Compression::Zstd })
+        {
+            if (!isCompressionAvailable(compression))
+            {
+                std::ostringstream discard;
+                bool threw = false;
+                try { CompressingStream out(discard, compression); } catch (const std::runtime_error&) { threw = true; }
+                VERIFY(threw);
+                continue;
+            }
+
+            // two values, written and compressed separately, and concatenated
+            std::ostringstream compressed;
+            for (int i = 0; i < 2; ++i)
+            {
+                CompressingStream out(compressed, compression);
+                JsonWriter writer(out);
+                writer.write(records);
+                VERIFY(out.finish());
+            }
+            if (compression != Compression::None)
+            {
+                VERIFY(compressed.str().size() < plain.str().size() / 2);
+            }
+
+            for (Compression reading : { compression, Compression::Auto })
+            {
+                std::istringstream in(compressed.str());
+                DecompressingStream decompressed(in, reading);
+                JsonReader reader(decompressed);
+                JsonValue first, second;
+                VERIFY(reader.read(first) && first == records);
+                VERIFY(reader.read(second) && second == records);
+                VERIFY(!reader.read(second));
+            }
+
+            // data that ends early, or is corrupt, fails to read
+            if (compression != Compression::None)
+            {
+                std::string data = compressed.str().substr(0, compressed.str().size() / 3);
+                std::istringstream truncated(data);
+                DecompressingStream truncatedStream(truncated);
+                JsonReader truncatedReader(truncatedStream);
+                JsonValue value;
+                VERIFY(!truncatedReader.read(value));
+
+                data = compressed.str();
+                data[data.size() / 2] ^= 0x55;
+                data[data.size() / 2 + 1] ^= 0x55;
+                std::istringstream corrupt(data);
+                DecompressingStream corruptStream(corrupt);
+                JsonReader corruptReader(corruptStream);
+                VERIFY(!corruptReader.read(value) || !corruptReader.read(value) || value != records);
+            }
+        }
+    }
+
+    ////////////////////////////////////////
+
     std::cout << "...done" << std::endl;
     return 0;
 }